@@ -27,6 +27,7 @@ Obviously not thread safe while any bit gets modified
 #define BITMASK2D_H
 #include <vector>
 #include <stdexcept>
+#include <algorithm>
 
 #if defined(PACKER)
 #include "Packer.h"
@@ -110,6 +111,54 @@ template <typename T = unsigned long long> class BitMap2D
         return _bits.size() * sizeof(T);
     }
 
+    // Width and height in storage units
+    int getUnitWidth() const
+    {
+        return _lw;
+    }
+
+    int getUnitHeight() const
+    {
+        return Chunks<TGSIZE>(_h);
+    }
+
+    // A whole storage unit, bit TGSIZE * (y % TGSIZE) + x % TGSIZE is the pixel at x, y
+    T getUnit(int ux, int uy) const
+    {
+        return _bits[_lw * uy + ux];
+    }
+
+    void setUnit(int ux, int uy, T val)
+    {
+        _bits[_lw * uy + ux] = val;
+    }
+
+    // The storage units, row by row
+    const T *data() const
+    {
+        return _bits.data();
+    }
+
+    // True if no bit is set, ignoring the bits past the right and bottom edges
+    bool isEmpty() const
+    {
+        const int uw = getUnitWidth(), uh = getUnitHeight();
+        const int w = getWidth(), h = getHeight();
+        for (int uy = 0; uy < uh; uy++)
+            for (int ux = 0; ux < uw; ux++)
+            {
+                if (getUnit(ux, uy) == 0)
+                    continue;
+                if (ux < uw - 1 && uy < uh - 1)
+                    return false; // Inner unit
+                for (int y = uy * TGSIZE; y < std::min(h, (uy + 1) * TGSIZE); y++)
+                    for (int x = ux * TGSIZE; x < std::min(w, (ux + 1) * TGSIZE); x++)
+                        if (isSet(x, y))
+                            return false;
+            }
+        return true;
+    }
+
     // Returns the condition of a specific bit
     bool isSet(int x, int y) const
     {
@@ -45,7 +45,7 @@ var Jpeg12Layer = L.GridLayer.extend({
     if (!tile.raw) return;
     let width = tile.width;
     let height = tile.height;
-    let image = JPEG12.decode(tile.raw, { width: width, height: height, numComponents: 1});
+    let image = JPEG12.decode(tile.raw, { width: width, height: height, numComponents: 1}, true);
 
     let min = +slider.noUiSlider.get()[0];
     let max = +slider.noUiSlider.get()[1];
@@ -55,10 +55,10 @@ var Jpeg12Layer = L.GridLayer.extend({
     let imageData = ctx.createImageData(width, height);
     let uintview = new Uint32Array(imageData.data.buffer, 0, width * height);
     const scale = 256 / (max - min);
-    const ALPHA = 0xff000000; // Opaque
+    // The Zen mask is the alpha, invalid pixels are transparent
     for (let i = 0; i < width * height; i++) {
       let c = Math.max(0, Math.min(255, (image.data[i] - min) * scale)) |0;
-      uintview[i] = ALPHA | 0x10101 * c;
+      uintview[i] = (image.mask[i] << 24) | 0x10101 * c;
     }
 
     ctx.putImageData(imageData, 0, 0);
@@ -128,6 +128,8 @@ static size_t toYarn(const char *ibuffer, char *obuf, size_t len,
 // C decompress function, returns actual decompressed size
 // Stops when either olen is reached or when ilen is exhausted
 // returns the number of output bytes written
+// Literal spans are found with memchr and copied in one go, the marker
+// is rare since it is the least used byte value
 //
 static size_t fromYarn(const char *ibuffer, size_t ilen, char *obuf,
                        size_t olen, Byte CODE = 0xC3)
@@ -135,56 +137,64 @@ static size_t fromYarn(const char *ibuffer, size_t ilen, char *obuf,
     Byte *next = reinterpret_cast<Byte *>(obuf);
     while (ilen > 0 && olen > 0)
     {
-        // It is safe to read and write one byte
+        // Copy the literals up to the next marker, as far as both buffers go
+        const size_t span = std::min(ilen, olen);
+        const char *marker =
+            static_cast<const char *>(memchr(ibuffer, CODE, span));
+        if (marker != ibuffer)
+        {
+            const size_t count =
+                marker ? static_cast<size_t>(marker - ibuffer) : span;
+            memcpy(next, ibuffer, count);
+            next += count;
+            ibuffer += count;
+            ilen -= count;
+            olen -= count;
+            continue;
+        }
+
+        // Marker found, which type of sequence is it?
+        ibuffer++;
+        ilen--;
+        CHECK_INPUT;
         Byte b = NEXT_BYTE;
         ilen--;
-        if (b != CODE)
-        {  // Copy single chars
-            *next++ = b;
+        if (b == 0)
+        {  // Emit one code
+            *next++ = CODE;
             olen--;
         }
         else
-        {  // Marker found, which type of sequence is it?
-            CHECK_INPUT;
-            b = NEXT_BYTE;
-            ilen--;
-            if (b == 0)
-            {  // Emit one code
-                *next++ = CODE;
-                olen--;
-            }
-            else
-            {  // Sequence
-                size_t run = 0;
-                if (b < 4)
-                {
-                    run = 256 * b;
-                    if (3 == b)
-                    {  // Second byte of high count
-                        CHECK_INPUT;
-                        run += 256 * NEXT_BYTE;
-                        ilen--;
-                    }
+        {  // Sequence
+            size_t run = 0;
+            if (b < 4)
+            {
+                run = 256 * b;
+                if (3 == b)
+                {  // Second byte of high count
                     CHECK_INPUT;
-                    run += NEXT_BYTE;
+                    run += 256 * NEXT_BYTE;
                     ilen--;
                 }
-                else
-                {  // Single byte count
-                    run = b;
-                }
-
-                // Write the sequence out, after checking
-                if (olen < run)
-                    RET_NOW;
                 CHECK_INPUT;
-                b = NEXT_BYTE;
+                run += NEXT_BYTE;
                 ilen--;
-                memset(next, b, run);
-
-                next += run;
-                olen -= run;
             }
+            else
+            {  // Single byte count
+                run = b;
+            }
+
+            // Write the sequence out, after checking
+            if (olen < run)
+                RET_NOW;
+            CHECK_INPUT;
+            b = NEXT_BYTE;
+            ilen--;
+            memset(next, b, run);
+
+            next += run;
+            olen -= run;
         }
     }
     RET_NOW;
@@ -1,7 +1,14 @@
 rm -f *.o
 
 OPTIONS="-O3 -flto"
-for file in jpeg12-6b/*.c
+# SIMD=1 ./build.sh adds -msimd128, for the WebAssembly SIMD kernels in jpeg12-6b (see jsimd.h)
+# That module only loads in engines with SIMD128 support, the default one loads everywhere
+if [ "$SIMD" = "1" ]
+then
+    OPTIONS="$OPTIONS -msimd128"
+fi
+# The library sources, the check (ck*.c) and benchmark (bm*.c) programs are built natively on their own
+for file in jpeg12-6b/j*.c
 do
     echo $file
     emcc $OPTIONS -c $file
@@ -11,6 +18,10 @@ echo jpeg12api.cpp
 
 # define IGNORE_ZEN_CHUNK when compiling jpeg12api to disable zen chunk processing
 # it makes decoding about 5% faster, but zero values are not stable
+
+# add -pthread to OPTIONS and PARAMS for encodetiles to use more than one thread,
+# and -DPTHREAD_POOL_SIZE=N to OPTIONS and -sPTHREAD_POOL_SIZE=N to PARAMS for N worker threads,
+# four if not set. The tile functions never start more threads than that
 emcc $OPTIONS -c jpeg12api.cpp Packer_RLE.cpp
 
 echo Building jpeg12dec
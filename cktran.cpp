@@ -0,0 +1,122 @@
+//
+// Check program for transformimage, not part of the library
+// Every transform, with and without a crop, is run once with all the coefficients in memory and once
+// with a small JPEGMEM limit, so the virtual arrays go through the backing store. Both outputs must be
+// the same. Transposing twice must give back the output of TRANSFORM_NONE, a rotation would drop
+// the partial iMCUs at the edges
+// Any difference is reported, and the exit status is then non-zero
+//
+// Usage: cktran file.jpg ...
+//
+// Build with a native compiler, not emcc:
+// gcc -O2 -c jpeg12-6b/j*.c && g++ -O2 -o cktran cktran.cpp jpeg12api.cpp Packer_RLE.cpp *.o -pthread
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+    char *transformimage(uint8_t *, size_t, int, int, int, int, int, uint8_t *, size_t);
+}
+
+// The TRANSFORM codes of jpeg12api.cpp
+static const char *const transformNames[] = {"none",      "flip horizontal", "flip vertical", "transpose",
+                                             "transverse", "rotate 90",       "rotate 180",    "rotate 270"};
+
+// Kilobytes for JPEGMEM, a few block rows of a small image
+static const char *const memoryLimit = "20";
+
+static bool readFile(const char *name, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f)
+        return false;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.insert(data.end(), buffer, buffer + n);
+    const bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Runs transformimage, with the memory limit if limited
+// Returns the json of an error, or an empty string
+static std::string transform(std::vector<uint8_t> &input, int code, int x, int y, int width, int height,
+                             bool limited, std::vector<uint8_t> &output)
+{
+    if (limited)
+        setenv("JPEGMEM", memoryLimit, 1);
+    else
+        unsetenv("JPEGMEM");
+    output.resize(2 * input.size() + 65536);
+    char *result = transformimage(input.data(), input.size(), code, x, y, width, height, output.data(),
+                                  output.size());
+    const char *size = strstr(result, "\"outputSize\":");
+    std::string error;
+    if (strstr(result, "\"error\"") || !size)
+        error = result;
+    else
+        output.resize(strtoull(size + 13, nullptr, 10));
+    free(result);
+    return error;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s file.jpg ...\n", argv[0]);
+        return 2;
+    }
+
+    int bad = 0;
+    for (int arg = 1; arg < argc; arg++)
+    {
+        std::vector<uint8_t> input, full, limited, none, transposed, back;
+        const int before = bad;
+        if (!readFile(argv[arg], input))
+        {
+            perror(argv[arg]);
+            return 1;
+        }
+
+        // The whole image, then a crop that doesn't start on an iMCU boundary
+        for (int crop = 0; crop < 2; crop++)
+            for (int code = 0; code < 8; code++)
+            {
+                const int x = crop ? 17 : 0, y = crop ? 33 : 0, width = crop ? 300 : 0, height = crop ? 200 : 0;
+                std::string error = transform(input, code, x, y, width, height, false, full);
+                if (error.empty())
+                    error = transform(input, code, x, y, width, height, true, limited);
+                if (!error.empty() || full != limited)
+                {
+                    printf("%s: %s%s: %s\n", argv[arg], transformNames[code], crop ? ", cropped" : "",
+                           error.empty() ? "different with JPEGMEM" : error.c_str());
+                    bad++;
+                }
+            }
+
+        for (int limit = 0; limit < 2; limit++)
+        {
+            std::string error = transform(input, 0, 0, 0, 0, 0, limit, none);
+            if (error.empty())
+                error = transform(input, 3, 0, 0, 0, 0, limit, transposed);
+            if (error.empty())
+                error = transform(transposed, 3, 0, 0, 0, 0, limit, back);
+            if (!error.empty() || none != back)
+            {
+                printf("%s: transposed twice%s: %s\n", argv[arg], limit ? " with JPEGMEM" : "",
+                       error.empty() ? "not the same image" : error.c_str());
+                bad++;
+            }
+        }
+        printf("%s: %d differences\n", argv[arg], bad - before);
+    }
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * bmdecode.c
+ *
+ * This is a benchmark program, not part of the library.  It decompresses
+ * each file named on the command line over and over from memory, through
+ * jpeg_read_scanlines, and prints the time per decode.  It was written to
+ * measure the coefficient buffer clearing in jdcoefct.c, but any change to
+ * the decoder can be timed with it.
+ *
+ * Build it natively with the library, not with emcc:
+ *	gcc -O2 -o bmdecode jpeg12-6b/bmdecode.c jpeg12-6b/j*.c
+ * and run it as
+ *	./bmdecode [-n count] [-dct int|float] file.jpg ...
+ * Set JSIMD_FORCENONE=1 to time the C IDCT routines.
+ */
+
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jerror.h"
+#include <time.h>
+
+
+/* A source manager for a file held in memory */
+
+METHODDEF(void)
+init_source (j_decompress_ptr cinfo)
+{
+}
+
+METHODDEF(boolean)
+fill_input_buffer (j_decompress_ptr cinfo)
+{
+  static const JOCTET eoi[2] = { (JOCTET) 0xFF, (JOCTET) JPEG_EOI };
+
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+  cinfo->src->next_input_byte = eoi;
+  cinfo->src->bytes_in_buffer = 2;
+  return TRUE;
+}
+
+METHODDEF(void)
+skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+  if (num_bytes <= 0)
+    return;
+  if ((size_t) num_bytes > cinfo->src->bytes_in_buffer)
+    num_bytes = (long) cinfo->src->bytes_in_buffer;
+  cinfo->src->next_input_byte += num_bytes;
+  cinfo->src->bytes_in_buffer -= (size_t) num_bytes;
+}
+
+METHODDEF(void)
+term_source (j_decompress_ptr cinfo)
+{
+}
+
+
+/* Decompress the file once, returns the number of samples */
+
+LOCAL(long)
+decode_once (j_decompress_ptr cinfo, struct jpeg_source_mgr * src,
+	     const JOCTET * data, size_t size, J_DCT_METHOD dct_method)
+{
+  JSAMPARRAY buffer;
+  long samples;
+
+  src->next_input_byte = data;
+  src->bytes_in_buffer = size;
+  cinfo->src = src;
+  jpeg_read_header(cinfo, TRUE);
+  cinfo->dct_method = dct_method;
+  jpeg_start_decompress(cinfo);
+  buffer = (*cinfo->mem->alloc_sarray)
+    ((j_common_ptr) cinfo, JPOOL_IMAGE,
+     cinfo->output_width * cinfo->output_components, 1);
+  while (cinfo->output_scanline < cinfo->output_height)
+    jpeg_read_scanlines(cinfo, buffer, 1);
+  samples = (long) cinfo->output_width * cinfo->output_height *
+    cinfo->output_components;
+  jpeg_finish_decompress(cinfo);
+  return samples;
+}
+
+
+LOCAL(JOCTET *)
+read_file (const char * name, size_t * size)
+{
+  FILE * file;
+  JOCTET * data = NULL;
+  long length;
+
+  if ((file = fopen(name, "rb")) == NULL)
+    return NULL;
+  if (fseek(file, 0L, SEEK_END) == 0 && (length = ftell(file)) > 0 &&
+      fseek(file, 0L, SEEK_SET) == 0 &&
+      (data = (JOCTET *) malloc((size_t) length)) != NULL &&
+      JFREAD(file, data, (size_t) length) != (size_t) length) {
+    free(data);
+    data = NULL;
+  }
+  *size = (data != NULL) ? (size_t) length : 0;
+  fclose(file);
+  return data;
+}
+
+
+int
+main (int argc, char ** argv)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  struct jpeg_source_mgr src;
+  J_DCT_METHOD dct_method = JDCT_DEFAULT;
+  int count = 20;
+  int arg, n;
+  JOCTET * data;
+  size_t size;
+  long samples;
+  clock_t start;
+  double seconds;
+
+  for (arg = 1; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+    if (strcmp(argv[arg], "-n") == 0)
+      count = atoi(argv[arg + 1]);
+    else if (strcmp(argv[arg], "-dct") == 0)
+      dct_method = (strcmp(argv[arg + 1], "int") == 0) ?
+	JDCT_ISLOW : JDCT_FLOAT;
+    else
+      break;
+  }
+  if (arg >= argc || count <= 0) {
+    fprintf(stderr, "usage: %s [-n count] [-dct int|float] file.jpg ...\n",
+	    argv[0]);
+    return 2;
+  }
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+  src.init_source = init_source;
+  src.fill_input_buffer = fill_input_buffer;
+  src.skip_input_data = skip_input_data;
+  src.resync_to_restart = jpeg_resync_to_restart;
+  src.term_source = term_source;
+
+  for (; arg < argc; arg++) {
+    if ((data = read_file(argv[arg], &size)) == NULL) {
+      perror(argv[arg]);
+      continue;
+    }
+    /* One decode to warm the caches, not timed */
+    samples = decode_once(&cinfo, &src, data, size, dct_method);
+    start = clock();
+    for (n = 0; n < count; n++)
+      decode_once(&cinfo, &src, data, size, dct_method);
+    seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    printf("%s: %ld samples, %.3f ms per decode, %.1f Msamples/s\n",
+	   argv[arg], samples, 1000.0 * seconds / count,
+	   samples * count / seconds / 1e6);
+    free(data);
+  }
+
+  jpeg_destroy_decompress(&cinfo);
+  return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * ckjsimd.c
+ *
+ * This is a check program, not part of the library.  It compares the
+ * IDCT routines that jddctmgr.c selects at run time (the SIMD kernels of
+ * jidctx86.c) with the C routines they replace, jpeg_idct_islow and
+ * jpeg_idct_float, on random and extreme coefficient blocks, one block at
+ * a time and through the batched row form.  Any difference in the output
+ * samples is reported, and the exit status is then non-zero.
+ *
+ * Build it natively with the library, not with emcc:
+ *	gcc -O2 -o ckjsimd jpeg12-6b/ckjsimd.c jpeg12-6b/j*.c
+ * and run it once for each instruction set the CPU supports:
+ *	./ckjsimd && JSIMD_FORCESSE2=1 ./ckjsimd && JSIMD_FORCENONE=1 ./ckjsimd
+ * With JSIMD_FORCENONE=1 the C routines are selected, so the comparison
+ * only checks the harness itself.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+
+#define NUM_TABLES	1000	/* quantization tables per method */
+#define BLOCKS_PER_TABLE 100	/* random blocks per table and kind */
+#define ROW_BLOCKS	5	/* blocks in a batched row */
+#define OUTPUT_COL	3	/* an unaligned output column */
+#define ROW_WIDTH	(OUTPUT_COL + ROW_BLOCKS * DCTSIZE + 5)
+
+/* The largest dequantized coefficient of 12-bit data */
+#define MAX_COEF	32767
+
+static unsigned long seed = 1;
+
+LOCAL(long)
+random_below (long n)
+{
+  seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+  return (long) ((seed >> 33) % (unsigned long) n);
+}
+
+LOCAL(int)
+random_sign (void)
+{
+  return random_below(2) ? 1 : -1;
+}
+
+
+/* Same as prepare_range_limit_table in jdmaster.c */
+
+LOCAL(void)
+prepare_range_limit_table (j_decompress_ptr cinfo)
+{
+  JSAMPLE * table;
+  int i;
+
+  table = (JSAMPLE *)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+		(5 * (MAXJSAMPLE+1) + CENTERJSAMPLE) * SIZEOF(JSAMPLE));
+  table += (MAXJSAMPLE+1);
+  cinfo->sample_range_limit = table;
+  MEMZERO(table - (MAXJSAMPLE+1), (MAXJSAMPLE+1) * SIZEOF(JSAMPLE));
+  for (i = 0; i <= MAXJSAMPLE; i++)
+    table[i] = (JSAMPLE) i;
+  table += CENTERJSAMPLE;
+  for (i = CENTERJSAMPLE; i < 2*(MAXJSAMPLE+1); i++)
+    table[i] = MAXJSAMPLE;
+  MEMZERO(table + (2 * (MAXJSAMPLE+1)),
+	  (2 * (MAXJSAMPLE+1) - CENTERJSAMPLE) * SIZEOF(JSAMPLE));
+  MEMCOPY(table + (4 * (MAXJSAMPLE+1) - CENTERJSAMPLE),
+	  cinfo->sample_range_limit, CENTERJSAMPLE * SIZEOF(JSAMPLE));
+}
+
+
+/*
+ * Quantization tables: all ones, so that coefficients reach the extremes
+ * one step at a time, a scaled standard luminance table, or random.
+ */
+
+static const unsigned int std_luminance_quant_tbl[DCTSIZE2] = {
+  16,  11,  10,  16,  24,  40,  51,  61,
+  12,  12,  14,  19,  26,  58,  60,  55,
+  14,  13,  16,  24,  40,  57,  69,  56,
+  14,  17,  22,  29,  51,  87,  80,  62,
+  18,  22,  37,  56,  68, 109, 103,  77,
+  24,  35,  55,  64,  81, 104, 113,  92,
+  49,  64,  78,  87, 103, 121, 120, 101,
+  72,  92,  95,  98, 112, 100, 103,  99
+};
+
+LOCAL(void)
+fill_quant_table (JQUANT_TBL * qtbl, int n)
+{
+  int i;
+  long scale = 1 + random_below(400);
+
+  for (i = 0; i < DCTSIZE2; i++) {
+    switch (n % 3) {
+    case 0:
+      qtbl->quantval[i] = 1;
+      break;
+    case 1:
+      qtbl->quantval[i] = (UINT16)
+	MAX(1, (std_luminance_quant_tbl[i] * scale + 50) / 100);
+      break;
+    default:
+      qtbl->quantval[i] = (UINT16) (1 + random_below(255));
+      break;
+    }
+  }
+}
+
+
+/*
+ * Coefficient blocks, with every dequantized value within +-MAX_COEF.
+ */
+
+#define NUM_KINDS  5
+
+static const char * const kind_names[NUM_KINDS] = {
+  "sparse", "dense", "extreme", "extreme same sign", "extreme DC and AC"
+};
+
+LOCAL(void)
+fill_block (JCOEFPTR block, const JQUANT_TBL * qtbl, int kind)
+{
+  int i, limit;
+  int sign = random_sign();
+
+  MEMZERO(block, SIZEOF(JBLOCK));
+  for (i = 0; i < DCTSIZE2; i++) {
+    limit = MAX_COEF / qtbl->quantval[i];
+    switch (kind) {
+    case 0:			/* DC and a few small AC terms */
+      if (i == 0)
+	block[i] = (JCOEF) (random_below(2 * limit + 1) - limit);
+      else if (random_below(8) == 0)
+	block[i] = (JCOEF) (random_below(2 * MIN(limit, 64) + 1) -
+			    MIN(limit, 64));
+      break;
+    case 1:			/* anything in range */
+      block[i] = (JCOEF) (random_below(2 * limit + 1) - limit);
+      break;
+    case 2:			/* every term at the limit */
+      block[i] = (JCOEF) (random_sign() * limit);
+      break;
+    case 3:
+      block[i] = (JCOEF) (sign * limit);
+      break;
+    default:			/* DC and one AC term at the limit */
+      if (i == 0)
+	block[i] = (JCOEF) (random_sign() * limit);
+      break;
+    }
+  }
+  if (kind == 4) {
+    i = 1 + (int) random_below(DCTSIZE2 - 1);
+    block[i] = (JCOEF) (random_sign() * (MAX_COEF / qtbl->quantval[i]));
+  }
+}
+
+
+/*
+ * Run the C routine and the selected one on the same blocks.
+ * Returns the number of blocks with different output.
+ */
+
+static JSAMPLE out_c[DCTSIZE][ROW_WIDTH];
+static JSAMPLE out_simd[DCTSIZE][ROW_WIDTH];
+
+LOCAL(long)
+compare_blocks (j_decompress_ptr cinfo, inverse_DCT_method_ptr c_method,
+		JBLOCKROW blocks, long mismatches[])
+{
+  jpeg_component_info * compptr = cinfo->comp_info;
+  JSAMPROW rows_c[DCTSIZE], rows_simd[DCTSIZE];
+  long bad = 0;
+  int i, b, kind;
+
+  for (i = 0; i < DCTSIZE; i++) {
+    rows_c[i] = out_c[i];
+    rows_simd[i] = out_simd[i];
+  }
+
+  for (kind = 0; kind < NUM_KINDS; kind++) {
+    /* One block at a time */
+    fill_block(blocks[0], compptr->quant_table, kind);
+    MEMZERO(out_c, SIZEOF(out_c));
+    MEMZERO(out_simd, SIZEOF(out_simd));
+    (*c_method) (cinfo, compptr, blocks[0], rows_c, OUTPUT_COL);
+    (*cinfo->idct->inverse_DCT[0]) (cinfo, compptr, blocks[0],
+				     rows_simd, OUTPUT_COL);
+    if (memcmp(out_c, out_simd, SIZEOF(out_c)) != 0) {
+      mismatches[kind]++;
+      bad++;
+    }
+
+    /* A batched row */
+    for (b = 0; b < ROW_BLOCKS; b++) {
+      fill_block(blocks[b], compptr->quant_table, kind);
+      (*c_method) (cinfo, compptr, blocks[b], rows_c,
+		   OUTPUT_COL + b * DCTSIZE);
+    }
+    (*cinfo->idct->inverse_DCT_row[0]) (cinfo, compptr, blocks, rows_simd,
+					 OUTPUT_COL, ROW_BLOCKS);
+    if (memcmp(out_c, out_simd, SIZEOF(out_c)) != 0) {
+      mismatches[kind]++;
+      bad++;
+    }
+  }
+  return bad;
+}
+
+
+LOCAL(const char *)
+method_name (inverse_DCT_method_ptr method)
+{
+  if (method == jpeg_idct_islow || method == jpeg_idct_float)
+    return "C";
+#ifdef JSIMD_X86
+  if (method == jpeg_idct_islow_sse2 || method == jpeg_idct_float_sse2)
+    return "SSE2";
+  if (method == jpeg_idct_islow_avx2 || method == jpeg_idct_float_avx2)
+    return "AVX2";
+#endif
+  return "unknown";
+}
+
+
+/* Check one DCT method, returns the number of mismatches */
+
+LOCAL(long)
+check_method (j_decompress_ptr cinfo, J_DCT_METHOD dct_method,
+	      inverse_DCT_method_ptr c_method, const char * name)
+{
+  JBLOCK blocks[ROW_BLOCKS];
+  long mismatches[NUM_KINDS];
+  long bad = 0;
+  int n, k, kind;
+  const char * selected = NULL;
+
+  MEMZERO(mismatches, SIZEOF(mismatches));
+  cinfo->dct_method = dct_method;
+  for (n = 0; n < NUM_TABLES; n++) {
+    /* A new controller builds the multiplier table from the new quant table */
+    fill_quant_table(cinfo->comp_info->quant_table, n);
+    jinit_inverse_dct(cinfo);
+    (*cinfo->idct->start_pass) (cinfo);
+    selected = method_name(cinfo->idct->inverse_DCT[0]);
+    for (k = 0; k < BLOCKS_PER_TABLE; k++)
+      bad += compare_blocks(cinfo, c_method, blocks, mismatches);
+    (*cinfo->mem->free_pool) ((j_common_ptr) cinfo, JPOOL_IMAGE);
+  }
+
+  printf("%s IDCT, %s routine: %ld mismatches\n", name, selected, bad);
+  for (kind = 0; kind < NUM_KINDS; kind++)
+    if (mismatches[kind])
+      printf("  %ld in %s blocks\n", mismatches[kind], kind_names[kind]);
+  return bad;
+}
+
+
+int
+main (void)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  jpeg_component_info * compptr;
+  long bad;
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+
+  /* Just what jddctmgr.c looks at, for one full size component */
+  cinfo.num_components = 1;
+  compptr = (jpeg_component_info *)
+    (*cinfo.mem->alloc_small) ((j_common_ptr) &cinfo, JPOOL_PERMANENT,
+			       SIZEOF(jpeg_component_info));
+  MEMZERO(compptr, SIZEOF(jpeg_component_info));
+  compptr->DCT_scaled_size = DCTSIZE;
+  compptr->component_needed = TRUE;
+  compptr->quant_table = jpeg_alloc_quant_table((j_common_ptr) &cinfo);
+  cinfo.comp_info = compptr;
+  prepare_range_limit_table(&cinfo);
+
+  bad = check_method(&cinfo, JDCT_ISLOW, jpeg_idct_islow, "islow");
+  bad += check_method(&cinfo, JDCT_FLOAT, jpeg_idct_float, "float");
+
+  jpeg_destroy_decompress(&cinfo);
+  return bad ? 1 : 0;
+}
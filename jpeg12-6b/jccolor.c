@@ -11,6 +11,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 /* Private subobject */
@@ -20,6 +21,13 @@ typedef struct {
 
   /* Private state for RGB->YCC conversion */
   INT32 * rgb_ycc_tab;		/* => table for RGB to YCbCr conversion */
+
+#ifdef JSIMD_ANY
+  /* SIMD row kernel (see jsimd.h), used instead of the table */
+  JMETHOD(JDIMENSION, rgb_ycc_simd, (JSAMPROW inptr, JSAMPROW outptr0,
+				     JSAMPROW outptr1, JSAMPROW outptr2,
+				     JDIMENSION num_cols));
+#endif
 } my_color_converter;
 
 typedef my_color_converter * my_cconvert_ptr;
@@ -172,6 +180,101 @@ rgb_ycc_convert (j_compress_ptr cinfo,
 }
 
 
+#ifdef JSIMD_ANY
+
+/*
+ * Convert columns start..num_cols-1 of one row without using the table.
+ * The arithmetic is exactly that of the table, only done on the fly.
+ */
+
+LOCAL(void)
+rgb_ycc_fixed (JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+	       JSAMPROW outptr2, JDIMENSION start, JDIMENSION num_cols)
+{
+  register INT32 r, g, b;
+  register JDIMENSION col;
+
+  inptr += start * RGB_PIXELSIZE;
+  for (col = start; col < num_cols; col++) {
+    r = GETJSAMPLE(inptr[RGB_RED]);
+    g = GETJSAMPLE(inptr[RGB_GREEN]);
+    b = GETJSAMPLE(inptr[RGB_BLUE]);
+    inptr += RGB_PIXELSIZE;
+    outptr0[col] = (JSAMPLE)
+	((FIX(0.29900) * r + FIX(0.58700) * g + FIX(0.11400) * b
+	  + ONE_HALF) >> SCALEBITS);
+    outptr1[col] = (JSAMPLE)
+	((- FIX(0.16874) * r - FIX(0.33126) * g + FIX(0.50000) * b
+	  + CBCR_OFFSET + ONE_HALF-1) >> SCALEBITS);
+    outptr2[col] = (JSAMPLE)
+	((FIX(0.50000) * r - FIX(0.41869) * g - FIX(0.08131) * b
+	  + CBCR_OFFSET + ONE_HALF-1) >> SCALEBITS);
+  }
+}
+
+
+/*
+ * Same as rgb_ycc_convert, using a SIMD kernel for as much of each row as
+ * it can do.  Only selected when RGB_PIXELSIZE is 3, in R,G,B order, and
+ * then no table is built.
+ */
+
+METHODDEF(void)
+rgb_ycc_convert_simd (j_compress_ptr cinfo,
+		      JSAMPARRAY input_buf, JSAMPIMAGE output_buf,
+		      JDIMENSION output_row, int num_rows)
+{
+  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+  JSAMPROW inptr;
+  JSAMPROW outptr0, outptr1, outptr2;
+  JDIMENSION col;
+  JDIMENSION num_cols = cinfo->image_width;
+
+  while (--num_rows >= 0) {
+    inptr = *input_buf++;
+    outptr0 = output_buf[0][output_row];
+    outptr1 = output_buf[1][output_row];
+    outptr2 = output_buf[2][output_row];
+    output_row++;
+    col = (*cconvert->rgb_ycc_simd) (inptr, outptr0, outptr1, outptr2,
+				     num_cols);
+    if (col < num_cols)
+      rgb_ycc_fixed(inptr, outptr0, outptr1, outptr2, col, num_cols);
+  }
+}
+
+
+/*
+ * Pick the SIMD kernel for RGB->YCbCr conversion, if there is one for
+ * this machine.  Returns TRUE if it was found.
+ */
+
+LOCAL(boolean)
+select_simd_ycc (my_cconvert_ptr cconvert)
+{
+  /* The kernels read R,G,B triplets */
+  if (RGB_RED != 0 || RGB_GREEN != 1 || RGB_BLUE != 2 || RGB_PIXELSIZE != 3)
+    return FALSE;
+#ifdef JSIMD_X86
+  if (jsimd_cpu_features() & JSIMD_AVX2) {
+    cconvert->rgb_ycc_simd = jpeg_rgb_ycc_avx2;
+    return TRUE;
+  }
+  if (jsimd_cpu_features() & JSIMD_SSE2) {
+    cconvert->rgb_ycc_simd = jpeg_rgb_ycc_sse2;
+    return TRUE;
+  }
+#endif
+#ifdef JSIMD_WASM
+  cconvert->rgb_ycc_simd = jpeg_rgb_ycc_wasm;
+  return TRUE;
+#endif
+  return FALSE;
+}
+
+#endif /* JSIMD_ANY */
+
+
 /**************** Cases other than RGB -> YCbCr **************/
 
 
@@ -420,8 +523,15 @@ jinit_color_converter (j_compress_ptr cinfo)
     if (cinfo->num_components != 3)
       ERREXIT(cinfo, JERR_BAD_J_COLORSPACE);
     if (cinfo->in_color_space == JCS_RGB) {
-      cconvert->pub.start_pass = rgb_ycc_start;
-      cconvert->pub.color_convert = rgb_ycc_convert;
+#ifdef JSIMD_ANY
+      if (select_simd_ycc(cconvert))
+	cconvert->pub.color_convert = rgb_ycc_convert_simd; /* no table */
+      else
+#endif
+      {
+	cconvert->pub.start_pass = rgb_ycc_start;
+	cconvert->pub.color_convert = rgb_ycc_convert;
+      }
     } else if (cinfo->in_color_space == JCS_YCbCr)
       cconvert->pub.color_convert = null_convert;
     else
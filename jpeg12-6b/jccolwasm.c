@@ -0,0 +1,104 @@
+/*
+ * jccolwasm.c
+ *
+ * This file contains the WebAssembly SIMD128 version of the RGB->YCbCr
+ * conversion of jccolor.c, for 12-bit samples.  It is built when
+ * compiling with -msimd128, and is then always used.
+ *
+ * The arithmetic is the same as in jccolx86.c: 16x16->32 bit dot products
+ * with the split constants described in jsimd.h, giving results that are
+ * bit-identical to the table-driven C code, eight pixels at a time.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_WASM
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <wasm_simd128.h>
+
+
+/* Pairs of 16-bit multipliers, for use with dot products on interleaved inputs */
+#define PAIR(a,b)  wasm_i16x8_make(a, b, a, b, a, b, a, b)
+
+/* Rounding, as included in the B=>Y and B=>Cb tables of jccolor.c */
+#define Y_BIAS		32768
+#define CBCR_BIAS	((CENTERJSAMPLE << 16) + 32767)
+
+
+/* The 32-bit dot products of (a,b) pairs with c, for lanes 0-3 or 4-7 */
+#define DOT_LO(a,b,c)  \
+  wasm_i32x4_dot_i16x8(wasm_i16x8_shuffle(a, b, 0, 8, 1, 9, 2, 10, 3, 11), c)
+#define DOT_HI(a,b,c)  \
+  wasm_i32x4_dot_i16x8(wasm_i16x8_shuffle(a, b, 4, 12, 5, 13, 6, 14, 7, 15), c)
+
+/* (a0 * c0 + a1 * c1 + b0 * d0 + b1 * d1 + bias) >> 16, lane by lane */
+static INLINE v128_t
+dot2_shift (v128_t a0, v128_t a1, v128_t c,
+	    v128_t b0, v128_t b1, v128_t d, v128_t bias)
+{
+  v128_t lo = wasm_i32x4_add(DOT_LO(a0, a1, c), DOT_LO(b0, b1, d));
+  v128_t hi = wasm_i32x4_add(DOT_HI(a0, a1, c), DOT_HI(b0, b1, d));
+
+  lo = wasm_i32x4_shr(wasm_i32x4_add(lo, bias), 16);
+  hi = wasm_i32x4_shr(wasm_i32x4_add(hi, bias), 16);
+  return wasm_i16x8_narrow_i32x4(lo, hi);
+}
+
+
+/* Load eight RGB triplets, from three vectors:
+ *	R0 G0 B0 R1 G1 B1 R2 G2 | B2 R3 G3 B3 R4 G4 B4 R5 | G5 B5 R6 G6 B6 R7 G7 B7
+ * Each of R, G and B takes its first lanes from the first two vectors and
+ * the rest from the third.
+ */
+
+static INLINE void
+load_rgb (const JSAMPLE * inptr, v128_t * r, v128_t * g, v128_t * b)
+{
+  v128_t v0 = wasm_v128_load(inptr);
+  v128_t v1 = wasm_v128_load(inptr + 8);
+  v128_t v2 = wasm_v128_load(inptr + 16);
+  v128_t t;
+
+  t = wasm_i16x8_shuffle(v0, v1, 0, 3, 6, 9, 12, 15, 0, 0);
+  *r = wasm_i16x8_shuffle(t, v2, 0, 1, 2, 3, 4, 5, 10, 13);
+  t = wasm_i16x8_shuffle(v0, v1, 1, 4, 7, 10, 13, 0, 0, 0);
+  *g = wasm_i16x8_shuffle(t, v2, 0, 1, 2, 3, 4, 8, 11, 14);
+  t = wasm_i16x8_shuffle(v0, v1, 2, 5, 8, 11, 14, 0, 0, 0);
+  *b = wasm_i16x8_shuffle(t, v2, 0, 1, 2, 3, 4, 9, 12, 15);
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_rgb_ycc_wasm (JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+		   JSAMPROW outptr2, JDIMENSION num_cols)
+{
+  const v128_t half = wasm_i16x8_splat(16384);
+  const v128_t y_bias = wasm_i32x4_splat(Y_BIAS);
+  const v128_t cbcr_bias = wasm_i32x4_splat(CBCR_BIAS);
+  JDIMENSION col;
+  v128_t r, g, b;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    load_rgb(inptr + col * 3, &r, &g, &b);
+    wasm_v128_store(outptr0 + col,
+		    dot2_shift(r, g, PAIR(JSIMD_FIX_Y_R, JSIMD_FIX_Y_G),
+			       g, b, PAIR(32767, JSIMD_FIX_Y_B), y_bias));
+    wasm_v128_store(outptr1 + col,
+		    dot2_shift(r, g, PAIR(JSIMD_FIX_CB_R, JSIMD_FIX_CB_G),
+			       b, b, half, cbcr_bias));
+    wasm_v128_store(outptr2 + col,
+		    dot2_shift(r, r, half,
+			       g, b, PAIR(JSIMD_FIX_CR_G, JSIMD_FIX_CR_B),
+			       cbcr_bias));
+  }
+  return col;
+}
+
+#endif /* JSIMD_WASM */
@@ -0,0 +1,183 @@
+/*
+ * jccolx86.c
+ *
+ * This file contains SSE2 and AVX2 versions of the RGB->YCbCr conversion
+ * of jccolor.c, for 12-bit samples.  jccolor.c selects them at run time
+ * when the CPU supports the instruction set.
+ *
+ * Instead of the 128 KB lookup table used by rgb_ycc_convert, the sums are
+ * formed with 16x16->32 bit multiply-adds, using the split constants
+ * described in jsimd.h, so the results are bit-identical to the C code.
+ * Eight (SSE2) or sixteen (AVX2) pixels are converted per step.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <immintrin.h>
+
+
+/* Pairs of 16-bit multipliers, for use with madd on interleaved inputs */
+#define PAIR_SSE2(a,b)  _mm_set_epi16(b, a, b, a, b, a, b, a)
+#define PAIR_AVX2(a,b)  _mm256_set_epi16(b, a, b, a, b, a, b, a, \
+					 b, a, b, a, b, a, b, a)
+
+/* Rounding, as included in the B=>Y and B=>Cb tables of jccolor.c */
+#define Y_BIAS		32768
+#define CBCR_BIAS	((CENTERJSAMPLE << 16) + 32767)
+
+
+/*
+ * SSE2 implementation, eight pixels at a time.
+ */
+
+/* (a0 * c0 + a1 * c1 + b0 * d0 + b1 * d1 + bias) >> 16, lane by lane */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+madd2_shift_sse2 (__m128i a0, __m128i a1, __m128i c,
+		  __m128i b0, __m128i b1, __m128i d, __m128i bias)
+{
+  __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a0, a1), c),
+			     _mm_madd_epi16(_mm_unpacklo_epi16(b0, b1), d));
+  __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a0, a1), c),
+			     _mm_madd_epi16(_mm_unpackhi_epi16(b0, b1), d));
+
+  lo = _mm_srai_epi32(_mm_add_epi32(lo, bias), 16);
+  hi = _mm_srai_epi32(_mm_add_epi32(hi, bias), 16);
+  return _mm_packs_epi32(lo, hi);
+}
+
+
+/* Load eight RGB triplets into separate R, G and B vectors.  Each pixel is
+ * read as a 64-bit RGBx group; the last one is taken from the end of the
+ * third vector, so nothing past the end of the row is read.  Two rounds
+ * of unpacking then transpose the groups.
+ */
+
+JSIMD_TARGET_SSE2 static INLINE void
+load_rgb_sse2 (const JSAMPLE * inptr, __m128i * r, __m128i * g, __m128i * b)
+{
+  __m128i p01, p23, p45, p67, t0, t1, rg03, bx03, rg47, bx47;
+
+  p01 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) (inptr + 0)),
+			   _mm_loadl_epi64((const __m128i *) (inptr + 3)));
+  p23 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) (inptr + 6)),
+			   _mm_loadl_epi64((const __m128i *) (inptr + 9)));
+  p45 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) (inptr + 12)),
+			   _mm_loadl_epi64((const __m128i *) (inptr + 15)));
+  p67 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) (inptr + 18)),
+			   _mm_srli_si128(_mm_loadu_si128((const __m128i *)
+							  (inptr + 16)), 10));
+
+  /* R0 R2 G0 G2 B0 B2 x x, and R1 R3 G1 G3 B1 B3 x x */
+  t0 = _mm_unpacklo_epi16(p01, p23);
+  t1 = _mm_unpackhi_epi16(p01, p23);
+  rg03 = _mm_unpacklo_epi16(t0, t1);	/* R0 R1 R2 R3 G0 G1 G2 G3 */
+  bx03 = _mm_unpackhi_epi16(t0, t1);	/* B0 B1 B2 B3 x x x x */
+  t0 = _mm_unpacklo_epi16(p45, p67);
+  t1 = _mm_unpackhi_epi16(p45, p67);
+  rg47 = _mm_unpacklo_epi16(t0, t1);
+  bx47 = _mm_unpackhi_epi16(t0, t1);
+
+  *r = _mm_unpacklo_epi64(rg03, rg47);
+  *g = _mm_unpackhi_epi64(rg03, rg47);
+  *b = _mm_unpacklo_epi64(bx03, bx47);
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_rgb_ycc_sse2 (JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+		   JSAMPROW outptr2, JDIMENSION num_cols)
+{
+  const __m128i half = _mm_set1_epi16(16384);
+  const __m128i y_bias = _mm_set1_epi32(Y_BIAS);
+  const __m128i cbcr_bias = _mm_set1_epi32(CBCR_BIAS);
+  JDIMENSION col;
+  __m128i r, g, b;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    load_rgb_sse2(inptr + col * 3, &r, &g, &b);
+    _mm_storeu_si128((__m128i *) (outptr0 + col),
+      madd2_shift_sse2(r, g, PAIR_SSE2(JSIMD_FIX_Y_R, JSIMD_FIX_Y_G),
+		       g, b, PAIR_SSE2(32767, JSIMD_FIX_Y_B), y_bias));
+    _mm_storeu_si128((__m128i *) (outptr1 + col),
+      madd2_shift_sse2(r, g, PAIR_SSE2(JSIMD_FIX_CB_R, JSIMD_FIX_CB_G),
+		       b, b, half, cbcr_bias));
+    _mm_storeu_si128((__m128i *) (outptr2 + col),
+      madd2_shift_sse2(r, r, half,
+		       g, b, PAIR_SSE2(JSIMD_FIX_CR_G, JSIMD_FIX_CR_B),
+		       cbcr_bias));
+  }
+  return col;
+}
+
+
+/*
+ * AVX2 implementation, sixteen pixels at a time.  The unpack and pack
+ * instructions work within 128-bit lanes, so each lane holds eight
+ * consecutive pixels throughout, loaded with the SSE2 code.
+ */
+
+JSIMD_TARGET_AVX2 static INLINE __m256i
+madd2_shift_avx2 (__m256i a0, __m256i a1, __m256i c,
+		  __m256i b0, __m256i b1, __m256i d, __m256i bias)
+{
+  __m256i lo = _mm256_add_epi32(
+		 _mm256_madd_epi16(_mm256_unpacklo_epi16(a0, a1), c),
+		 _mm256_madd_epi16(_mm256_unpacklo_epi16(b0, b1), d));
+  __m256i hi = _mm256_add_epi32(
+		 _mm256_madd_epi16(_mm256_unpackhi_epi16(a0, a1), c),
+		 _mm256_madd_epi16(_mm256_unpackhi_epi16(b0, b1), d));
+
+  lo = _mm256_srai_epi32(_mm256_add_epi32(lo, bias), 16);
+  hi = _mm256_srai_epi32(_mm256_add_epi32(hi, bias), 16);
+  return _mm256_packs_epi32(lo, hi);
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE __m256i
+combine_avx2 (__m128i lo, __m128i hi)
+{
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_rgb_ycc_avx2 (JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+		   JSAMPROW outptr2, JDIMENSION num_cols)
+{
+  const __m256i half = _mm256_set1_epi16(16384);
+  const __m256i y_bias = _mm256_set1_epi32(Y_BIAS);
+  const __m256i cbcr_bias = _mm256_set1_epi32(CBCR_BIAS);
+  JDIMENSION col;
+  __m128i r0, g0, b0, r1, g1, b1;
+  __m256i r, g, b;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    load_rgb_sse2(inptr + col * 3, &r0, &g0, &b0);
+    load_rgb_sse2(inptr + col * 3 + 24, &r1, &g1, &b1);
+    r = combine_avx2(r0, r1);
+    g = combine_avx2(g0, g1);
+    b = combine_avx2(b0, b1);
+    _mm256_storeu_si256((__m256i *) (outptr0 + col),
+      madd2_shift_avx2(r, g, PAIR_AVX2(JSIMD_FIX_Y_R, JSIMD_FIX_Y_G),
+		       g, b, PAIR_AVX2(32767, JSIMD_FIX_Y_B), y_bias));
+    _mm256_storeu_si256((__m256i *) (outptr1 + col),
+      madd2_shift_avx2(r, g, PAIR_AVX2(JSIMD_FIX_CB_R, JSIMD_FIX_CB_G),
+		       b, b, half, cbcr_bias));
+    _mm256_storeu_si256((__m256i *) (outptr2 + col),
+      madd2_shift_avx2(r, r, half,
+		       g, b, PAIR_AVX2(JSIMD_FIX_CR_G, JSIMD_FIX_CR_B),
+		       cbcr_bias));
+  }
+  return col;
+}
+
+#endif /* JSIMD_X86 */
@@ -15,6 +15,23 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"		/* SIMD replacements for the FDCTs */
+
+
+#ifdef JSIMD_ANY
+/* A SIMD kernel doing the FDCT and the quantization of a row of blocks */
+typedef JMETHOD(void, simd_DCT_method_ptr,
+		(JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+		 JDIMENSION start_col, JDIMENSION num_blocks,
+		 const unsigned int * recip));
+#ifdef DCT_FLOAT_SUPPORTED
+/* The same for the floating-point DCT, with the float divisors */
+typedef JMETHOD(void, simd_float_DCT_method_ptr,
+		(JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+		 JDIMENSION start_col, JDIMENSION num_blocks,
+		 const FAST_FLOAT * divisors));
+#endif
+#endif
 
 
 /* Private subobject for this module */
@@ -36,11 +53,63 @@ typedef struct {
   float_DCT_method_ptr do_float_dct;
   FAST_FLOAT * float_divisors[NUM_QUANT_TBLS];
 #endif
+
+#ifdef JSIMD_ANY
+  /* The SIMD kernel replacing do_dct, or NULL, and the reciprocals of
+   * the divisors that it uses instead (see jsimd.h).
+   */
+  simd_DCT_method_ptr do_simd_dct;
+  unsigned int * reciprocals[NUM_QUANT_TBLS];
+#ifdef DCT_FLOAT_SUPPORTED
+  /* The SIMD kernel replacing do_float_dct, or NULL */
+  simd_float_DCT_method_ptr do_simd_float_dct;
+#endif
+#endif
 } my_fdct_controller;
 
 typedef my_fdct_controller * my_fdct_ptr;
 
 
+#ifdef JSIMD_ANY
+
+/*
+ * Compute the reciprocal table of a divisor table, as described in jsimd.h.
+ * The divisors are below 2^18, so everything fits in 32 bits.
+ */
+
+LOCAL(void)
+compute_reciprocals (const DCTELEM * divisors, unsigned int * recip)
+{
+  unsigned int d, m, r;
+  int i, l, s, b;
+
+  for (i = 0; i < DCTSIZE2; i++) {
+    d = (unsigned int) divisors[i];
+    for (l = 0; (1U << l) < d; l++)
+      ;
+    s = MAX(33, 19 + l);
+    /* m = ceil(2^s / d) by long division, one quotient bit at a time */
+    m = 0;
+    r = 1;
+    for (b = 0; b < s; b++) {
+      r <<= 1;
+      m <<= 1;
+      if (r >= d) {
+	r -= d;
+	m |= 1;
+      }
+    }
+    if (r != 0)
+      m++;
+    recip[i] = d >> 1;
+    recip[DCTSIZE2 + i] = m;
+    recip[2 * DCTSIZE2 + i] = 1U << (64 - s);
+  }
+}
+
+#endif /* JSIMD_ANY */
+
+
 /*
  * Initialize for a processing pass.
  * Verify that all referenced Q-tables are present, and set up
@@ -84,6 +153,16 @@ start_pass_fdctmgr (j_compress_ptr cinfo)
       for (i = 0; i < DCTSIZE2; i++) {
 	dtbl[i] = ((DCTELEM) qtbl->quantval[i]) << 3;
       }
+#ifdef JSIMD_ANY
+      if (fdct->do_simd_dct != NULL) {
+	if (fdct->reciprocals[qtblno] == NULL) {
+	  fdct->reciprocals[qtblno] = (unsigned int *)
+	    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+					JSIMD_RECIP_SIZE * SIZEOF(unsigned int));
+	}
+	compute_reciprocals(dtbl, fdct->reciprocals[qtblno]);
+      }
+#endif
       break;
 #endif
 #ifdef DCT_IFAST_SUPPORTED
@@ -264,6 +343,24 @@ forward_DCT (j_compress_ptr cinfo, jpeg_component_info * compptr,
 }
 
 
+#ifdef JSIMD_ANY
+
+METHODDEF(void)
+forward_DCT_simd (j_compress_ptr cinfo, jpeg_component_info * compptr,
+		  JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+		  JDIMENSION start_row, JDIMENSION start_col,
+		  JDIMENSION num_blocks)
+/* This version is used when a SIMD kernel does the DCT and quantization. */
+{
+  my_fdct_ptr fdct = (my_fdct_ptr) cinfo->fdct;
+
+  (*fdct->do_simd_dct) (sample_data + start_row, coef_blocks, start_col,
+			num_blocks, fdct->reciprocals[compptr->quant_tbl_no]);
+}
+
+#endif /* JSIMD_ANY */
+
+
 #ifdef DCT_FLOAT_SUPPORTED
 
 METHODDEF(void)
@@ -334,6 +431,25 @@ forward_DCT_float (j_compress_ptr cinfo, jpeg_component_info * compptr,
   }
 }
 
+
+#ifdef JSIMD_ANY
+
+METHODDEF(void)
+forward_DCT_float_simd (j_compress_ptr cinfo, jpeg_component_info * compptr,
+			JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+			JDIMENSION start_row, JDIMENSION start_col,
+			JDIMENSION num_blocks)
+/* This version is used when a SIMD kernel does the float DCT. */
+{
+  my_fdct_ptr fdct = (my_fdct_ptr) cinfo->fdct;
+
+  (*fdct->do_simd_float_dct) (sample_data + start_row, coef_blocks, start_col,
+			      num_blocks,
+			      fdct->float_divisors[compptr->quant_tbl_no]);
+}
+
+#endif /* JSIMD_ANY */
+
 #endif /* DCT_FLOAT_SUPPORTED */
 
 
@@ -352,12 +468,31 @@ jinit_forward_dct (j_compress_ptr cinfo)
 				SIZEOF(my_fdct_controller));
   cinfo->fdct = (struct jpeg_forward_dct *) fdct;
   fdct->pub.start_pass = start_pass_fdctmgr;
+#ifdef JSIMD_ANY
+  fdct->do_simd_dct = NULL;
+#ifdef DCT_FLOAT_SUPPORTED
+  fdct->do_simd_float_dct = NULL;
+#endif
+#endif
 
   switch (cinfo->dct_method) {
 #ifdef DCT_ISLOW_SUPPORTED
   case JDCT_ISLOW:
     fdct->pub.forward_DCT = forward_DCT;
     fdct->do_dct = jpeg_fdct_islow;
+#ifdef JSIMD_X86
+    if (jsimd_cpu_features() & JSIMD_AVX2)
+      fdct->do_simd_dct = jpeg_fdct_islow_quant_avx2;
+    else if (jsimd_cpu_features() & JSIMD_SSE2)
+      fdct->do_simd_dct = jpeg_fdct_islow_quant_sse2;
+#endif
+#ifdef JSIMD_WASM
+    fdct->do_simd_dct = jpeg_fdct_islow_quant_wasm;
+#endif
+#ifdef JSIMD_ANY
+    if (fdct->do_simd_dct != NULL)
+      fdct->pub.forward_DCT = forward_DCT_simd;
+#endif
     break;
 #endif
 #ifdef DCT_IFAST_SUPPORTED
@@ -370,6 +505,19 @@ jinit_forward_dct (j_compress_ptr cinfo)
   case JDCT_FLOAT:
     fdct->pub.forward_DCT = forward_DCT_float;
     fdct->do_float_dct = jpeg_fdct_float;
+#ifdef JSIMD_X86
+    if (jsimd_cpu_features() & JSIMD_AVX2)
+      fdct->do_simd_float_dct = jpeg_fdct_float_quant_avx2;
+    else if (jsimd_cpu_features() & JSIMD_SSE2)
+      fdct->do_simd_float_dct = jpeg_fdct_float_quant_sse2;
+#endif
+#ifdef JSIMD_WASM
+    fdct->do_simd_float_dct = jpeg_fdct_float_quant_wasm;
+#endif
+#ifdef JSIMD_ANY
+    if (fdct->do_simd_float_dct != NULL)
+      fdct->pub.forward_DCT = forward_DCT_float_simd;
+#endif
     break;
 #endif
   default:
@@ -382,6 +530,9 @@ jinit_forward_dct (j_compress_ptr cinfo)
     fdct->divisors[i] = NULL;
 #ifdef DCT_FLOAT_SUPPORTED
     fdct->float_divisors[i] = NULL;
+#endif
+#ifdef JSIMD_ANY
+    fdct->reciprocals[i] = NULL;
 #endif
   }
 }
@@ -77,6 +77,19 @@ jpeg_destroy (j_common_ptr cinfo)
 }
 
 
+/*
+ * Memory usage statistics.  Valid at any point between creating and
+ * destroying the object; after jpeg_finish_(de)compress the image pool is
+ * empty again, but the peaks still describe the image just processed.
+ */
+
+GLOBAL(void)
+jpeg_get_memory_stats (j_common_ptr cinfo, struct jpeg_memory_stats * stats)
+{
+  (*cinfo->mem->get_stats) (cinfo, stats);
+}
+
+
 /*
  * Convenience routines for allocating quantization and Huffman tables.
  * (Would jutils.c be a more reasonable place to put these?)
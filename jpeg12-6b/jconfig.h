@@ -72,6 +72,10 @@
 /* These are for configuring the JPEG memory manager. */
 #undef DEFAULT_MAX_MEM
 #undef NO_MKTEMP
+/* Backing store in memory-mapped temporary files, see jmemnobs.c */
+#ifndef __EMSCRIPTEN__
+#define USE_MMAP_BACKING_STORE
+#endif
 
 #endif /* JPEG_INTERNALS */
 
@@ -48,6 +48,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 /* Pointer to routine to downsample a single component */
@@ -62,6 +63,20 @@ typedef struct {
 
   /* Downsampling method pointers, one per component */
   downsample1_ptr methods[MAX_COMPONENTS];
+
+#ifdef JSIMD_ANY
+  /* SIMD kernels for the 2h1v and 2h2v downsamplers (see jsimd.h), or
+   * NULL if there are none for this machine.
+   */
+  JMETHOD(JDIMENSION, h2v1_simd, (JSAMPROW inptr, JSAMPROW outptr,
+				  JDIMENSION num_cols));
+  JMETHOD(JDIMENSION, h2v2_simd, (JSAMPROW inptr0, JSAMPROW inptr1,
+				  JSAMPROW outptr, JDIMENSION num_cols));
+  JMETHOD(JDIMENSION, h2v2_smooth_simd, (JSAMPROW above_ptr, JSAMPROW inptr0,
+					 JSAMPROW inptr1, JSAMPROW below_ptr,
+					 JSAMPROW outptr, JDIMENSION num_cols,
+					 int memberscale, int neighscale));
+#endif
 } my_downsampler;
 
 typedef my_downsampler * my_downsample_ptr;
@@ -212,6 +227,7 @@ METHODDEF(void)
 h2v1_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
 		 JSAMPARRAY input_data, JSAMPARRAY output_data)
 {
+  my_downsample_ptr downsample = (my_downsample_ptr) cinfo->downsample;
   int outrow;
   JDIMENSION outcol;
   JDIMENSION output_cols = compptr->width_in_blocks * DCTSIZE;
@@ -228,8 +244,16 @@ h2v1_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
   for (outrow = 0; outrow < compptr->v_samp_factor; outrow++) {
     outptr = output_data[outrow];
     inptr = input_data[outrow];
+    outcol = 0;
+#ifdef JSIMD_ANY
+    if (downsample->h2v1_simd != NULL) {
+      outcol = (*downsample->h2v1_simd) (inptr, outptr, output_cols);
+      inptr += outcol * 2;
+      outptr += outcol;
+    }
+#endif
     bias = 0;			/* bias = 0,1,0,1,... for successive samples */
-    for (outcol = 0; outcol < output_cols; outcol++) {
+    for (; outcol < output_cols; outcol++) {
       *outptr++ = (JSAMPLE) ((GETJSAMPLE(*inptr) + GETJSAMPLE(inptr[1])
 			      + bias) >> 1);
       bias ^= 1;		/* 0=>1, 1=>0 */
@@ -249,6 +273,7 @@ METHODDEF(void)
 h2v2_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
 		 JSAMPARRAY input_data, JSAMPARRAY output_data)
 {
+  my_downsample_ptr downsample = (my_downsample_ptr) cinfo->downsample;
   int inrow, outrow;
   JDIMENSION outcol;
   JDIMENSION output_cols = compptr->width_in_blocks * DCTSIZE;
@@ -267,8 +292,16 @@ h2v2_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
     outptr = output_data[outrow];
     inptr0 = input_data[inrow];
     inptr1 = input_data[inrow+1];
+    outcol = 0;
+#ifdef JSIMD_ANY
+    if (downsample->h2v2_simd != NULL) {
+      outcol = (*downsample->h2v2_simd) (inptr0, inptr1, outptr, output_cols);
+      inptr0 += outcol * 2; inptr1 += outcol * 2;
+      outptr += outcol;
+    }
+#endif
     bias = 1;			/* bias = 1,2,1,2,... for successive samples */
-    for (outcol = 0; outcol < output_cols; outcol++) {
+    for (; outcol < output_cols; outcol++) {
       *outptr++ = (JSAMPLE) ((GETJSAMPLE(*inptr0) + GETJSAMPLE(inptr0[1]) +
 			      GETJSAMPLE(*inptr1) + GETJSAMPLE(inptr1[1])
 			      + bias) >> 2);
@@ -292,8 +325,12 @@ METHODDEF(void)
 h2v2_smooth_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
 			JSAMPARRAY input_data, JSAMPARRAY output_data)
 {
+  my_downsample_ptr downsample = (my_downsample_ptr) cinfo->downsample;
   int inrow, outrow;
   JDIMENSION colctr;
+#ifdef JSIMD_ANY
+  JDIMENSION done;
+#endif
   JDIMENSION output_cols = compptr->width_in_blocks * DCTSIZE;
   register JSAMPROW inptr0, inptr1, above_ptr, below_ptr, outptr;
   INT32 membersum, neighsum, memberscale, neighscale;
@@ -343,7 +380,20 @@ h2v2_smooth_downsample (j_compress_ptr cinfo, jpeg_component_info * compptr,
     *outptr++ = (JSAMPLE) ((membersum + 32768) >> 16);
     inptr0 += 2; inptr1 += 2; above_ptr += 2; below_ptr += 2;
 
-    for (colctr = output_cols - 2; colctr > 0; colctr--) {
+    colctr = output_cols - 2;
+#ifdef JSIMD_ANY
+    if (downsample->h2v2_smooth_simd != NULL) {
+      done = (*downsample->h2v2_smooth_simd) (above_ptr, inptr0, inptr1,
+					      below_ptr, outptr, colctr,
+					      (int) memberscale,
+					      (int) neighscale);
+      inptr0 += done * 2; inptr1 += done * 2;
+      above_ptr += done * 2; below_ptr += done * 2;
+      outptr += done;
+      colctr -= done;
+    }
+#endif
+    for (; colctr > 0; colctr--) {
       /* sum of pixels directly mapped to this output element */
       membersum = GETJSAMPLE(*inptr0) + GETJSAMPLE(inptr0[1]) +
 		  GETJSAMPLE(*inptr1) + GETJSAMPLE(inptr1[1]);
@@ -479,6 +529,31 @@ jinit_downsampler (j_compress_ptr cinfo)
   if (cinfo->CCIR601_sampling)
     ERREXIT(cinfo, JERR_CCIR601_NOTIMPL);
 
+#ifdef JSIMD_ANY
+  downsample->h2v1_simd = NULL;
+  downsample->h2v2_simd = NULL;
+  downsample->h2v2_smooth_simd = NULL;
+#ifdef JSIMD_X86
+  if (jsimd_cpu_features() & JSIMD_AVX2) {
+    downsample->h2v1_simd = jpeg_h2v1_downsample_avx2;
+    downsample->h2v2_simd = jpeg_h2v2_downsample_avx2;
+    downsample->h2v2_smooth_simd = jpeg_h2v2_smooth_downsample_avx2;
+  } else if (jsimd_cpu_features() & JSIMD_SSE2) {
+    downsample->h2v1_simd = jpeg_h2v1_downsample_sse2;
+    downsample->h2v2_simd = jpeg_h2v2_downsample_sse2;
+    downsample->h2v2_smooth_simd = jpeg_h2v2_smooth_downsample_sse2;
+  }
+#endif
+#ifdef JSIMD_WASM
+  downsample->h2v1_simd = jpeg_h2v1_downsample_wasm;
+  downsample->h2v2_simd = jpeg_h2v2_downsample_wasm;
+  downsample->h2v2_smooth_simd = jpeg_h2v2_smooth_downsample_wasm;
+#endif
+  if (cinfo->smoothing_factor < 0 ||
+      cinfo->smoothing_factor > JSIMD_MAX_SMOOTHING)
+    downsample->h2v2_smooth_simd = NULL;
+#endif /* JSIMD_ANY */
+
   /* Verify we can handle the sampling factors, and set up method pointers */
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
@@ -0,0 +1,138 @@
+/*
+ * jcsamwasm.c
+ *
+ * This file contains WebAssembly SIMD128 versions of the 2h1v and 2h2v
+ * downsamplers of jcsample.c, with and without smoothing, for 12-bit
+ * samples.  They are built when compiling with -msimd128, and are then
+ * always used by jcsample.c.
+ *
+ * The arithmetic is the same as in jcsamx86.c, eight output columns at a
+ * time, with the same calling conventions.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_WASM
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <wasm_simd128.h>
+
+
+/* Pairs of 16-bit values, for use with dot products on interleaved inputs */
+#define PAIR(a,b)  wasm_i16x8_make(a, b, a, b, a, b, a, b)
+
+
+/* Sums of horizontal pairs of the 16-bit lanes of a and b, in order */
+static INLINE v128_t
+pairsum (v128_t a, v128_t b)
+{
+  const v128_t ones = wasm_i16x8_splat(1);
+
+  return wasm_i16x8_narrow_i32x4(wasm_i32x4_dot_i16x8(a, ones),
+				 wasm_i32x4_dot_i16x8(b, ones));
+}
+
+
+/* Sums of the 2x2 boxes of two rows, for eight output columns */
+static INLINE v128_t
+boxsum (const JSAMPLE * inptr0, const JSAMPLE * inptr1)
+{
+  return pairsum(wasm_i16x8_add(wasm_v128_load(inptr0),
+				wasm_v128_load(inptr1)),
+		 wasm_i16x8_add(wasm_v128_load(inptr0 + 8),
+				wasm_v128_load(inptr1 + 8)));
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_h2v1_downsample_wasm (JSAMPROW inptr, JSAMPROW outptr,
+			   JDIMENSION num_cols)
+{
+  const v128_t bias = PAIR(0, 1);
+  JDIMENSION col;
+  v128_t sum;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    sum = pairsum(wasm_v128_load(inptr + col * 2),
+		  wasm_v128_load(inptr + col * 2 + 8));
+    wasm_v128_store(outptr + col, wasm_u16x8_shr(wasm_i16x8_add(sum, bias), 1));
+  }
+  return col;
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_h2v2_downsample_wasm (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+			   JDIMENSION num_cols)
+{
+  const v128_t bias = PAIR(1, 2);
+  JDIMENSION col;
+  v128_t sum;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    sum = boxsum(inptr0 + col * 2, inptr1 + col * 2);
+    wasm_v128_store(outptr + col, wasm_u16x8_shr(wasm_i16x8_add(sum, bias), 2));
+  }
+  return col;
+}
+
+
+/* The 32-bit dot products of (a,b) pairs with c, for lanes 0-3 or 4-7 */
+#define DOT_LO(a,b,c)  \
+  wasm_i32x4_dot_i16x8(wasm_i16x8_shuffle(a, b, 0, 8, 1, 9, 2, 10, 3, 11), c)
+#define DOT_HI(a,b,c)  \
+  wasm_i32x4_dot_i16x8(wasm_i16x8_shuffle(a, b, 4, 12, 5, 13, 6, 14, 7, 15), c)
+
+/* The smoothed 2h2v output for eight columns, as smooth_sse2 */
+static INLINE v128_t
+smooth (const JSAMPLE * above_ptr, const JSAMPLE * inptr0,
+	const JSAMPLE * inptr1, const JSAMPLE * below_ptr,
+	v128_t weights, v128_t corner)
+{
+  v128_t member, edges, corners, lo, hi;
+  const v128_t minus1 = wasm_i16x8_splat(-1);
+
+  member = boxsum(inptr0, inptr1);
+  edges = wasm_i16x8_sub(wasm_i16x8_add(boxsum(inptr0 - 1, inptr1 - 1),
+					boxsum(inptr0 + 1, inptr1 + 1)),
+			 member);
+  corners = boxsum(above_ptr, below_ptr);
+  edges = wasm_i16x8_add(edges, corners);
+  corners = wasm_i16x8_sub(wasm_i16x8_add(boxsum(above_ptr - 1, below_ptr - 1),
+					  boxsum(above_ptr + 1, below_ptr + 1)),
+			   corners);
+
+  lo = wasm_i32x4_add(DOT_LO(member, edges, weights),
+		      DOT_LO(corners, minus1, corner));
+  hi = wasm_i32x4_add(DOT_HI(member, edges, weights),
+		      DOT_HI(corners, minus1, corner));
+  return wasm_i16x8_narrow_i32x4(wasm_i32x4_shr(lo, 16),
+				 wasm_i32x4_shr(hi, 16));
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_h2v2_smooth_downsample_wasm (JSAMPROW above_ptr, JSAMPROW inptr0,
+				  JSAMPROW inptr1, JSAMPROW below_ptr,
+				  JSAMPROW outptr, JDIMENSION num_cols,
+				  int memberscale, int neighscale)
+{
+  const v128_t weights = PAIR(memberscale, neighscale * 2);
+  const v128_t corner = PAIR(neighscale, -32768);
+  JDIMENSION col;
+
+  for (col = 0; col + 8 <= num_cols; col += 8)
+    wasm_v128_store(outptr + col,
+		    smooth(above_ptr + col * 2, inptr0 + col * 2,
+			   inptr1 + col * 2, below_ptr + col * 2,
+			   weights, corner));
+  return col;
+}
+
+#endif /* JSIMD_WASM */
@@ -0,0 +1,286 @@
+/*
+ * jcsamx86.c
+ *
+ * This file contains SSE2 and AVX2 versions of the 2h1v and 2h2v
+ * downsamplers of jcsample.c, with and without smoothing, for 12-bit
+ * samples.  jcsample.c selects them at run time when the CPU supports the
+ * instruction set.
+ *
+ * Horizontal pairs of samples are summed with a multiply-add by ones.  The
+ * box filter sums fit in 16 bits; the smoothing filter keeps its member,
+ * edge and corner sums apart, each fitting in 16 bits, and weights them
+ * with a final multiply-add to 32 bits.  The results are bit-identical to
+ * the C code, including the alternating rounding bias.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <immintrin.h>
+
+
+/*
+ * For all kernels, num_cols output columns may be done, from the input
+ * columns twice as far in; the smoothing kernel also reads the columns
+ * either side of those.  The number of output columns done is returned.
+ */
+
+/* Two 16-bit lanes, a in the low one, as a 32-bit value to broadcast */
+#define PAIR(a,b)  ((int) (((unsigned int) (unsigned short) (b) << 16) | \
+			   (unsigned short) (a)))
+
+/* The alternating rounding biases of h2v1_downsample and h2v2_downsample */
+#define H2V1_BIAS  PAIR(0, 1)
+#define H2V2_BIAS  PAIR(1, 2)
+
+
+/*
+ * SSE2 implementation, eight output columns at a time.
+ */
+
+/* Sums of horizontal pairs of the 16-bit lanes of a and b, in order */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+pairsum_sse2 (__m128i a, __m128i b)
+{
+  const __m128i ones = _mm_set1_epi16(1);
+
+  return _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+}
+
+
+/* Sums of the 2x2 boxes of two rows, for eight output columns */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+boxsum_sse2 (const JSAMPLE * inptr0, const JSAMPLE * inptr1)
+{
+  return pairsum_sse2(
+    _mm_add_epi16(_mm_loadu_si128((const __m128i *) inptr0),
+		  _mm_loadu_si128((const __m128i *) inptr1)),
+    _mm_add_epi16(_mm_loadu_si128((const __m128i *) (inptr0 + 8)),
+		  _mm_loadu_si128((const __m128i *) (inptr1 + 8))));
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_h2v1_downsample_sse2 (JSAMPROW inptr, JSAMPROW outptr,
+			   JDIMENSION num_cols)
+{
+  const __m128i bias = _mm_set1_epi32(H2V1_BIAS);
+  JDIMENSION col;
+  __m128i sum;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    sum = pairsum_sse2(
+      _mm_loadu_si128((const __m128i *) (inptr + col * 2)),
+      _mm_loadu_si128((const __m128i *) (inptr + col * 2 + 8)));
+    _mm_storeu_si128((__m128i *) (outptr + col),
+		     _mm_srli_epi16(_mm_add_epi16(sum, bias), 1));
+  }
+  return col;
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_h2v2_downsample_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+			   JDIMENSION num_cols)
+{
+  const __m128i bias = _mm_set1_epi32(H2V2_BIAS);
+  JDIMENSION col;
+  __m128i sum;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    sum = boxsum_sse2(inptr0 + col * 2, inptr1 + col * 2);
+    _mm_storeu_si128((__m128i *) (outptr + col),
+		     _mm_srli_epi16(_mm_add_epi16(sum, bias), 2));
+  }
+  return col;
+}
+
+
+/* The smoothed 2h2v output for eight columns.  The sums of the member
+ * pixels, of the edge neighbors and of the corner neighbors are formed
+ * from box sums: the boxes one column either side cover the outer columns
+ * once and the middle ones twice.  weights holds the member and edge
+ * scales, the latter doubled; corner holds the corner scale and -32768,
+ * which times -1 adds the rounding.
+ */
+
+JSIMD_TARGET_SSE2 static INLINE __m128i
+smooth_sse2 (const JSAMPLE * above_ptr, const JSAMPLE * inptr0,
+	     const JSAMPLE * inptr1, const JSAMPLE * below_ptr,
+	     __m128i weights, __m128i corner)
+{
+  __m128i member, edges, corners, lo, hi;
+  const __m128i minus1 = _mm_set1_epi16(-1);
+
+  member = boxsum_sse2(inptr0, inptr1);
+  edges = _mm_sub_epi16(_mm_add_epi16(boxsum_sse2(inptr0 - 1, inptr1 - 1),
+				      boxsum_sse2(inptr0 + 1, inptr1 + 1)),
+			member);
+  corners = boxsum_sse2(above_ptr, below_ptr);
+  edges = _mm_add_epi16(edges, corners);
+  corners = _mm_sub_epi16(_mm_add_epi16(boxsum_sse2(above_ptr - 1,
+						    below_ptr - 1),
+					boxsum_sse2(above_ptr + 1,
+						    below_ptr + 1)),
+			  corners);
+
+  lo = _mm_add_epi32(
+	 _mm_madd_epi16(_mm_unpacklo_epi16(member, edges), weights),
+	 _mm_madd_epi16(_mm_unpacklo_epi16(corners, minus1), corner));
+  hi = _mm_add_epi32(
+	 _mm_madd_epi16(_mm_unpackhi_epi16(member, edges), weights),
+	 _mm_madd_epi16(_mm_unpackhi_epi16(corners, minus1), corner));
+  return _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_h2v2_smooth_downsample_sse2 (JSAMPROW above_ptr, JSAMPROW inptr0,
+				  JSAMPROW inptr1, JSAMPROW below_ptr,
+				  JSAMPROW outptr, JDIMENSION num_cols,
+				  int memberscale, int neighscale)
+{
+  const __m128i weights = _mm_set1_epi32(PAIR(memberscale, neighscale * 2));
+  const __m128i corner = _mm_set1_epi32(PAIR(neighscale, -32768));
+  JDIMENSION col;
+
+  for (col = 0; col + 8 <= num_cols; col += 8)
+    _mm_storeu_si128((__m128i *) (outptr + col),
+		     smooth_sse2(above_ptr + col * 2, inptr0 + col * 2,
+				 inptr1 + col * 2, below_ptr + col * 2,
+				 weights, corner));
+  return col;
+}
+
+
+/*
+ * AVX2 implementation, sixteen output columns at a time.  The pair sums
+ * come out of the in-lane pack with the middle 64-bit quarters swapped;
+ * everything after that works lane by lane, so they are put back in order
+ * when storing.
+ */
+
+JSIMD_TARGET_AVX2 static INLINE __m256i
+pairsum_avx2 (__m256i a, __m256i b)
+{
+  const __m256i ones = _mm256_set1_epi16(1);
+
+  return _mm256_packs_epi32(_mm256_madd_epi16(a, ones),
+			    _mm256_madd_epi16(b, ones));
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE __m256i
+boxsum_avx2 (const JSAMPLE * inptr0, const JSAMPLE * inptr1)
+{
+  return pairsum_avx2(
+    _mm256_add_epi16(_mm256_loadu_si256((const __m256i *) inptr0),
+		     _mm256_loadu_si256((const __m256i *) inptr1)),
+    _mm256_add_epi16(_mm256_loadu_si256((const __m256i *) (inptr0 + 16)),
+		     _mm256_loadu_si256((const __m256i *) (inptr1 + 16))));
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE void
+store_avx2 (JSAMPROW outptr, __m256i out)
+{
+  _mm256_storeu_si256((__m256i *) outptr,
+		      _mm256_permute4x64_epi64(out, _MM_SHUFFLE(3,1,2,0)));
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_h2v1_downsample_avx2 (JSAMPROW inptr, JSAMPROW outptr,
+			   JDIMENSION num_cols)
+{
+  const __m256i bias = _mm256_set1_epi32(H2V1_BIAS);
+  JDIMENSION col;
+  __m256i sum;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    sum = pairsum_avx2(
+      _mm256_loadu_si256((const __m256i *) (inptr + col * 2)),
+      _mm256_loadu_si256((const __m256i *) (inptr + col * 2 + 16)));
+    store_avx2(outptr + col,
+	       _mm256_srli_epi16(_mm256_add_epi16(sum, bias), 1));
+  }
+  return col;
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_h2v2_downsample_avx2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+			   JDIMENSION num_cols)
+{
+  const __m256i bias = _mm256_set1_epi32(H2V2_BIAS);
+  JDIMENSION col;
+  __m256i sum;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    sum = boxsum_avx2(inptr0 + col * 2, inptr1 + col * 2);
+    store_avx2(outptr + col,
+	       _mm256_srli_epi16(_mm256_add_epi16(sum, bias), 2));
+  }
+  return col;
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE __m256i
+smooth_avx2 (const JSAMPLE * above_ptr, const JSAMPLE * inptr0,
+	     const JSAMPLE * inptr1, const JSAMPLE * below_ptr,
+	     __m256i weights, __m256i corner)
+{
+  __m256i member, edges, corners, lo, hi;
+  const __m256i minus1 = _mm256_set1_epi16(-1);
+
+  member = boxsum_avx2(inptr0, inptr1);
+  edges = _mm256_sub_epi16(
+	    _mm256_add_epi16(boxsum_avx2(inptr0 - 1, inptr1 - 1),
+			     boxsum_avx2(inptr0 + 1, inptr1 + 1)),
+	    member);
+  corners = boxsum_avx2(above_ptr, below_ptr);
+  edges = _mm256_add_epi16(edges, corners);
+  corners = _mm256_sub_epi16(
+	      _mm256_add_epi16(boxsum_avx2(above_ptr - 1, below_ptr - 1),
+			       boxsum_avx2(above_ptr + 1, below_ptr + 1)),
+	      corners);
+
+  lo = _mm256_add_epi32(
+	 _mm256_madd_epi16(_mm256_unpacklo_epi16(member, edges), weights),
+	 _mm256_madd_epi16(_mm256_unpacklo_epi16(corners, minus1), corner));
+  hi = _mm256_add_epi32(
+	 _mm256_madd_epi16(_mm256_unpackhi_epi16(member, edges), weights),
+	 _mm256_madd_epi16(_mm256_unpackhi_epi16(corners, minus1), corner));
+  return _mm256_packs_epi32(_mm256_srai_epi32(lo, 16),
+			    _mm256_srai_epi32(hi, 16));
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_h2v2_smooth_downsample_avx2 (JSAMPROW above_ptr, JSAMPROW inptr0,
+				  JSAMPROW inptr1, JSAMPROW below_ptr,
+				  JSAMPROW outptr, JDIMENSION num_cols,
+				  int memberscale, int neighscale)
+{
+  const __m256i weights = _mm256_set1_epi32(PAIR(memberscale,
+						neighscale * 2));
+  const __m256i corner = _mm256_set1_epi32(PAIR(neighscale, -32768));
+  JDIMENSION col;
+
+  for (col = 0; col + 16 <= num_cols; col += 16)
+    store_avx2(outptr + col,
+	       smooth_avx2(above_ptr + col * 2, inptr0 + col * 2,
+			   inptr1 + col * 2, below_ptr + col * 2,
+			   weights, corner));
+  return col;
+}
+
+#endif /* JSIMD_X86 */
@@ -36,16 +36,16 @@ typedef struct {
 
   /* The output side's location is represented by cinfo->output_iMCU_row. */
 
-  /* In single-pass modes, it's sufficient to buffer just one MCU.
-   * We allocate a workspace of D_MAX_BLOCKS_IN_MCU coefficient blocks,
-   * and let the entropy decoder write into that workspace each time.
-   * (On 80x86, the workspace is FAR even though it's not really very big;
-   * this is to keep the module interfaces unchanged when a large coefficient
-   * buffer is necessary.)
+  /* In single-pass modes, it's sufficient to buffer just one MCU row.
+   * We allocate MCU_height block rows for each component, and point
+   * MCU_buffer at the current MCU's blocks within them before each call
+   * to the entropy decoder.  Once the MCU row is complete, each block row
+   * goes through the batched IDCT in a single call.
    * In multi-pass modes, this array points to the current MCU's blocks
    * within the virtual arrays; it is used only by the input side.
    */
   JBLOCKROW MCU_buffer[D_MAX_BLOCKS_IN_MCU];
+  JBLOCKARRAY MCU_row_buffer[MAX_COMPONENTS];
 
 #ifdef D_MULTISCAN_FILES_SUPPORTED
   /* In multi-pass modes, we need a virtual block array for each component. */
@@ -123,7 +123,8 @@ start_output_pass (j_decompress_ptr cinfo)
 
   /* If multipass, check to see whether to use block smoothing on this pass */
   if (coef->pub.coef_arrays != NULL) {
-    if (cinfo->do_block_smoothing && smoothing_ok(cinfo))
+    if (cinfo->do_block_smoothing && cinfo->block_mask == NULL &&
+	smoothing_ok(cinfo))
       coef->pub.decompress_data = decompress_smooth_data;
     else
       coef->pub.decompress_data = decompress_data;
@@ -133,10 +134,71 @@ start_output_pass (j_decompress_ptr cinfo)
 }
 
 
+/*
+ * IDCT of one block row of an image with a block_mask (see jpeglib.h).
+ * Runs of blocks with some mask bit set go through the batched IDCT and
+ * are then masked sample by sample; runs of fully clear blocks are only
+ * zero filled.  block_row counts block rows from the top of the image.
+ */
+
+LOCAL(boolean)
+mask_is_empty (const UINT8 * mask)
+{
+  int i;
+
+  for (i = 0; i < DCTSIZE; i++)
+    if (mask[i])
+      return FALSE;
+  return TRUE;
+}
+
+LOCAL(void)
+masked_IDCT_row (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		 JBLOCKROW coef_row, JSAMPARRAY output_buf,
+		 JDIMENSION block_row)
+{
+  const UINT8 * mask = cinfo->block_mask +
+    (size_t) block_row * compptr->width_in_blocks * DCTSIZE;
+  JDIMENSION num_blocks = compptr->width_in_blocks;
+  JDIMENSION start, blk, blkn;
+  boolean empty;
+  int row, col;
+  unsigned int bits;
+  register JSAMPROW outptr;
+
+  for (start = 0; start < num_blocks; start = blk) {
+    empty = mask_is_empty(mask + start * DCTSIZE);
+    for (blk = start + 1; blk < num_blocks; blk++)
+      if (mask_is_empty(mask + blk * DCTSIZE) != empty)
+	break;
+    if (empty) {
+      for (row = 0; row < DCTSIZE; row++)
+	jzero_far((void FAR *) (output_buf[row] + start * DCTSIZE),
+		  (size_t) (blk - start) * DCTSIZE * SIZEOF(JSAMPLE));
+      continue;
+    }
+    (*cinfo->idct->inverse_DCT_row[compptr->component_index])
+      (cinfo, compptr, coef_row + start, output_buf,
+       start * DCTSIZE, blk - start);
+    for (row = 0; row < DCTSIZE; row++) {
+      outptr = output_buf[row] + start * DCTSIZE;
+      for (blkn = start; blkn < blk; blkn++, outptr += DCTSIZE) {
+	bits = mask[blkn * DCTSIZE + row];
+	/* Zero if the bit is clear, else 1 if zero; no branches */
+	for (col = 0; col < DCTSIZE; col++, bits >>= 1)
+	  outptr[col] = (JSAMPLE) ((outptr[col] + (outptr[col] == 0)) &
+				   -(int) (bits & 1));
+      }
+    }
+  }
+}
+
+
 /*
  * Decompress and return some data in the single-pass case.
  * Always attempts to emit one fully interleaved MCU row ("iMCU" row).
- * Input and output must run in lockstep since we have only a one-MCU buffer.
+ * Input and output must run in lockstep since we have only a one-MCU-row
+ * buffer.
  * Return value is JPEG_ROW_COMPLETED, JPEG_SCAN_COMPLETED, or JPEG_SUSPENDED.
  *
  * NB: output_buf contains a plane for each component in image,
@@ -150,59 +212,63 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   JDIMENSION MCU_col_num;	/* index of current MCU within row */
   JDIMENSION last_MCU_col = cinfo->MCUs_per_row - 1;
   JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
-  int blkn, ci, xindex, yindex, yoffset, useful_width;
+  int blkn, ci, xindex, yindex, yoffset;
   JSAMPARRAY output_ptr;
-  JDIMENSION start_col, output_col;
+  JBLOCKROW buffer_ptr;
   jpeg_component_info *compptr;
-  inverse_DCT_method_ptr inverse_DCT;
 
   /* Loop to process as much as one whole iMCU row */
   for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
        yoffset++) {
     for (MCU_col_num = coef->MCU_ctr; MCU_col_num <= last_MCU_col;
 	 MCU_col_num++) {
-      /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed. */
-      jzero_far((void FAR *) coef->MCU_buffer[0],
-		(size_t) (cinfo->blocks_in_MCU * SIZEOF(JBLOCK)));
+      /* Point MCU_buffer at this MCU's blocks within the row buffer.
+       * Entropy decoder expects the blocks to be zeroed.
+       */
+      blkn = 0;
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+	compptr = cinfo->cur_comp_info[ci];
+	for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+	  buffer_ptr = coef->MCU_row_buffer[compptr->component_index][yindex] +
+	    MCU_col_num * compptr->MCU_width;
+	  jzero_far((void FAR *) buffer_ptr,
+		    (size_t) (compptr->MCU_width * SIZEOF(JBLOCK)));
+	  for (xindex = 0; xindex < compptr->MCU_width; xindex++)
+	    coef->MCU_buffer[blkn++] = buffer_ptr++;
+	}
+      }
       if (! (*cinfo->entropy->decode_mcu) (cinfo, coef->MCU_buffer)) {
 	/* Suspension forced; update state counters and exit */
 	coef->MCU_vert_offset = yoffset;
 	coef->MCU_ctr = MCU_col_num;
 	return JPEG_SUSPENDED;
       }
-      /* Determine where data should go in output_buf and do the IDCT thing.
-       * We skip dummy blocks at the right and bottom edges (but blkn gets
-       * incremented past them!).  Note the inner loop relies on having
-       * allocated the MCU_buffer[] blocks sequentially.
-       */
-      blkn = 0;			/* index of current DCT block within MCU */
-      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
-	compptr = cinfo->cur_comp_info[ci];
-	/* Don't bother to IDCT an uninteresting component. */
-	if (! compptr->component_needed) {
-	  blkn += compptr->MCU_blocks;
-	  continue;
-	}
-	inverse_DCT = cinfo->idct->inverse_DCT[compptr->component_index];
-	useful_width = (MCU_col_num < last_MCU_col) ? compptr->MCU_width
-						    : compptr->last_col_width;
-	output_ptr = output_buf[compptr->component_index] +
-	  yoffset * compptr->DCT_scaled_size;
-	start_col = MCU_col_num * compptr->MCU_sample_width;
-	for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
-	  if (cinfo->input_iMCU_row < last_iMCU_row ||
-	      yoffset+yindex < compptr->last_row_height) {
-	    output_col = start_col;
-	    for (xindex = 0; xindex < useful_width; xindex++) {
-	      (*inverse_DCT) (cinfo, compptr,
-			      (JCOEFPTR) coef->MCU_buffer[blkn+xindex],
-			      output_ptr, output_col);
-	      output_col += compptr->DCT_scaled_size;
-	    }
-	  }
-	  blkn += compptr->MCU_width;
-	  output_ptr += compptr->DCT_scaled_size;
+    }
+    /* Completed an MCU row, now do the IDCT thing one block row at a time.
+     * We skip dummy blocks at the right and bottom edges; the useful part
+     * of each block row is exactly width_in_blocks long.
+     */
+    for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+      compptr = cinfo->cur_comp_info[ci];
+      /* Don't bother to IDCT an uninteresting component. */
+      if (! compptr->component_needed)
+	continue;
+      output_ptr = output_buf[compptr->component_index] +
+	yoffset * compptr->DCT_scaled_size;
+      for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+	if (cinfo->input_iMCU_row < last_iMCU_row ||
+	    yoffset+yindex < compptr->last_row_height) {
+	  buffer_ptr = coef->MCU_row_buffer[compptr->component_index][yindex];
+	  if (cinfo->block_mask != NULL)
+	    masked_IDCT_row(cinfo, compptr, buffer_ptr, output_ptr,
+			    cinfo->input_iMCU_row * compptr->v_samp_factor +
+			    (JDIMENSION) (yoffset + yindex));
+	  else
+	    (*cinfo->idct->inverse_DCT_row[compptr->component_index])
+	      (cinfo, compptr, buffer_ptr, output_ptr,
+	       (JDIMENSION) 0, compptr->width_in_blocks);
 	}
+	output_ptr += compptr->DCT_scaled_size;
       }
     }
     /* Completed an MCU row, but perhaps not an iMCU row */
@@ -356,6 +422,13 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     output_ptr = output_buf[ci];
     /* Loop over all DCT blocks to be processed. */
     for (block_row = 0; block_row < block_rows; block_row++) {
+      if (cinfo->block_mask != NULL) {
+	masked_IDCT_row(cinfo, compptr, buffer[block_row], output_ptr,
+			cinfo->output_iMCU_row * compptr->v_samp_factor +
+			(JDIMENSION) block_row);
+	output_ptr += compptr->DCT_scaled_size;
+	continue;
+      }
       buffer_ptr = buffer[block_row];
       output_col = 0;
       for (block_num = 0; block_num < compptr->width_in_blocks; block_num++) {
@@ -687,6 +760,12 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
   coef->coef_bits_latch = NULL;
 #endif
 
+  /* The block mask is applied to the IDCT output as is */
+  if (cinfo->block_mask != NULL &&
+      (cinfo->num_components != 1 ||
+       cinfo->comp_info[0].DCT_scaled_size != DCTSIZE))
+    ERREXIT(cinfo, JERR_BAD_BLOCK_MASK);
+
   /* Create the coefficient buffer. */
   if (need_full_buffer) {
 #ifdef D_MULTISCAN_FILES_SUPPORTED
@@ -719,15 +798,18 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
     ERREXIT(cinfo, JERR_NOT_COMPILED);
 #endif
   } else {
-    /* We only need a single-MCU buffer. */
-    JBLOCKROW buffer;
-    int i;
-
-    buffer = (JBLOCKROW)
-      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				  D_MAX_BLOCKS_IN_MCU * SIZEOF(JBLOCK));
-    for (i = 0; i < D_MAX_BLOCKS_IN_MCU; i++) {
-      coef->MCU_buffer[i] = buffer + i;
+    /* We only need a single-MCU-row buffer, */
+    /* padded to a multiple of samp_factor DCT blocks in each direction. */
+    int ci;
+    jpeg_component_info *compptr;
+
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+	 ci++, compptr++) {
+      coef->MCU_row_buffer[ci] = (*cinfo->mem->alloc_barray)
+	((j_common_ptr) cinfo, JPOOL_IMAGE,
+	 (JDIMENSION) jround_up((long) compptr->width_in_blocks,
+				(long) compptr->h_samp_factor),
+	 (JDIMENSION) compptr->v_samp_factor);
     }
     coef->pub.consume_data = dummy_consume_data;
     coef->pub.decompress_data = decompress_onepass;
@@ -11,6 +11,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 /* Private subobject */
@@ -23,6 +24,15 @@ typedef struct {
   int * Cb_b_tab;		/* => table for Cb to B conversion */
   INT32 * Cr_g_tab;		/* => table for Cr to G conversion */
   INT32 * Cb_g_tab;		/* => table for Cb to G conversion */
+
+#ifdef JSIMD_ANY
+  /* SIMD row kernels (see jsimd.h), used instead of the tables */
+  JMETHOD(JDIMENSION, ycc_rgb_simd, (JSAMPROW inptr0, JSAMPROW inptr1,
+				     JSAMPROW inptr2, JSAMPROW outptr,
+				     JDIMENSION num_cols));
+  JMETHOD(JDIMENSION, gray_rgb_simd, (JSAMPROW inptr, JSAMPROW outptr,
+				      JDIMENSION num_cols));
+#endif
 } my_color_deconverter;
 
 typedef my_color_deconverter * my_cconvert_ptr;
@@ -157,6 +167,73 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
 }
 
 
+/*
+ * Convert columns start..num_cols-1 of one row without using the tables.
+ * The arithmetic is exactly that of the tables, only done on the fly.
+ */
+
+LOCAL(void)
+ycc_rgb_fixed (j_decompress_ptr cinfo,
+	       JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	       JSAMPROW outptr, JDIMENSION start, JDIMENSION num_cols)
+{
+  register int y;
+  register INT32 cb, cr;
+  register JDIMENSION col;
+  register JSAMPLE * range_limit = cinfo->sample_range_limit;
+  SHIFT_TEMPS
+
+  outptr += start * RGB_PIXELSIZE;
+  for (col = start; col < num_cols; col++) {
+    y  = GETJSAMPLE(inptr0[col]);
+    cb = (INT32) GETJSAMPLE(inptr1[col]) - CENTERJSAMPLE;
+    cr = (INT32) GETJSAMPLE(inptr2[col]) - CENTERJSAMPLE;
+    outptr[RGB_RED] = range_limit[y + (int)
+			RIGHT_SHIFT(FIX(1.40200) * cr + ONE_HALF, SCALEBITS)];
+    outptr[RGB_GREEN] = range_limit[y + (int)
+			RIGHT_SHIFT(- FIX(0.34414) * cb - FIX(0.71414) * cr
+				    + ONE_HALF, SCALEBITS)];
+    outptr[RGB_BLUE] = range_limit[y + (int)
+			RIGHT_SHIFT(FIX(1.77200) * cb + ONE_HALF, SCALEBITS)];
+    outptr += RGB_PIXELSIZE;
+  }
+}
+
+
+#ifdef JSIMD_ANY
+
+/*
+ * Same as ycc_rgb_convert, using a SIMD kernel for as much of each row as
+ * it can do.  Only selected when RGB_PIXELSIZE is 3, in R,G,B order.
+ */
+
+METHODDEF(void)
+ycc_rgb_convert_simd (j_decompress_ptr cinfo,
+		      JSAMPIMAGE input_buf, JDIMENSION input_row,
+		      JSAMPARRAY output_buf, int num_rows)
+{
+  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+  JSAMPROW outptr;
+  JSAMPROW inptr0, inptr1, inptr2;
+  JDIMENSION col;
+  JDIMENSION num_cols = cinfo->output_width;
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    col = (*cconvert->ycc_rgb_simd) (inptr0, inptr1, inptr2, outptr,
+				     num_cols);
+    if (col < num_cols)
+      ycc_rgb_fixed(cinfo, inptr0, inptr1, inptr2, outptr, col, num_cols);
+  }
+}
+
+#endif /* JSIMD_ANY */
+
+
 /**************** Cases other than YCbCr -> RGB **************/
 
 
@@ -234,6 +311,32 @@ gray_rgb_convert (j_decompress_ptr cinfo,
 }
 
 
+#ifdef JSIMD_ANY
+
+METHODDEF(void)
+gray_rgb_convert_simd (j_decompress_ptr cinfo,
+		       JSAMPIMAGE input_buf, JDIMENSION input_row,
+		       JSAMPARRAY output_buf, int num_rows)
+{
+  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+  JSAMPROW inptr, outptr;
+  JDIMENSION col;
+  JDIMENSION num_cols = cinfo->output_width;
+
+  while (--num_rows >= 0) {
+    inptr = input_buf[0][input_row++];
+    outptr = *output_buf++;
+    col = (*cconvert->gray_rgb_simd) (inptr, outptr, num_cols);
+    for (outptr += col * RGB_PIXELSIZE; col < num_cols; col++) {
+      outptr[RGB_RED] = outptr[RGB_GREEN] = outptr[RGB_BLUE] = inptr[col];
+      outptr += RGB_PIXELSIZE;
+    }
+  }
+}
+
+#endif /* JSIMD_ANY */
+
+
 /*
  * Adobe-style YCCK->CMYK conversion.
  * We convert YCbCr to R=1-C, G=1-M, and B=1-Y using the same
@@ -296,6 +399,42 @@ start_pass_dcolor (j_decompress_ptr cinfo)
 }
 
 
+#ifdef JSIMD_ANY
+
+/*
+ * Pick the SIMD kernels for conversion to RGB, if there are any for
+ * this machine.  Returns TRUE if they were found.
+ */
+
+LOCAL(boolean)
+select_simd_rgb (my_cconvert_ptr cconvert)
+{
+  /* The kernels write R,G,B triplets */
+  if (RGB_RED != 0 || RGB_GREEN != 1 || RGB_BLUE != 2 || RGB_PIXELSIZE != 3)
+    return FALSE;
+#ifdef JSIMD_X86
+  if (jsimd_cpu_features() & JSIMD_AVX2) {
+    cconvert->ycc_rgb_simd = jpeg_ycc_rgb_avx2;
+    cconvert->gray_rgb_simd = jpeg_gray_rgb_avx2;
+    return TRUE;
+  }
+  if (jsimd_cpu_features() & JSIMD_SSE2) {
+    cconvert->ycc_rgb_simd = jpeg_ycc_rgb_sse2;
+    cconvert->gray_rgb_simd = jpeg_gray_rgb_sse2;
+    return TRUE;
+  }
+#endif
+#ifdef JSIMD_WASM
+  cconvert->ycc_rgb_simd = jpeg_ycc_rgb_wasm;
+  cconvert->gray_rgb_simd = jpeg_gray_rgb_wasm;
+  return TRUE;
+#endif
+  return FALSE;
+}
+
+#endif /* JSIMD_ANY */
+
+
 /*
  * Module initialization routine for output colorspace conversion.
  */
@@ -358,10 +497,22 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
   case JCS_RGB:
     cinfo->out_color_components = RGB_PIXELSIZE;
     if (cinfo->jpeg_color_space == JCS_YCbCr) {
-      cconvert->pub.color_convert = ycc_rgb_convert;
-      build_ycc_rgb_table(cinfo);
+#ifdef JSIMD_ANY
+      if (select_simd_rgb(cconvert))
+	cconvert->pub.color_convert = ycc_rgb_convert_simd; /* no tables */
+      else
+#endif
+      {
+	cconvert->pub.color_convert = ycc_rgb_convert;
+	build_ycc_rgb_table(cinfo);
+      }
     } else if (cinfo->jpeg_color_space == JCS_GRAYSCALE) {
-      cconvert->pub.color_convert = gray_rgb_convert;
+#ifdef JSIMD_ANY
+      if (select_simd_rgb(cconvert))
+	cconvert->pub.color_convert = gray_rgb_convert_simd;
+      else
+#endif
+	cconvert->pub.color_convert = gray_rgb_convert;
     } else if (cinfo->jpeg_color_space == JCS_RGB && RGB_PIXELSIZE == 3) {
       cconvert->pub.color_convert = null_convert;
     } else
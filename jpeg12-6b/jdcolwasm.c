@@ -0,0 +1,203 @@
+/*
+ * jdcolwasm.c
+ *
+ * This file contains WebAssembly SIMD128 versions of the YCbCr->RGB and
+ * gray->RGB conversions of jdcolor.c and of the merged upsamplers of
+ * jdmerge.c, for 12-bit samples.  They are built when compiling with
+ * -msimd128, and are then always used.
+ *
+ * The arithmetic is the same as in jdcolx86.c: 16x16->32 bit dot products
+ * with the split constants described in jsimd.h, giving results that are
+ * bit-identical to the table-driven C code, eight pixels at a time.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_WASM
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <wasm_simd128.h>
+
+
+/* Pairs of 16-bit multipliers, for use with dot products on interleaved inputs */
+#define PAIR(a,b)  wasm_i16x8_make(a, b, a, b, a, b, a, b)
+
+/* Multiplying a -1 lane by this adds ONE_HALF to each product */
+#define MINUS_HALF  (-32768)
+
+
+/* (lo,hi) pairs of 16-bit values times a constant pair, then >> 16 */
+static INLINE v128_t
+dot_shift (v128_t a, v128_t b, v128_t c, v128_t bias)
+{
+  v128_t lo = wasm_i32x4_dot_i16x8(wasm_i16x8_shuffle(a, b, 0, 8, 1, 9,
+						      2, 10, 3, 11), c);
+  v128_t hi = wasm_i32x4_dot_i16x8(wasm_i16x8_shuffle(a, b, 4, 12, 5, 13,
+						      6, 14, 7, 15), c);
+
+  lo = wasm_i32x4_shr(wasm_i32x4_add(lo, bias), 16);
+  hi = wasm_i32x4_shr(wasm_i32x4_add(hi, bias), 16);
+  return wasm_i16x8_narrow_i32x4(lo, hi);
+}
+
+
+/* The chroma part of the conversion: the amounts to add to Y for R, G
+ * and B, from unbiased Cb and Cr samples.
+ */
+
+static INLINE void
+chroma (v128_t cb, v128_t cr, v128_t * dr, v128_t * dg, v128_t * db)
+{
+  const v128_t center = wasm_i16x8_splat(CENTERJSAMPLE);
+  const v128_t minus1 = wasm_i16x8_splat(-1);
+  const v128_t zero = wasm_i32x4_splat(0);
+
+  cb = wasm_i16x8_sub(cb, center);
+  cr = wasm_i16x8_sub(cr, center);
+  *dr = dot_shift(cr, minus1, PAIR(JSIMD_FIX_R, MINUS_HALF), zero);
+  *dr = wasm_i16x8_add(*dr, cr);
+  *dg = dot_shift(cb, cr, PAIR(JSIMD_FIX_G_CB, JSIMD_FIX_G_CR),
+		  wasm_i32x4_splat(32768));
+  *dg = wasm_i16x8_sub(*dg, cr);
+  *db = dot_shift(cb, minus1, PAIR(JSIMD_FIX_B, MINUS_HALF), zero);
+  *db = wasm_i16x8_add(*db, wasm_i16x8_add(cb, cb));
+}
+
+
+/* Y plus a chroma term, range limited */
+static INLINE v128_t
+add_limit (v128_t y, v128_t d)
+{
+  return wasm_i16x8_min(wasm_i16x8_max(wasm_i16x8_add(y, d),
+				       wasm_i16x8_splat(0)),
+			wasm_i16x8_splat(MAXJSAMPLE));
+}
+
+
+static INLINE void
+ycc_rgb (const JSAMPLE * inptr0, const JSAMPLE * inptr1,
+	 const JSAMPLE * inptr2, v128_t * r, v128_t * g, v128_t * b)
+{
+  v128_t y = wasm_v128_load(inptr0);
+  v128_t dr, dg, db;
+
+  chroma(wasm_v128_load(inptr1), wasm_v128_load(inptr2), &dr, &dg, &db);
+  *r = add_limit(y, dr);
+  *g = add_limit(y, dg);
+  *b = add_limit(y, db);
+}
+
+
+/* Store eight pixels as RGB triplets, in three vectors:
+ *	R0 G0 B0 R1 G1 B1 R2 G2 | B2 R3 G3 B3 R4 G4 B4 R5 | G5 B5 R6 G6 B6 R7 G7 B7
+ * The R and G lanes are placed first, leaving holes that the B lanes fill.
+ */
+
+static INLINE void
+store_rgb (JSAMPLE * outptr, v128_t r, v128_t g, v128_t b)
+{
+  v128_t t;
+
+  t = wasm_i16x8_shuffle(r, g, 0, 8, 0, 1, 9, 0, 2, 10);
+  wasm_v128_store(outptr, wasm_i16x8_shuffle(t, b, 0, 1, 8, 3, 4, 9, 6, 7));
+  t = wasm_i16x8_shuffle(r, g, 0, 3, 11, 0, 4, 12, 0, 5);
+  wasm_v128_store(outptr + 8,
+		  wasm_i16x8_shuffle(t, b, 10, 1, 2, 11, 4, 5, 12, 7));
+  t = wasm_i16x8_shuffle(r, g, 13, 0, 6, 14, 0, 7, 15, 0);
+  wasm_v128_store(outptr + 16,
+		  wasm_i16x8_shuffle(t, b, 0, 13, 2, 3, 14, 5, 6, 15));
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_ycc_rgb_wasm (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		   JSAMPROW outptr, JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  v128_t r, g, b;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    ycc_rgb(inptr0 + col, inptr1 + col, inptr2 + col, &r, &g, &b);
+    store_rgb(outptr + col * 3, r, g, b);
+  }
+  return col;
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_gray_rgb_wasm (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  v128_t y;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    y = wasm_v128_load(inptr + col);
+    store_rgb(outptr + col * 3, y, y, y);
+  }
+  return col;
+}
+
+
+/* Merged upsampling and conversion for 2h1v and 2h2v sampling (jdmerge.c).
+ * Each chroma term is computed once and added to the two (or four) Y
+ * samples that share it.  num_cols counts output pixels.
+ */
+
+#define DUP_LO(d)  wasm_i16x8_shuffle(d, d, 0, 0, 1, 1, 2, 2, 3, 3)
+#define DUP_HI(d)  wasm_i16x8_shuffle(d, d, 4, 4, 5, 5, 6, 6, 7, 7)
+
+static INLINE void
+merged_row (const JSAMPLE * inptr, JSAMPLE * outptr,
+	    v128_t dr, v128_t dg, v128_t db)
+{
+  v128_t y;
+
+  y = wasm_v128_load(inptr);
+  store_rgb(outptr, add_limit(y, DUP_LO(dr)), add_limit(y, DUP_LO(dg)),
+	    add_limit(y, DUP_LO(db)));
+  y = wasm_v128_load(inptr + 8);
+  store_rgb(outptr + 24, add_limit(y, DUP_HI(dr)), add_limit(y, DUP_HI(dg)),
+	    add_limit(y, DUP_HI(db)));
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_h2v1_merged_wasm (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		       JSAMPROW outptr, JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  v128_t dr, dg, db;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    chroma(wasm_v128_load(inptr1 + col / 2), wasm_v128_load(inptr2 + col / 2),
+	   &dr, &dg, &db);
+    merged_row(inptr0 + col, outptr + col * 3, dr, dg, db);
+  }
+  return col;
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_h2v2_merged_wasm (JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1,
+		       JSAMPROW inptr2, JSAMPROW outptr0, JSAMPROW outptr1,
+		       JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  v128_t dr, dg, db;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    chroma(wasm_v128_load(inptr1 + col / 2), wasm_v128_load(inptr2 + col / 2),
+	   &dr, &dg, &db);
+    merged_row(inptr00 + col, outptr0 + col * 3, dr, dg, db);
+    merged_row(inptr01 + col, outptr1 + col * 3, dr, dg, db);
+  }
+  return col;
+}
+
+#endif /* JSIMD_WASM */
@@ -0,0 +1,387 @@
+/*
+ * jdcolx86.c
+ *
+ * This file contains SSE2 and AVX2 versions of the YCbCr->RGB and
+ * gray->RGB conversions of jdcolor.c and of the merged upsamplers of
+ * jdmerge.c, for 12-bit samples.  Those modules select them at run time
+ * when the CPU supports the instruction set.
+ *
+ * Instead of the four lookup tables used by ycc_rgb_convert, the products
+ * are formed with 16x16->32 bit multiply-adds, using the split constants
+ * described in jsimd.h, so the results are bit-identical to the C code.
+ * All intermediates fit in 16 bits once shifted back down, which allows
+ * eight (SSE2) or sixteen (AVX2) pixels per step.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <immintrin.h>
+
+
+/* Pairs of 16-bit multipliers, for use with madd on interleaved inputs */
+#define PAIR_SSE2(a,b)  _mm_set_epi16(b, a, b, a, b, a, b, a)
+#define PAIR_AVX2(a,b)  _mm256_set_epi16(b, a, b, a, b, a, b, a, \
+					 b, a, b, a, b, a, b, a)
+
+/* Multiplying a -1 lane by this adds ONE_HALF to each product */
+#define MINUS_HALF  (-32768)
+
+
+/*
+ * SSE2 implementation, eight pixels at a time.
+ */
+
+/* (lo,hi) pairs of 16-bit values times a constant pair, then >> 16 */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+madd_shift_sse2 (__m128i a, __m128i b, __m128i c, __m128i bias)
+{
+  __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c);
+  __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c);
+
+  lo = _mm_srai_epi32(_mm_add_epi32(lo, bias), 16);
+  hi = _mm_srai_epi32(_mm_add_epi32(hi, bias), 16);
+  return _mm_packs_epi32(lo, hi);
+}
+
+
+/* The chroma part of the conversion: the amounts to add to Y for R, G
+ * and B, from unbiased Cb and Cr samples.
+ */
+
+JSIMD_TARGET_SSE2 static INLINE void
+chroma_sse2 (__m128i cb, __m128i cr, __m128i * dr, __m128i * dg, __m128i * db)
+{
+  const __m128i center = _mm_set1_epi16(CENTERJSAMPLE);
+  const __m128i minus1 = _mm_set1_epi16(-1);
+  const __m128i zero = _mm_setzero_si128();
+
+  cb = _mm_sub_epi16(cb, center);
+  cr = _mm_sub_epi16(cr, center);
+  *dr = madd_shift_sse2(cr, minus1, PAIR_SSE2(JSIMD_FIX_R, MINUS_HALF), zero);
+  *dr = _mm_add_epi16(*dr, cr);
+  *dg = madd_shift_sse2(cb, cr, PAIR_SSE2(JSIMD_FIX_G_CB, JSIMD_FIX_G_CR),
+			_mm_set1_epi32(32768));
+  *dg = _mm_sub_epi16(*dg, cr);
+  *db = madd_shift_sse2(cb, minus1, PAIR_SSE2(JSIMD_FIX_B, MINUS_HALF), zero);
+  *db = _mm_add_epi16(*db, _mm_add_epi16(cb, cb));
+}
+
+
+/* Y plus a chroma term, range limited */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+add_limit_sse2 (__m128i y, __m128i d)
+{
+  return _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(y, d),
+				     _mm_setzero_si128()),
+		       _mm_set1_epi16(MAXJSAMPLE));
+}
+
+
+JSIMD_TARGET_SSE2 static INLINE void
+ycc_rgb_sse2 (const JSAMPLE * inptr0, const JSAMPLE * inptr1,
+	      const JSAMPLE * inptr2, __m128i * r, __m128i * g, __m128i * b)
+{
+  __m128i y = _mm_loadu_si128((const __m128i *) inptr0);
+  __m128i dr, dg, db;
+
+  chroma_sse2(_mm_loadu_si128((const __m128i *) inptr1),
+	      _mm_loadu_si128((const __m128i *) inptr2), &dr, &dg, &db);
+  *r = add_limit_sse2(y, dr);
+  *g = add_limit_sse2(y, dg);
+  *b = add_limit_sse2(y, db);
+}
+
+
+/* Store eight pixels as RGB triplets.  Each pixel is written as a 64-bit
+ * RGBx group, and the x is overwritten by the next pixel; the last one is
+ * stored by parts so nothing past the end of the row is touched.
+ */
+
+JSIMD_TARGET_SSE2 static INLINE void
+store_rgb_sse2 (JSAMPLE * outptr, __m128i r, __m128i g, __m128i b)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i rg_lo = _mm_unpacklo_epi16(r, g);
+  __m128i rg_hi = _mm_unpackhi_epi16(r, g);
+  __m128i bx_lo = _mm_unpacklo_epi16(b, zero);
+  __m128i bx_hi = _mm_unpackhi_epi16(b, zero);
+  __m128i p01 = _mm_unpacklo_epi32(rg_lo, bx_lo);
+  __m128i p23 = _mm_unpackhi_epi32(rg_lo, bx_lo);
+  __m128i p45 = _mm_unpacklo_epi32(rg_hi, bx_hi);
+  __m128i p67 = _mm_unpackhi_epi32(rg_hi, bx_hi);
+
+  _mm_storel_epi64((__m128i *) (outptr + 0), p01);
+  _mm_storel_epi64((__m128i *) (outptr + 3), _mm_srli_si128(p01, 8));
+  _mm_storel_epi64((__m128i *) (outptr + 6), p23);
+  _mm_storel_epi64((__m128i *) (outptr + 9), _mm_srli_si128(p23, 8));
+  _mm_storel_epi64((__m128i *) (outptr + 12), p45);
+  _mm_storel_epi64((__m128i *) (outptr + 15), _mm_srli_si128(p45, 8));
+  _mm_storel_epi64((__m128i *) (outptr + 18), p67);
+  outptr[21] = (JSAMPLE) _mm_extract_epi16(p67, 4);
+  outptr[22] = (JSAMPLE) _mm_extract_epi16(p67, 5);
+  outptr[23] = (JSAMPLE) _mm_extract_epi16(p67, 6);
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_ycc_rgb_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		   JSAMPROW outptr, JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  __m128i r, g, b;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    ycc_rgb_sse2(inptr0 + col, inptr1 + col, inptr2 + col, &r, &g, &b);
+    store_rgb_sse2(outptr + col * 3, r, g, b);
+  }
+  return col;
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_gray_rgb_sse2 (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  __m128i y;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    y = _mm_loadu_si128((const __m128i *) (inptr + col));
+    store_rgb_sse2(outptr + col * 3, y, y, y);
+  }
+  return col;
+}
+
+
+/* Merged upsampling and conversion for 2h1v and 2h2v sampling (jdmerge.c).
+ * Each chroma term is computed once and added to the two (or four) Y
+ * samples that share it.  num_cols counts output pixels.
+ */
+
+JSIMD_TARGET_SSE2 static INLINE void
+merged_row_sse2 (const JSAMPLE * inptr, JSAMPLE * outptr,
+		 __m128i dr, __m128i dg, __m128i db)
+{
+  __m128i y;
+
+  y = _mm_loadu_si128((const __m128i *) inptr);
+  store_rgb_sse2(outptr, add_limit_sse2(y, _mm_unpacklo_epi16(dr, dr)),
+		 add_limit_sse2(y, _mm_unpacklo_epi16(dg, dg)),
+		 add_limit_sse2(y, _mm_unpacklo_epi16(db, db)));
+  y = _mm_loadu_si128((const __m128i *) (inptr + 8));
+  store_rgb_sse2(outptr + 24, add_limit_sse2(y, _mm_unpackhi_epi16(dr, dr)),
+		 add_limit_sse2(y, _mm_unpackhi_epi16(dg, dg)),
+		 add_limit_sse2(y, _mm_unpackhi_epi16(db, db)));
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_h2v1_merged_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		       JSAMPROW outptr, JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  __m128i dr, dg, db;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    chroma_sse2(_mm_loadu_si128((const __m128i *) (inptr1 + col / 2)),
+		_mm_loadu_si128((const __m128i *) (inptr2 + col / 2)),
+		&dr, &dg, &db);
+    merged_row_sse2(inptr0 + col, outptr + col * 3, dr, dg, db);
+  }
+  return col;
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_h2v2_merged_sse2 (JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1,
+		       JSAMPROW inptr2, JSAMPROW outptr0, JSAMPROW outptr1,
+		       JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  __m128i dr, dg, db;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    chroma_sse2(_mm_loadu_si128((const __m128i *) (inptr1 + col / 2)),
+		_mm_loadu_si128((const __m128i *) (inptr2 + col / 2)),
+		&dr, &dg, &db);
+    merged_row_sse2(inptr00 + col, outptr0 + col * 3, dr, dg, db);
+    merged_row_sse2(inptr01 + col, outptr1 + col * 3, dr, dg, db);
+  }
+  return col;
+}
+
+
+/*
+ * AVX2 implementation, sixteen pixels at a time.  The unpack and pack
+ * instructions work within 128-bit lanes, so each lane holds eight
+ * consecutive pixels throughout and is stored with the SSE2 code.
+ */
+
+JSIMD_TARGET_AVX2 static INLINE __m256i
+madd_shift_avx2 (__m256i a, __m256i b, __m256i c, __m256i bias)
+{
+  __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c);
+  __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c);
+
+  lo = _mm256_srai_epi32(_mm256_add_epi32(lo, bias), 16);
+  hi = _mm256_srai_epi32(_mm256_add_epi32(hi, bias), 16);
+  return _mm256_packs_epi32(lo, hi);
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE void
+chroma_avx2 (__m256i cb, __m256i cr, __m256i * dr, __m256i * dg, __m256i * db)
+{
+  const __m256i center = _mm256_set1_epi16(CENTERJSAMPLE);
+  const __m256i minus1 = _mm256_set1_epi16(-1);
+  const __m256i zero = _mm256_setzero_si256();
+
+  cb = _mm256_sub_epi16(cb, center);
+  cr = _mm256_sub_epi16(cr, center);
+  *dr = madd_shift_avx2(cr, minus1, PAIR_AVX2(JSIMD_FIX_R, MINUS_HALF), zero);
+  *dr = _mm256_add_epi16(*dr, cr);
+  *dg = madd_shift_avx2(cb, cr, PAIR_AVX2(JSIMD_FIX_G_CB, JSIMD_FIX_G_CR),
+			_mm256_set1_epi32(32768));
+  *dg = _mm256_sub_epi16(*dg, cr);
+  *db = madd_shift_avx2(cb, minus1, PAIR_AVX2(JSIMD_FIX_B, MINUS_HALF), zero);
+  *db = _mm256_add_epi16(*db, _mm256_add_epi16(cb, cb));
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE __m256i
+add_limit_avx2 (__m256i y, __m256i d)
+{
+  return _mm256_min_epi16(_mm256_max_epi16(_mm256_add_epi16(y, d),
+					   _mm256_setzero_si256()),
+			  _mm256_set1_epi16(MAXJSAMPLE));
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE void
+ycc_rgb_avx2 (const JSAMPLE * inptr0, const JSAMPLE * inptr1,
+	      const JSAMPLE * inptr2, __m256i * r, __m256i * g, __m256i * b)
+{
+  __m256i y = _mm256_loadu_si256((const __m256i *) inptr0);
+  __m256i dr, dg, db;
+
+  chroma_avx2(_mm256_loadu_si256((const __m256i *) inptr1),
+	      _mm256_loadu_si256((const __m256i *) inptr2), &dr, &dg, &db);
+  *r = add_limit_avx2(y, dr);
+  *g = add_limit_avx2(y, dg);
+  *b = add_limit_avx2(y, db);
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE void
+store_rgb_avx2 (JSAMPLE * outptr, __m256i r, __m256i g, __m256i b)
+{
+  store_rgb_sse2(outptr, _mm256_castsi256_si128(r),
+		 _mm256_castsi256_si128(g), _mm256_castsi256_si128(b));
+  store_rgb_sse2(outptr + 24, _mm256_extracti128_si256(r, 1),
+		 _mm256_extracti128_si256(g, 1),
+		 _mm256_extracti128_si256(b, 1));
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_ycc_rgb_avx2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		   JSAMPROW outptr, JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  __m256i r, g, b;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    ycc_rgb_avx2(inptr0 + col, inptr1 + col, inptr2 + col, &r, &g, &b);
+    store_rgb_avx2(outptr + col * 3, r, g, b);
+  }
+  return col;
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_gray_rgb_avx2 (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  __m256i y;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    y = _mm256_loadu_si256((const __m256i *) (inptr + col));
+    store_rgb_avx2(outptr + col * 3, y, y, y);
+  }
+  return col;
+}
+
+
+/* Duplicating each chroma term within the lanes leaves the first sixteen
+ * pixels' worth split between the low lanes of the two unpacks.
+ */
+
+JSIMD_TARGET_AVX2 static INLINE void
+merged_row_avx2 (const JSAMPLE * inptr, JSAMPLE * outptr,
+		 __m256i dr, __m256i dg, __m256i db)
+{
+  __m256i rlo = _mm256_unpacklo_epi16(dr, dr);
+  __m256i rhi = _mm256_unpackhi_epi16(dr, dr);
+  __m256i glo = _mm256_unpacklo_epi16(dg, dg);
+  __m256i ghi = _mm256_unpackhi_epi16(dg, dg);
+  __m256i blo = _mm256_unpacklo_epi16(db, db);
+  __m256i bhi = _mm256_unpackhi_epi16(db, db);
+  __m256i y;
+
+  y = _mm256_loadu_si256((const __m256i *) inptr);
+  store_rgb_avx2(outptr,
+		 add_limit_avx2(y, _mm256_permute2x128_si256(rlo, rhi, 0x20)),
+		 add_limit_avx2(y, _mm256_permute2x128_si256(glo, ghi, 0x20)),
+		 add_limit_avx2(y, _mm256_permute2x128_si256(blo, bhi, 0x20)));
+  y = _mm256_loadu_si256((const __m256i *) (inptr + 16));
+  store_rgb_avx2(outptr + 48,
+		 add_limit_avx2(y, _mm256_permute2x128_si256(rlo, rhi, 0x31)),
+		 add_limit_avx2(y, _mm256_permute2x128_si256(glo, ghi, 0x31)),
+		 add_limit_avx2(y, _mm256_permute2x128_si256(blo, bhi, 0x31)));
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_h2v1_merged_avx2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		       JSAMPROW outptr, JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  __m256i dr, dg, db;
+
+  for (col = 0; col + 32 <= num_cols; col += 32) {
+    chroma_avx2(_mm256_loadu_si256((const __m256i *) (inptr1 + col / 2)),
+		_mm256_loadu_si256((const __m256i *) (inptr2 + col / 2)),
+		&dr, &dg, &db);
+    merged_row_avx2(inptr0 + col, outptr + col * 3, dr, dg, db);
+  }
+  return col;
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_h2v2_merged_avx2 (JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1,
+		       JSAMPROW inptr2, JSAMPROW outptr0, JSAMPROW outptr1,
+		       JDIMENSION num_cols)
+{
+  JDIMENSION col;
+  __m256i dr, dg, db;
+
+  for (col = 0; col + 32 <= num_cols; col += 32) {
+    chroma_avx2(_mm256_loadu_si256((const __m256i *) (inptr1 + col / 2)),
+		_mm256_loadu_si256((const __m256i *) (inptr2 + col / 2)),
+		&dr, &dg, &db);
+    merged_row_avx2(inptr00 + col, outptr0 + col * 3, dr, dg, db);
+    merged_row_avx2(inptr01 + col, outptr1 + col * 3, dr, dg, db);
+  }
+  return col;
+}
+
+#endif /* JSIMD_X86 */
@@ -19,6 +19,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"		/* SIMD replacements for some IDCT routines */
 
 
 /*
@@ -79,6 +80,27 @@ typedef union {
 #endif
 
 
+/*
+ * Batched IDCT for methods that only come in single-block form.
+ * The coefficient controller calls this once per block row.
+ */
+
+METHODDEF(void)
+idct_row_by_block (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		   JBLOCKROW coef_row, JSAMPARRAY output_buf,
+		   JDIMENSION output_col, JDIMENSION num_blocks)
+{
+  inverse_DCT_method_ptr inverse_DCT =
+    cinfo->idct->inverse_DCT[compptr->component_index];
+
+  for (; num_blocks > 0; num_blocks--, coef_row++) {
+    (*inverse_DCT) (cinfo, compptr, (JCOEFPTR) coef_row,
+		    output_buf, output_col);
+    output_col += compptr->DCT_scaled_size;
+  }
+}
+
+
 /*
  * Prepare for an output pass.
  * Here we select the proper IDCT routine for each component and build
@@ -93,10 +115,12 @@ start_pass (j_decompress_ptr cinfo)
   jpeg_component_info *compptr;
   int method = 0;
   inverse_DCT_method_ptr method_ptr = NULL;
+  inverse_DCT_row_method_ptr row_method_ptr;
   JQUANT_TBL * qtbl;
 
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
+    row_method_ptr = idct_row_by_block;
     /* Select the proper IDCT routine for this component's scaling */
     switch (compptr->DCT_scaled_size) {
 #ifdef IDCT_SCALING_SUPPORTED
@@ -118,6 +142,15 @@ start_pass (j_decompress_ptr cinfo)
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
 	method_ptr = jpeg_idct_islow;
+#ifdef JSIMD_X86
+	if (jsimd_cpu_features() & JSIMD_AVX2) {
+	  method_ptr = jpeg_idct_islow_avx2;
+	  row_method_ptr = jpeg_idct_islow_row_avx2;
+	} else if (jsimd_cpu_features() & JSIMD_SSE2) {
+	  method_ptr = jpeg_idct_islow_sse2;
+	  row_method_ptr = jpeg_idct_islow_row_sse2;
+	}
+#endif
 	method = JDCT_ISLOW;
 	break;
 #endif
@@ -130,6 +163,15 @@ start_pass (j_decompress_ptr cinfo)
 #ifdef DCT_FLOAT_SUPPORTED
       case JDCT_FLOAT:
 	method_ptr = jpeg_idct_float;
+#ifdef JSIMD_X86
+	if (jsimd_cpu_features() & JSIMD_AVX2) {
+	  method_ptr = jpeg_idct_float_avx2;
+	  row_method_ptr = jpeg_idct_float_row_avx2;
+	} else if (jsimd_cpu_features() & JSIMD_SSE2) {
+	  method_ptr = jpeg_idct_float_sse2;
+	  row_method_ptr = jpeg_idct_float_row_sse2;
+	}
+#endif
 	method = JDCT_FLOAT;
 	break;
 #endif
@@ -143,6 +185,7 @@ start_pass (j_decompress_ptr cinfo)
       break;
     }
     idct->pub.inverse_DCT[ci] = method_ptr;
+    idct->pub.inverse_DCT_row[ci] = row_method_ptr;
     /* Create multiplier table from quant table.
      * However, we can skip this if the component is uninteresting
      * or if we already built the table.  Also, if no quant table
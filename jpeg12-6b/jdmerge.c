@@ -35,6 +35,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 #ifdef UPSAMPLE_MERGING_SUPPORTED
 
@@ -55,6 +56,17 @@ typedef struct {
   INT32 * Cr_g_tab;		/* => table for Cr to G conversion */
   INT32 * Cb_g_tab;		/* => table for Cb to G conversion */
 
+#ifdef JSIMD_ANY
+  /* SIMD kernels for the bulk of each row (see jsimd.h), or NULL */
+  JMETHOD(JDIMENSION, h2v1_simd, (JSAMPROW inptr0, JSAMPROW inptr1,
+				  JSAMPROW inptr2, JSAMPROW outptr,
+				  JDIMENSION num_cols));
+  JMETHOD(JDIMENSION, h2v2_simd, (JSAMPROW inptr00, JSAMPROW inptr01,
+				  JSAMPROW inptr1, JSAMPROW inptr2,
+				  JSAMPROW outptr0, JSAMPROW outptr1,
+				  JDIMENSION num_cols));
+#endif
+
   /* For 2:1 vertical sampling, we produce two output rows at a time.
    * We need a "spare" row buffer to hold the second output row if the
    * application provides just a one-row buffer; we also use the spare
@@ -233,6 +245,9 @@ h2v1_merged_upsample (j_decompress_ptr cinfo,
   register JSAMPROW outptr;
   JSAMPROW inptr0, inptr1, inptr2;
   JDIMENSION col;
+#ifdef JSIMD_ANY
+  JDIMENSION done;
+#endif
   /* copy these pointers into registers if possible */
   register JSAMPLE * range_limit = cinfo->sample_range_limit;
   int * Crrtab = upsample->Cr_r_tab;
@@ -245,8 +260,20 @@ h2v1_merged_upsample (j_decompress_ptr cinfo,
   inptr1 = input_buf[1][in_row_group_ctr];
   inptr2 = input_buf[2][in_row_group_ctr];
   outptr = output_buf[0];
+  col = cinfo->output_width >> 1;
+#ifdef JSIMD_ANY
+  if (upsample->h2v1_simd != NULL) {
+    done = (*upsample->h2v1_simd) (inptr0, inptr1, inptr2, outptr,
+				   cinfo->output_width);
+    inptr0 += done;
+    inptr1 += done >> 1;
+    inptr2 += done >> 1;
+    outptr += done * RGB_PIXELSIZE;
+    col -= done >> 1;
+  }
+#endif
   /* Loop for each pair of output pixels */
-  for (col = cinfo->output_width >> 1; col > 0; col--) {
+  for (; col > 0; col--) {
     /* Do the chroma part of the calculation */
     cb = GETJSAMPLE(*inptr1++);
     cr = GETJSAMPLE(*inptr2++);
@@ -295,6 +322,9 @@ h2v2_merged_upsample (j_decompress_ptr cinfo,
   register JSAMPROW outptr0, outptr1;
   JSAMPROW inptr00, inptr01, inptr1, inptr2;
   JDIMENSION col;
+#ifdef JSIMD_ANY
+  JDIMENSION done;
+#endif
   /* copy these pointers into registers if possible */
   register JSAMPLE * range_limit = cinfo->sample_range_limit;
   int * Crrtab = upsample->Cr_r_tab;
@@ -309,8 +339,22 @@ h2v2_merged_upsample (j_decompress_ptr cinfo,
   inptr2 = input_buf[2][in_row_group_ctr];
   outptr0 = output_buf[0];
   outptr1 = output_buf[1];
+  col = cinfo->output_width >> 1;
+#ifdef JSIMD_ANY
+  if (upsample->h2v2_simd != NULL) {
+    done = (*upsample->h2v2_simd) (inptr00, inptr01, inptr1, inptr2,
+				   outptr0, outptr1, cinfo->output_width);
+    inptr00 += done;
+    inptr01 += done;
+    inptr1 += done >> 1;
+    inptr2 += done >> 1;
+    outptr0 += done * RGB_PIXELSIZE;
+    outptr1 += done * RGB_PIXELSIZE;
+    col -= done >> 1;
+  }
+#endif
   /* Loop for each group of output pixels */
-  for (col = cinfo->output_width >> 1; col > 0; col--) {
+  for (; col > 0; col--) {
     /* Do the chroma part of the calculation */
     cb = GETJSAMPLE(*inptr1++);
     cr = GETJSAMPLE(*inptr2++);
@@ -395,6 +439,29 @@ jinit_merged_upsampler (j_decompress_ptr cinfo)
   }
 
   build_ycc_rgb_table(cinfo);
+
+#ifdef JSIMD_ANY
+  /* The kernels write R,G,B triplets; the tables are still needed for the
+   * columns they leave over.
+   */
+  upsample->h2v1_simd = NULL;
+  upsample->h2v2_simd = NULL;
+  if (RGB_RED == 0 && RGB_GREEN == 1 && RGB_BLUE == 2 && RGB_PIXELSIZE == 3) {
+#ifdef JSIMD_X86
+    if (jsimd_cpu_features() & JSIMD_AVX2) {
+      upsample->h2v1_simd = jpeg_h2v1_merged_avx2;
+      upsample->h2v2_simd = jpeg_h2v2_merged_avx2;
+    } else if (jsimd_cpu_features() & JSIMD_SSE2) {
+      upsample->h2v1_simd = jpeg_h2v1_merged_sse2;
+      upsample->h2v2_simd = jpeg_h2v2_merged_sse2;
+    }
+#endif
+#ifdef JSIMD_WASM
+    upsample->h2v1_simd = jpeg_h2v1_merged_wasm;
+    upsample->h2v2_simd = jpeg_h2v2_merged_wasm;
+#endif
+  }
+#endif /* JSIMD_ANY */
 }
 
 #endif /* UPSAMPLE_MERGING_SUPPORTED */
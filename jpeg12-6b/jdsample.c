@@ -21,6 +21,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 /* Pointer to routine to upsample a single component */
@@ -56,6 +57,16 @@ typedef struct {
    */
   UINT8 h_expand[MAX_COMPONENTS];
   UINT8 v_expand[MAX_COMPONENTS];
+
+#ifdef JSIMD_ANY
+  /* SIMD kernels for the general case columns of the fancy upsamplers
+   * (see jsimd.h), or NULL if there are none for this machine.
+   */
+  JMETHOD(JDIMENSION, h2v1_fancy_simd, (JSAMPROW inptr, JSAMPROW outptr,
+					JDIMENSION num_cols));
+  JMETHOD(JDIMENSION, h2v2_fancy_simd, (JSAMPROW inptr0, JSAMPROW inptr1,
+					JSAMPROW outptr, JDIMENSION num_cols));
+#endif
 } my_upsampler;
 
 typedef my_upsampler * my_upsample_ptr;
@@ -304,6 +315,10 @@ METHODDEF(void)
 h2v1_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
 		     JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
 {
+#ifdef JSIMD_ANY
+  my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+  JDIMENSION done;
+#endif
   JSAMPARRAY output_data = *output_data_ptr;
   register JSAMPROW inptr, outptr;
   register int invalue;
@@ -318,7 +333,16 @@ h2v1_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
     *outptr++ = (JSAMPLE) invalue;
     *outptr++ = (JSAMPLE) ((invalue * 3 + GETJSAMPLE(*inptr) + 2) >> 2);
 
-    for (colctr = compptr->downsampled_width - 2; colctr > 0; colctr--) {
+    colctr = compptr->downsampled_width - 2;
+#ifdef JSIMD_ANY
+    if (upsample->h2v1_fancy_simd != NULL) {
+      done = (*upsample->h2v1_fancy_simd) (inptr, outptr, colctr);
+      inptr += done;
+      outptr += done * 2;
+      colctr -= done;
+    }
+#endif
+    for (; colctr > 0; colctr--) {
       /* General case: 3/4 * nearer pixel + 1/4 * further pixel */
       invalue = GETJSAMPLE(*inptr++) * 3;
       *outptr++ = (JSAMPLE) ((invalue + GETJSAMPLE(inptr[-2]) + 1) >> 2);
@@ -345,6 +369,10 @@ METHODDEF(void)
 h2v2_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
 		     JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
 {
+#ifdef JSIMD_ANY
+  my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+  JDIMENSION done;
+#endif
   JSAMPARRAY output_data = *output_data_ptr;
   register JSAMPROW inptr0, inptr1, outptr;
 #if BITS_IN_JSAMPLE == 8
@@ -373,7 +401,23 @@ h2v2_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
       *outptr++ = (JSAMPLE) ((thiscolsum * 3 + nextcolsum + 7) >> 4);
       lastcolsum = thiscolsum; thiscolsum = nextcolsum;
 
-      for (colctr = compptr->downsampled_width - 2; colctr > 0; colctr--) {
+      colctr = compptr->downsampled_width - 2;
+#ifdef JSIMD_ANY
+      if (upsample->h2v2_fancy_simd != NULL) {
+	/* The current column is the one before inptr0 */
+	done = (*upsample->h2v2_fancy_simd) (inptr0 - 1, inptr1 - 1, outptr,
+					     colctr);
+	if (done > 0) {
+	  inptr0 += done;
+	  inptr1 += done;
+	  outptr += done * 2;
+	  colctr -= done;
+	  lastcolsum = GETJSAMPLE(inptr0[-2]) * 3 + GETJSAMPLE(inptr1[-2]);
+	  thiscolsum = GETJSAMPLE(inptr0[-1]) * 3 + GETJSAMPLE(inptr1[-1]);
+	}
+      }
+#endif
+      for (; colctr > 0; colctr--) {
 	/* General case: 3/4 * nearer pixel + 1/4 * further pixel in each */
 	/* dimension, thus 9/16, 3/16, 3/16, 1/16 overall */
 	nextcolsum = GETJSAMPLE(*inptr0++) * 3 + GETJSAMPLE(*inptr1++);
@@ -420,6 +464,24 @@ jinit_upsampler (j_decompress_ptr cinfo)
    */
   do_fancy = cinfo->do_fancy_upsampling && cinfo->min_DCT_scaled_size > 1;
 
+#ifdef JSIMD_ANY
+  upsample->h2v1_fancy_simd = NULL;
+  upsample->h2v2_fancy_simd = NULL;
+#ifdef JSIMD_X86
+  if (jsimd_cpu_features() & JSIMD_AVX2) {
+    upsample->h2v1_fancy_simd = jpeg_h2v1_fancy_avx2;
+    upsample->h2v2_fancy_simd = jpeg_h2v2_fancy_avx2;
+  } else if (jsimd_cpu_features() & JSIMD_SSE2) {
+    upsample->h2v1_fancy_simd = jpeg_h2v1_fancy_sse2;
+    upsample->h2v2_fancy_simd = jpeg_h2v2_fancy_sse2;
+  }
+#endif
+#ifdef JSIMD_WASM
+  upsample->h2v1_fancy_simd = jpeg_h2v1_fancy_wasm;
+  upsample->h2v2_fancy_simd = jpeg_h2v2_fancy_wasm;
+#endif
+#endif /* JSIMD_ANY */
+
   /* Verify we can handle the sampling factors, select per-component methods,
    * and create storage as needed.
    */
@@ -0,0 +1,92 @@
+/*
+ * jdsamwasm.c
+ *
+ * This file contains WebAssembly SIMD128 versions of the "fancy" 2h1v and
+ * 2h2v upsamplers of jdsample.c, for 12-bit samples.  They are built when
+ * compiling with -msimd128, and are then always used by jdsample.c.
+ *
+ * The arithmetic is the same as in jdsamx86.c, eight input columns at a
+ * time, with the same calling conventions.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_WASM
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <wasm_simd128.h>
+
+
+/* Interleave the even and odd output samples of eight input columns */
+static INLINE void
+store_pairs (JSAMPROW outptr, v128_t even, v128_t odd)
+{
+  wasm_v128_store(outptr, wasm_i16x8_shuffle(even, odd, 0, 8, 1, 9,
+					     2, 10, 3, 11));
+  wasm_v128_store(outptr + 8, wasm_i16x8_shuffle(even, odd, 4, 12, 5, 13,
+						 6, 14, 7, 15));
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_h2v1_fancy_wasm (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols)
+{
+  const v128_t one = wasm_i16x8_splat(1);
+  const v128_t two = wasm_i16x8_splat(2);
+  JDIMENSION col;
+  v128_t prev, this3, next, even, odd;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    prev = wasm_v128_load(inptr + col - 1);
+    this3 = wasm_v128_load(inptr + col);
+    next = wasm_v128_load(inptr + col + 1);
+    this3 = wasm_i16x8_add(this3, wasm_i16x8_add(this3, this3));
+    even = wasm_i16x8_add(wasm_i16x8_add(this3, prev), one);
+    odd = wasm_i16x8_add(wasm_i16x8_add(this3, next), two);
+    store_pairs(outptr + col * 2, wasm_u16x8_shr(even, 2),
+		wasm_u16x8_shr(odd, 2));
+  }
+  return col;
+}
+
+
+/* 3 * nearer + further row, for eight columns */
+static INLINE v128_t
+colsum (const JSAMPLE * inptr0, const JSAMPLE * inptr1)
+{
+  v128_t t0 = wasm_v128_load(inptr0);
+
+  return wasm_i16x8_add(wasm_i16x8_add(t0, t0),
+			wasm_i16x8_add(t0, wasm_v128_load(inptr1)));
+}
+
+
+GLOBAL(JDIMENSION)
+jpeg_h2v2_fancy_wasm (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+		      JDIMENSION num_cols)
+{
+  const v128_t eight = wasm_i16x8_splat(8);
+  const v128_t seven = wasm_i16x8_splat(7);
+  JDIMENSION col;
+  v128_t last, this3, next, even, odd;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    last = colsum(inptr0 + col - 1, inptr1 + col - 1);
+    this3 = colsum(inptr0 + col, inptr1 + col);
+    next = colsum(inptr0 + col + 1, inptr1 + col + 1);
+    this3 = wasm_i16x8_add(this3, wasm_i16x8_add(this3, this3));
+    even = wasm_i16x8_add(wasm_i16x8_add(this3, last), eight);
+    odd = wasm_i16x8_add(wasm_i16x8_add(this3, next), seven);
+    store_pairs(outptr + col * 2, wasm_u16x8_shr(even, 4),
+		wasm_u16x8_shr(odd, 4));
+  }
+  return col;
+}
+
+#endif /* JSIMD_WASM */
@@ -0,0 +1,173 @@
+/*
+ * jdsamx86.c
+ *
+ * This file contains SSE2 and AVX2 versions of the "fancy" (triangle
+ * filter) 2h1v and 2h2v upsamplers of jdsample.c, for 12-bit samples.
+ * jdsample.c selects them at run time when the CPU supports the
+ * instruction set.
+ *
+ * The kernels do the general case columns only; the first and last
+ * columns are left to the C code.  With 12-bit samples every sum fits in
+ * 16 bits: at most 4*4095+2 for h2v1, and 4*(4*4095)+8 for h2v2 when
+ * treated as unsigned, so eight (SSE2) or sixteen (AVX2) input columns are
+ * done per step, giving exactly the same values as the C code.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <immintrin.h>
+
+
+/*
+ * For both kernels, inptr points to the first input column to be done,
+ * and num_cols columns may be done; the columns either side of them are
+ * read too.  Two output samples are stored per input column.  The number
+ * of columns done is returned.
+ */
+
+/*
+ * SSE2 implementation, eight input columns at a time.
+ */
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_h2v1_fancy_sse2 (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols)
+{
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i two = _mm_set1_epi16(2);
+  JDIMENSION col;
+  __m128i prev, this3, next, even, odd;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    prev = _mm_loadu_si128((const __m128i *) (inptr + col - 1));
+    this3 = _mm_loadu_si128((const __m128i *) (inptr + col));
+    next = _mm_loadu_si128((const __m128i *) (inptr + col + 1));
+    this3 = _mm_add_epi16(this3, _mm_add_epi16(this3, this3));
+    even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(this3, prev), one), 2);
+    odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(this3, next), two), 2);
+    _mm_storeu_si128((__m128i *) (outptr + col * 2),
+		     _mm_unpacklo_epi16(even, odd));
+    _mm_storeu_si128((__m128i *) (outptr + col * 2 + 8),
+		     _mm_unpackhi_epi16(even, odd));
+  }
+  return col;
+}
+
+
+/* 3 * nearer + further row, for eight columns */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+colsum_sse2 (const JSAMPLE * inptr0, const JSAMPLE * inptr1)
+{
+  __m128i t0 = _mm_loadu_si128((const __m128i *) inptr0);
+  __m128i t1 = _mm_loadu_si128((const __m128i *) inptr1);
+
+  return _mm_add_epi16(_mm_add_epi16(t0, t0), _mm_add_epi16(t0, t1));
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(JDIMENSION)
+jpeg_h2v2_fancy_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+		      JDIMENSION num_cols)
+{
+  const __m128i eight = _mm_set1_epi16(8);
+  const __m128i seven = _mm_set1_epi16(7);
+  JDIMENSION col;
+  __m128i last, this3, next, even, odd;
+
+  for (col = 0; col + 8 <= num_cols; col += 8) {
+    last = colsum_sse2(inptr0 + col - 1, inptr1 + col - 1);
+    this3 = colsum_sse2(inptr0 + col, inptr1 + col);
+    next = colsum_sse2(inptr0 + col + 1, inptr1 + col + 1);
+    this3 = _mm_add_epi16(this3, _mm_add_epi16(this3, this3));
+    even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(this3, last), eight), 4);
+    odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(this3, next), seven), 4);
+    _mm_storeu_si128((__m128i *) (outptr + col * 2),
+		     _mm_unpacklo_epi16(even, odd));
+    _mm_storeu_si128((__m128i *) (outptr + col * 2 + 8),
+		     _mm_unpackhi_epi16(even, odd));
+  }
+  return col;
+}
+
+
+/*
+ * AVX2 implementation, sixteen input columns at a time.  The unpacks work
+ * within 128-bit lanes, so the halves are put back in order when storing.
+ */
+
+JSIMD_TARGET_AVX2 static INLINE void
+store_pairs_avx2 (JSAMPROW outptr, __m256i even, __m256i odd)
+{
+  __m256i lo = _mm256_unpacklo_epi16(even, odd);
+  __m256i hi = _mm256_unpackhi_epi16(even, odd);
+
+  _mm256_storeu_si256((__m256i *) outptr,
+		      _mm256_permute2x128_si256(lo, hi, 0x20));
+  _mm256_storeu_si256((__m256i *) (outptr + 16),
+		      _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_h2v1_fancy_avx2 (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols)
+{
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i two = _mm256_set1_epi16(2);
+  JDIMENSION col;
+  __m256i prev, this3, next, even, odd;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    prev = _mm256_loadu_si256((const __m256i *) (inptr + col - 1));
+    this3 = _mm256_loadu_si256((const __m256i *) (inptr + col));
+    next = _mm256_loadu_si256((const __m256i *) (inptr + col + 1));
+    this3 = _mm256_add_epi16(this3, _mm256_add_epi16(this3, this3));
+    even = _mm256_add_epi16(_mm256_add_epi16(this3, prev), one);
+    odd = _mm256_add_epi16(_mm256_add_epi16(this3, next), two);
+    store_pairs_avx2(outptr + col * 2, _mm256_srli_epi16(even, 2),
+		     _mm256_srli_epi16(odd, 2));
+  }
+  return col;
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE __m256i
+colsum_avx2 (const JSAMPLE * inptr0, const JSAMPLE * inptr1)
+{
+  __m256i t0 = _mm256_loadu_si256((const __m256i *) inptr0);
+  __m256i t1 = _mm256_loadu_si256((const __m256i *) inptr1);
+
+  return _mm256_add_epi16(_mm256_add_epi16(t0, t0), _mm256_add_epi16(t0, t1));
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(JDIMENSION)
+jpeg_h2v2_fancy_avx2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+		      JDIMENSION num_cols)
+{
+  const __m256i eight = _mm256_set1_epi16(8);
+  const __m256i seven = _mm256_set1_epi16(7);
+  JDIMENSION col;
+  __m256i last, this3, next, even, odd;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    last = colsum_avx2(inptr0 + col - 1, inptr1 + col - 1);
+    this3 = colsum_avx2(inptr0 + col, inptr1 + col);
+    next = colsum_avx2(inptr0 + col + 1, inptr1 + col + 1);
+    this3 = _mm256_add_epi16(this3, _mm256_add_epi16(this3, this3));
+    even = _mm256_add_epi16(_mm256_add_epi16(this3, last), eight);
+    odd = _mm256_add_epi16(_mm256_add_epi16(this3, next), seven);
+    store_pairs_avx2(outptr + col * 2, _mm256_srli_epi16(even, 4),
+		     _mm256_srli_epi16(odd, 4));
+  }
+  return col;
+}
+
+#endif /* JSIMD_X86 */
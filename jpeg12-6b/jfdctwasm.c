@@ -0,0 +1,334 @@
+/*
+ * jfdctwasm.c
+ *
+ * This file contains the WebAssembly SIMD128 versions of the integer and
+ * floating-point forward DCTs and quantization of jfdctx86.c, for 12-bit
+ * samples.  It is built when compiling with -msimd128, and is then always
+ * used by jcdctmgr.c for JDCT_ISLOW and JDCT_FLOAT.
+ *
+ * The arithmetic is the same as in the SSE2 kernel, eight values held in
+ * two registers of four 32-bit lanes, with the 32x32 multiplies done
+ * natively.  The coefficients are bit-identical to those of the C code.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
+
+#ifdef JSIMD_WASM
+
+#if DCTSIZE != 8
+  Sorry, this code only copes with 8x8 DCTs. /* deliberate syntax err */
+#endif
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <wasm_simd128.h>
+
+
+/* Constants and scaling, same as jfdctint.c for 12-bit samples */
+
+#define CONST_BITS  13
+#define PASS1_BITS  1
+
+#define FIX_0_298631336  ((INT32)  2446)	/* FIX(0.298631336) */
+#define FIX_0_390180644  ((INT32)  3196)	/* FIX(0.390180644) */
+#define FIX_0_541196100  ((INT32)  4433)	/* FIX(0.541196100) */
+#define FIX_0_765366865  ((INT32)  6270)	/* FIX(0.765366865) */
+#define FIX_0_899976223  ((INT32)  7373)	/* FIX(0.899976223) */
+#define FIX_1_175875602  ((INT32)  9633)	/* FIX(1.175875602) */
+#define FIX_1_501321110  ((INT32)  12299)	/* FIX(1.501321110) */
+#define FIX_1_847759065  ((INT32)  15137)	/* FIX(1.847759065) */
+#define FIX_1_961570560  ((INT32)  16069)	/* FIX(1.961570560) */
+#define FIX_2_053119869  ((INT32)  16819)	/* FIX(2.053119869) */
+#define FIX_2_562915447  ((INT32)  20995)	/* FIX(2.562915447) */
+#define FIX_3_072711026  ((INT32)  25172)	/* FIX(3.072711026) */
+
+
+#define MULC(x,c)  wasm_i32x4_mul(x, wasm_i32x4_splat((int) (c)))
+
+/* DESCALE of jdct.h, an arithmetic shift with rounding */
+#define DESCALE4(x,n)  \
+  wasm_i32x4_shr(wasm_i32x4_add(x, wasm_i32x4_splat(1 << ((n)-1))), n)
+
+/* High 32 bits of an unsigned 32x32 multiply */
+static INLINE v128_t
+mulhi (v128_t a, v128_t b)
+{
+  return wasm_i32x4_shuffle(wasm_u64x2_extmul_low_u32x4(a, b),
+			    wasm_u64x2_extmul_high_u32x4(a, b), 1, 3, 5, 7);
+}
+
+
+/* One 1-D pass of the LL&M FDCT over four lanes, in place */
+static INLINE void
+islow_1d (v128_t * d, int pass)
+{
+  v128_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  v128_t tmp10, tmp11, tmp12, tmp13;
+  v128_t z1, z2, z3, z4, z5;
+
+  tmp0 = wasm_i32x4_add(d[0], d[7]);
+  tmp7 = wasm_i32x4_sub(d[0], d[7]);
+  tmp1 = wasm_i32x4_add(d[1], d[6]);
+  tmp6 = wasm_i32x4_sub(d[1], d[6]);
+  tmp2 = wasm_i32x4_add(d[2], d[5]);
+  tmp5 = wasm_i32x4_sub(d[2], d[5]);
+  tmp3 = wasm_i32x4_add(d[3], d[4]);
+  tmp4 = wasm_i32x4_sub(d[3], d[4]);
+
+  /* Even part */
+  tmp10 = wasm_i32x4_add(tmp0, tmp3);
+  tmp13 = wasm_i32x4_sub(tmp0, tmp3);
+  tmp11 = wasm_i32x4_add(tmp1, tmp2);
+  tmp12 = wasm_i32x4_sub(tmp1, tmp2);
+
+  z1 = MULC(wasm_i32x4_add(tmp12, tmp13), FIX_0_541196100);
+  tmp12 = wasm_i32x4_add(z1, MULC(tmp12, - FIX_1_847759065));
+  tmp13 = wasm_i32x4_add(z1, MULC(tmp13, FIX_0_765366865));
+
+  if (pass == 1) {
+    d[0] = wasm_i32x4_shl(wasm_i32x4_add(tmp10, tmp11), PASS1_BITS);
+    d[4] = wasm_i32x4_shl(wasm_i32x4_sub(tmp10, tmp11), PASS1_BITS);
+    d[2] = DESCALE4(tmp13, CONST_BITS-PASS1_BITS);
+    d[6] = DESCALE4(tmp12, CONST_BITS-PASS1_BITS);
+  } else {
+    d[0] = DESCALE4(wasm_i32x4_add(tmp10, tmp11), PASS1_BITS);
+    d[4] = DESCALE4(wasm_i32x4_sub(tmp10, tmp11), PASS1_BITS);
+    d[2] = DESCALE4(tmp13, CONST_BITS+PASS1_BITS);
+    d[6] = DESCALE4(tmp12, CONST_BITS+PASS1_BITS);
+  }
+
+  /* Odd part */
+  z1 = wasm_i32x4_add(tmp4, tmp7);
+  z2 = wasm_i32x4_add(tmp5, tmp6);
+  z3 = wasm_i32x4_add(tmp4, tmp6);
+  z4 = wasm_i32x4_add(tmp5, tmp7);
+  z5 = MULC(wasm_i32x4_add(z3, z4), FIX_1_175875602);
+
+  tmp4 = MULC(tmp4, FIX_0_298631336);
+  tmp5 = MULC(tmp5, FIX_2_053119869);
+  tmp6 = MULC(tmp6, FIX_3_072711026);
+  tmp7 = MULC(tmp7, FIX_1_501321110);
+  z1 = MULC(z1, - FIX_0_899976223);
+  z2 = MULC(z2, - FIX_2_562915447);
+  z3 = wasm_i32x4_add(MULC(z3, - FIX_1_961570560), z5);
+  z4 = wasm_i32x4_add(MULC(z4, - FIX_0_390180644), z5);
+
+  tmp4 = wasm_i32x4_add(tmp4, wasm_i32x4_add(z1, z3));
+  tmp5 = wasm_i32x4_add(tmp5, wasm_i32x4_add(z2, z4));
+  tmp6 = wasm_i32x4_add(tmp6, wasm_i32x4_add(z2, z3));
+  tmp7 = wasm_i32x4_add(tmp7, wasm_i32x4_add(z1, z4));
+
+  if (pass == 1) {
+    d[7] = DESCALE4(tmp4, CONST_BITS-PASS1_BITS);
+    d[5] = DESCALE4(tmp5, CONST_BITS-PASS1_BITS);
+    d[3] = DESCALE4(tmp6, CONST_BITS-PASS1_BITS);
+    d[1] = DESCALE4(tmp7, CONST_BITS-PASS1_BITS);
+  } else {
+    d[7] = DESCALE4(tmp4, CONST_BITS+PASS1_BITS);
+    d[5] = DESCALE4(tmp5, CONST_BITS+PASS1_BITS);
+    d[3] = DESCALE4(tmp6, CONST_BITS+PASS1_BITS);
+    d[1] = DESCALE4(tmp7, CONST_BITS+PASS1_BITS);
+  }
+}
+
+
+/* Transpose a 4x4 block of 32-bit values held in a, b, c, d */
+#define TRANSPOSE4(a,b,c,d)  \
+  { v128_t t0 = wasm_i32x4_shuffle(a, b, 0, 4, 1, 5); \
+    v128_t t1 = wasm_i32x4_shuffle(a, b, 2, 6, 3, 7); \
+    v128_t t2 = wasm_i32x4_shuffle(c, d, 0, 4, 1, 5); \
+    v128_t t3 = wasm_i32x4_shuffle(c, d, 2, 6, 3, 7); \
+    a = wasm_i64x2_shuffle(t0, t2, 0, 2); b = wasm_i64x2_shuffle(t0, t2, 1, 3); \
+    c = wasm_i64x2_shuffle(t1, t3, 0, 2); d = wasm_i64x2_shuffle(t1, t3, 1, 3); }
+
+/* Transpose an 8x8 block of 32-bit values.  lo[r] holds columns 0-3 of
+ * row r and hi[r] columns 4-7; the result has the same layout.
+ */
+static INLINE void
+transpose8x8 (v128_t * lo, v128_t * hi)
+{
+  v128_t t;
+  int i;
+
+  TRANSPOSE4(lo[0], lo[1], lo[2], lo[3]);
+  TRANSPOSE4(hi[0], hi[1], hi[2], hi[3]);
+  TRANSPOSE4(lo[4], lo[5], lo[6], lo[7]);
+  TRANSPOSE4(hi[4], hi[5], hi[6], hi[7]);
+  /* Swap the off-diagonal blocks */
+  for (i = 0; i < 4; i++) {
+    t = hi[i];
+    hi[i] = lo[i + 4];
+    lo[i + 4] = t;
+  }
+}
+
+
+/* Quantize four coefficients, with the entries at offset i of recip */
+static INLINE v128_t
+quantize (v128_t x, const unsigned int * recip, int i)
+{
+  v128_t q = wasm_i32x4_abs(x);
+
+  q = wasm_i32x4_add(q, wasm_v128_load(recip + i));
+  q = mulhi(q, wasm_v128_load(recip + DCTSIZE2 + i));
+  q = mulhi(q, wasm_v128_load(recip + 2 * DCTSIZE2 + i));
+  /* Restore the sign of x */
+  return wasm_v128_bitselect(wasm_i32x4_neg(q), q, wasm_i32x4_shr(x, 31));
+}
+
+
+GLOBAL(void)
+jpeg_fdct_islow_quant_wasm (JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+			    JDIMENSION start_col, JDIMENSION num_blocks,
+			    const unsigned int * recip)
+{
+  v128_t lo[8], hi[8];
+  const v128_t center = wasm_i32x4_splat(CENTERJSAMPLE);
+  JCOEFPTR output_ptr;
+  int i;
+
+  for (; num_blocks > 0; num_blocks--, coef_blocks++, start_col += DCTSIZE) {
+    /* Load the samples, applying unsigned->signed conversion */
+    for (i = 0; i < 8; i++) {
+      v128_t s = wasm_v128_load(sample_data[i] + start_col);
+      lo[i] = wasm_i32x4_sub(wasm_i32x4_extend_low_i16x8(s), center);
+      hi[i] = wasm_i32x4_sub(wasm_i32x4_extend_high_i16x8(s), center);
+    }
+
+    /* Pass 1: process rows. */
+    transpose8x8(lo, hi);
+    islow_1d(lo, 1);
+    islow_1d(hi, 1);
+
+    /* Pass 2: process columns, back in row layout. */
+    transpose8x8(lo, hi);
+    islow_1d(lo, 2);
+    islow_1d(hi, 2);
+
+    /* Quantize and store the coefficients */
+    output_ptr = (JCOEFPTR) (*coef_blocks);
+    for (i = 0; i < 8; i++)
+      wasm_v128_store(output_ptr + DCTSIZE * i,
+		      wasm_i16x8_narrow_i32x4(quantize(lo[i], recip, DCTSIZE * i),
+					      quantize(hi[i], recip,
+						       DCTSIZE * i + 4)));
+  }
+}
+
+
+/*
+ * The floating-point FDCT and the quantization of forward_DCT_float.
+ * WebAssembly arithmetic is IEEE single precision without contraction,
+ * like the C code as compiled for it, so the coefficients are the same.
+ */
+
+#define MULF(x,c)  wasm_f32x4_mul(x, wasm_f32x4_splat((float) (c)))
+
+/* One 1-D pass of the AA&N float FDCT over four lanes, in place */
+static INLINE void
+float_1d (v128_t * d)
+{
+  v128_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  v128_t tmp10, tmp11, tmp12, tmp13;
+  v128_t z1, z2, z3, z4, z5, z11, z13;
+
+  tmp0 = wasm_f32x4_add(d[0], d[7]);
+  tmp7 = wasm_f32x4_sub(d[0], d[7]);
+  tmp1 = wasm_f32x4_add(d[1], d[6]);
+  tmp6 = wasm_f32x4_sub(d[1], d[6]);
+  tmp2 = wasm_f32x4_add(d[2], d[5]);
+  tmp5 = wasm_f32x4_sub(d[2], d[5]);
+  tmp3 = wasm_f32x4_add(d[3], d[4]);
+  tmp4 = wasm_f32x4_sub(d[3], d[4]);
+
+  /* Even part */
+  tmp10 = wasm_f32x4_add(tmp0, tmp3);
+  tmp13 = wasm_f32x4_sub(tmp0, tmp3);
+  tmp11 = wasm_f32x4_add(tmp1, tmp2);
+  tmp12 = wasm_f32x4_sub(tmp1, tmp2);
+
+  d[0] = wasm_f32x4_add(tmp10, tmp11);
+  d[4] = wasm_f32x4_sub(tmp10, tmp11);
+
+  z1 = MULF(wasm_f32x4_add(tmp12, tmp13), 0.707106781);
+  d[2] = wasm_f32x4_add(tmp13, z1);
+  d[6] = wasm_f32x4_sub(tmp13, z1);
+
+  /* Odd part */
+  tmp10 = wasm_f32x4_add(tmp4, tmp5);
+  tmp11 = wasm_f32x4_add(tmp5, tmp6);
+  tmp12 = wasm_f32x4_add(tmp6, tmp7);
+
+  z5 = MULF(wasm_f32x4_sub(tmp10, tmp12), 0.382683433);
+  z2 = wasm_f32x4_add(MULF(tmp10, 0.541196100), z5);
+  z4 = wasm_f32x4_add(MULF(tmp12, 1.306562965), z5);
+  z3 = MULF(tmp11, 0.707106781);
+
+  z11 = wasm_f32x4_add(tmp7, z3);
+  z13 = wasm_f32x4_sub(tmp7, z3);
+
+  d[5] = wasm_f32x4_add(z13, z2);
+  d[3] = wasm_f32x4_sub(z13, z2);
+  d[1] = wasm_f32x4_add(z11, z4);
+  d[7] = wasm_f32x4_sub(z11, z4);
+}
+
+
+/* Quantize four coefficients as forward_DCT_float does */
+static INLINE v128_t
+quantize_float (v128_t x, const FAST_FLOAT * divisors)
+{
+  x = wasm_f32x4_add(wasm_f32x4_mul(x, wasm_v128_load(divisors)),
+		     wasm_f32x4_splat((float) 16384.5));
+  return wasm_i32x4_sub(wasm_i32x4_trunc_sat_f32x4(x),
+			wasm_i32x4_splat(16384));
+}
+
+
+GLOBAL(void)
+jpeg_fdct_float_quant_wasm (JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+			    JDIMENSION start_col, JDIMENSION num_blocks,
+			    const FAST_FLOAT * divisors)
+{
+  v128_t lo[8], hi[8];
+  const v128_t center = wasm_i32x4_splat(CENTERJSAMPLE);
+  JCOEFPTR output_ptr;
+  int i;
+
+  for (; num_blocks > 0; num_blocks--, coef_blocks++, start_col += DCTSIZE) {
+    /* Load the samples, applying unsigned->signed conversion */
+    for (i = 0; i < 8; i++) {
+      v128_t s = wasm_v128_load(sample_data[i] + start_col);
+      lo[i] = wasm_f32x4_convert_i32x4(
+	wasm_i32x4_sub(wasm_i32x4_extend_low_i16x8(s), center));
+      hi[i] = wasm_f32x4_convert_i32x4(
+	wasm_i32x4_sub(wasm_i32x4_extend_high_i16x8(s), center));
+    }
+
+    /* Pass 1: process rows. */
+    transpose8x8(lo, hi);
+    float_1d(lo);
+    float_1d(hi);
+
+    /* Pass 2: process columns, back in row layout. */
+    transpose8x8(lo, hi);
+    float_1d(lo);
+    float_1d(hi);
+
+    /* Quantize and store the coefficients */
+    output_ptr = (JCOEFPTR) (*coef_blocks);
+    for (i = 0; i < 8; i++)
+      wasm_v128_store(output_ptr + DCTSIZE * i,
+		      wasm_i16x8_narrow_i32x4(
+			quantize_float(lo[i], divisors + DCTSIZE * i),
+			quantize_float(hi[i], divisors + DCTSIZE * i + 4)));
+  }
+}
+
+#endif /* JSIMD_WASM */
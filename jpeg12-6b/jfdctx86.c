@@ -0,0 +1,711 @@
+/*
+ * jfdctx86.c
+ *
+ * This file contains SSE2 and AVX2 versions of the slow-but-accurate
+ * integer forward DCT (jfdctint.c) and of the floating-point forward DCT
+ * (jfdctflt.c), each combined with the quantization step of forward_DCT
+ * or forward_DCT_float in jcdctmgr.c, for 12-bit samples.  jcdctmgr.c
+ * selects them at run time when the CPU supports the instruction set.
+ * Each call does a whole row of blocks, with the constants kept in
+ * registers.
+ *
+ * The DCT performs the same arithmetic as the C code, in the same order,
+ * on all eight rows (then all eight columns) at once.  The integer DCT
+ * keeps every intermediate in 32-bit lanes, and the divisions of its
+ * quantization are replaced by the exact reciprocal multiplications
+ * described in jsimd.h, so the coefficients are bit-identical to those of
+ * the C code.  The float DCT is discussed with its kernels below.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#if DCTSIZE != 8
+  Sorry, this code only copes with 8x8 DCTs. /* deliberate syntax err */
+#endif
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <immintrin.h>
+
+
+/* Constants and scaling, same as jfdctint.c for 12-bit samples */
+
+#define CONST_BITS  13
+#define PASS1_BITS  1
+
+#define FIX_0_298631336  ((INT32)  2446)	/* FIX(0.298631336) */
+#define FIX_0_390180644  ((INT32)  3196)	/* FIX(0.390180644) */
+#define FIX_0_541196100  ((INT32)  4433)	/* FIX(0.541196100) */
+#define FIX_0_765366865  ((INT32)  6270)	/* FIX(0.765366865) */
+#define FIX_0_899976223  ((INT32)  7373)	/* FIX(0.899976223) */
+#define FIX_1_175875602  ((INT32)  9633)	/* FIX(1.175875602) */
+#define FIX_1_501321110  ((INT32)  12299)	/* FIX(1.501321110) */
+#define FIX_1_847759065  ((INT32)  15137)	/* FIX(1.847759065) */
+#define FIX_1_961570560  ((INT32)  16069)	/* FIX(1.961570560) */
+#define FIX_2_053119869  ((INT32)  16819)	/* FIX(2.053119869) */
+#define FIX_2_562915447  ((INT32)  20995)	/* FIX(2.562915447) */
+#define FIX_3_072711026  ((INT32)  25172)	/* FIX(3.072711026) */
+
+
+/*
+ * SSE2 helpers.  Eight values are held in two registers of four lanes.
+ */
+
+/* Low 32 bits of a 32x32 multiply; SSE2 only has the unsigned 32x32->64
+ * form, which gives the right low half for signed inputs too.
+ */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+mullo_sse2 (__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+			    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+/* High 32 bits of an unsigned 32x32 multiply */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+mulhi_sse2 (__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(3,1,3,1)),
+			    _mm_shuffle_epi32(odd, _MM_SHUFFLE(3,1,3,1)));
+}
+
+#define MULC_SSE2(x,c)  mullo_sse2(x, _mm_set1_epi32((int) (c)))
+
+/* DESCALE of jdct.h, an arithmetic shift with rounding */
+#define DESCALE_SSE2(x,n)  \
+  _mm_srai_epi32(_mm_add_epi32(x, _mm_set1_epi32(1 << ((n)-1))), n)
+
+/* One 1-D pass of the LL&M FDCT over four lanes, in place.
+ * d[0..7] hold the inputs in natural order.  Pass 1 scales the outputs up
+ * by PASS1_BITS, pass 2 removes that scaling, as in jpeg_fdct_islow.
+ */
+JSIMD_TARGET_SSE2 static INLINE void
+islow_1d_sse2 (__m128i * d, int pass)
+{
+  __m128i tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  __m128i tmp10, tmp11, tmp12, tmp13;
+  __m128i z1, z2, z3, z4, z5;
+
+  tmp0 = _mm_add_epi32(d[0], d[7]);
+  tmp7 = _mm_sub_epi32(d[0], d[7]);
+  tmp1 = _mm_add_epi32(d[1], d[6]);
+  tmp6 = _mm_sub_epi32(d[1], d[6]);
+  tmp2 = _mm_add_epi32(d[2], d[5]);
+  tmp5 = _mm_sub_epi32(d[2], d[5]);
+  tmp3 = _mm_add_epi32(d[3], d[4]);
+  tmp4 = _mm_sub_epi32(d[3], d[4]);
+
+  /* Even part */
+  tmp10 = _mm_add_epi32(tmp0, tmp3);
+  tmp13 = _mm_sub_epi32(tmp0, tmp3);
+  tmp11 = _mm_add_epi32(tmp1, tmp2);
+  tmp12 = _mm_sub_epi32(tmp1, tmp2);
+
+  z1 = MULC_SSE2(_mm_add_epi32(tmp12, tmp13), FIX_0_541196100);
+  tmp12 = _mm_add_epi32(z1, MULC_SSE2(tmp12, - FIX_1_847759065));
+  tmp13 = _mm_add_epi32(z1, MULC_SSE2(tmp13, FIX_0_765366865));
+
+  if (pass == 1) {
+    d[0] = _mm_slli_epi32(_mm_add_epi32(tmp10, tmp11), PASS1_BITS);
+    d[4] = _mm_slli_epi32(_mm_sub_epi32(tmp10, tmp11), PASS1_BITS);
+    d[2] = DESCALE_SSE2(tmp13, CONST_BITS-PASS1_BITS);
+    d[6] = DESCALE_SSE2(tmp12, CONST_BITS-PASS1_BITS);
+  } else {
+    d[0] = DESCALE_SSE2(_mm_add_epi32(tmp10, tmp11), PASS1_BITS);
+    d[4] = DESCALE_SSE2(_mm_sub_epi32(tmp10, tmp11), PASS1_BITS);
+    d[2] = DESCALE_SSE2(tmp13, CONST_BITS+PASS1_BITS);
+    d[6] = DESCALE_SSE2(tmp12, CONST_BITS+PASS1_BITS);
+  }
+
+  /* Odd part */
+  z1 = _mm_add_epi32(tmp4, tmp7);
+  z2 = _mm_add_epi32(tmp5, tmp6);
+  z3 = _mm_add_epi32(tmp4, tmp6);
+  z4 = _mm_add_epi32(tmp5, tmp7);
+  z5 = MULC_SSE2(_mm_add_epi32(z3, z4), FIX_1_175875602);
+
+  tmp4 = MULC_SSE2(tmp4, FIX_0_298631336);
+  tmp5 = MULC_SSE2(tmp5, FIX_2_053119869);
+  tmp6 = MULC_SSE2(tmp6, FIX_3_072711026);
+  tmp7 = MULC_SSE2(tmp7, FIX_1_501321110);
+  z1 = MULC_SSE2(z1, - FIX_0_899976223);
+  z2 = MULC_SSE2(z2, - FIX_2_562915447);
+  z3 = _mm_add_epi32(MULC_SSE2(z3, - FIX_1_961570560), z5);
+  z4 = _mm_add_epi32(MULC_SSE2(z4, - FIX_0_390180644), z5);
+
+  tmp4 = _mm_add_epi32(tmp4, _mm_add_epi32(z1, z3));
+  tmp5 = _mm_add_epi32(tmp5, _mm_add_epi32(z2, z4));
+  tmp6 = _mm_add_epi32(tmp6, _mm_add_epi32(z2, z3));
+  tmp7 = _mm_add_epi32(tmp7, _mm_add_epi32(z1, z4));
+
+  if (pass == 1) {
+    d[7] = DESCALE_SSE2(tmp4, CONST_BITS-PASS1_BITS);
+    d[5] = DESCALE_SSE2(tmp5, CONST_BITS-PASS1_BITS);
+    d[3] = DESCALE_SSE2(tmp6, CONST_BITS-PASS1_BITS);
+    d[1] = DESCALE_SSE2(tmp7, CONST_BITS-PASS1_BITS);
+  } else {
+    d[7] = DESCALE_SSE2(tmp4, CONST_BITS+PASS1_BITS);
+    d[5] = DESCALE_SSE2(tmp5, CONST_BITS+PASS1_BITS);
+    d[3] = DESCALE_SSE2(tmp6, CONST_BITS+PASS1_BITS);
+    d[1] = DESCALE_SSE2(tmp7, CONST_BITS+PASS1_BITS);
+  }
+}
+
+/* Transpose a 4x4 block of 32-bit values held in a, b, c, d */
+#define TRANSPOSE4_SSE2(a,b,c,d)  \
+  { __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpackhi_epi32(a, b); \
+    __m128i t2 = _mm_unpacklo_epi32(c, d), t3 = _mm_unpackhi_epi32(c, d); \
+    a = _mm_unpacklo_epi64(t0, t2); b = _mm_unpackhi_epi64(t0, t2); \
+    c = _mm_unpacklo_epi64(t1, t3); d = _mm_unpackhi_epi64(t1, t3); }
+
+/* Transpose an 8x8 block of 32-bit values.  lo[r] holds columns 0-3 of
+ * row r and hi[r] columns 4-7; the result has the same layout.
+ */
+JSIMD_TARGET_SSE2 static INLINE void
+transpose8x8_sse2 (__m128i * lo, __m128i * hi)
+{
+  __m128i t;
+  int i;
+
+  TRANSPOSE4_SSE2(lo[0], lo[1], lo[2], lo[3]);
+  TRANSPOSE4_SSE2(hi[0], hi[1], hi[2], hi[3]);
+  TRANSPOSE4_SSE2(lo[4], lo[5], lo[6], lo[7]);
+  TRANSPOSE4_SSE2(hi[4], hi[5], hi[6], hi[7]);
+  /* Swap the off-diagonal blocks */
+  for (i = 0; i < 4; i++) {
+    t = hi[i];
+    hi[i] = lo[i + 4];
+    lo[i + 4] = t;
+  }
+}
+
+/* Quantize four coefficients, with the entries at offset i of recip */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+quantize_sse2 (__m128i x, const unsigned int * recip, int i)
+{
+  __m128i sign = _mm_srai_epi32(x, 31);
+  __m128i q = _mm_sub_epi32(_mm_xor_si128(x, sign), sign);
+
+  q = _mm_add_epi32(q, _mm_loadu_si128((const __m128i *) (recip + i)));
+  q = mulhi_sse2(q, _mm_loadu_si128((const __m128i *)
+				     (recip + DCTSIZE2 + i)));
+  q = mulhi_sse2(q, _mm_loadu_si128((const __m128i *)
+				     (recip + 2 * DCTSIZE2 + i)));
+  return _mm_sub_epi32(_mm_xor_si128(q, sign), sign);
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(void)
+jpeg_fdct_islow_quant_sse2 (JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+			    JDIMENSION start_col, JDIMENSION num_blocks,
+			    const unsigned int * recip)
+{
+  __m128i lo[8], hi[8];
+  __m128i center = _mm_set1_epi32(CENTERJSAMPLE);
+  JCOEFPTR output_ptr;
+  int i;
+
+  for (; num_blocks > 0; num_blocks--, coef_blocks++, start_col += DCTSIZE) {
+    /* Load the samples, applying unsigned->signed conversion */
+    for (i = 0; i < 8; i++) {
+      __m128i s = _mm_loadu_si128((const __m128i *)
+				  (sample_data[i] + start_col));
+      lo[i] = _mm_sub_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16),
+			    center);
+      hi[i] = _mm_sub_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16),
+			    center);
+    }
+
+    /* Pass 1: process rows.  After the transpose lo[c] holds column c of
+     * rows 0-3 and hi[c] of rows 4-7.
+     */
+    transpose8x8_sse2(lo, hi);
+    islow_1d_sse2(lo, 1);
+    islow_1d_sse2(hi, 1);
+
+    /* Pass 2: process columns, back in row layout. */
+    transpose8x8_sse2(lo, hi);
+    islow_1d_sse2(lo, 2);
+    islow_1d_sse2(hi, 2);
+
+    /* Quantize and store the coefficients */
+    output_ptr = (JCOEFPTR) (*coef_blocks);
+    for (i = 0; i < 8; i++)
+      _mm_storeu_si128((__m128i *) (output_ptr + DCTSIZE * i),
+		       _mm_packs_epi32(quantize_sse2(lo[i], recip, DCTSIZE * i),
+				       quantize_sse2(hi[i], recip,
+						     DCTSIZE * i + 4)));
+  }
+}
+
+
+/*
+ * The floating-point FDCT, SSE2 version.  The operations are those of
+ * jpeg_fdct_float and forward_DCT_float, in the same order and in single
+ * precision without contraction, and the final (int) cast truncates as
+ * cvttps does.  So on x86-64, where the C code uses the same scalar SSE
+ * arithmetic, the coefficients match it exactly, unless the C code is
+ * built for a CPU with FMA and the compiler fuses its multiplies and adds.
+ */
+
+/* One 1-D pass of the AA&N float FDCT over four lanes, in place */
+JSIMD_TARGET_SSE2 static INLINE void
+float_1d_sse2 (__m128 * d)
+{
+  __m128 tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  __m128 tmp10, tmp11, tmp12, tmp13;
+  __m128 z1, z2, z3, z4, z5, z11, z13;
+
+  tmp0 = _mm_add_ps(d[0], d[7]);
+  tmp7 = _mm_sub_ps(d[0], d[7]);
+  tmp1 = _mm_add_ps(d[1], d[6]);
+  tmp6 = _mm_sub_ps(d[1], d[6]);
+  tmp2 = _mm_add_ps(d[2], d[5]);
+  tmp5 = _mm_sub_ps(d[2], d[5]);
+  tmp3 = _mm_add_ps(d[3], d[4]);
+  tmp4 = _mm_sub_ps(d[3], d[4]);
+
+  /* Even part */
+  tmp10 = _mm_add_ps(tmp0, tmp3);
+  tmp13 = _mm_sub_ps(tmp0, tmp3);
+  tmp11 = _mm_add_ps(tmp1, tmp2);
+  tmp12 = _mm_sub_ps(tmp1, tmp2);
+
+  d[0] = _mm_add_ps(tmp10, tmp11);
+  d[4] = _mm_sub_ps(tmp10, tmp11);
+
+  z1 = _mm_mul_ps(_mm_add_ps(tmp12, tmp13), _mm_set1_ps((float) 0.707106781));
+  d[2] = _mm_add_ps(tmp13, z1);
+  d[6] = _mm_sub_ps(tmp13, z1);
+
+  /* Odd part */
+  tmp10 = _mm_add_ps(tmp4, tmp5);
+  tmp11 = _mm_add_ps(tmp5, tmp6);
+  tmp12 = _mm_add_ps(tmp6, tmp7);
+
+  z5 = _mm_mul_ps(_mm_sub_ps(tmp10, tmp12), _mm_set1_ps((float) 0.382683433));
+  z2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps((float) 0.541196100), tmp10), z5);
+  z4 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps((float) 1.306562965), tmp12), z5);
+  z3 = _mm_mul_ps(tmp11, _mm_set1_ps((float) 0.707106781));
+
+  z11 = _mm_add_ps(tmp7, z3);
+  z13 = _mm_sub_ps(tmp7, z3);
+
+  d[5] = _mm_add_ps(z13, z2);
+  d[3] = _mm_sub_ps(z13, z2);
+  d[1] = _mm_add_ps(z11, z4);
+  d[7] = _mm_sub_ps(z11, z4);
+}
+
+/* Transpose a 4x4 block of floats held in a, b, c, d */
+#define TRANSPOSE4_PS_SSE2(a,b,c,d)  \
+  { __m128 t0 = _mm_unpacklo_ps(a, b), t1 = _mm_unpackhi_ps(a, b); \
+    __m128 t2 = _mm_unpacklo_ps(c, d), t3 = _mm_unpackhi_ps(c, d); \
+    a = _mm_movelh_ps(t0, t2); b = _mm_movehl_ps(t2, t0); \
+    c = _mm_movelh_ps(t1, t3); d = _mm_movehl_ps(t3, t1); }
+
+/* Transpose an 8x8 block of floats, laid out as in transpose8x8_sse2 */
+JSIMD_TARGET_SSE2 static INLINE void
+transpose8x8_ps_sse2 (__m128 * lo, __m128 * hi)
+{
+  __m128 x0, x1, x2, x3;
+
+  /* The off-diagonal blocks trade places as they are transposed, written
+   * out so that the compiler can keep everything in registers.
+   */
+  TRANSPOSE4_PS_SSE2(lo[0], lo[1], lo[2], lo[3]);
+  TRANSPOSE4_PS_SSE2(hi[4], hi[5], hi[6], hi[7]);
+  x0 = hi[0]; x1 = hi[1]; x2 = hi[2]; x3 = hi[3];
+  hi[0] = lo[4]; hi[1] = lo[5]; hi[2] = lo[6]; hi[3] = lo[7];
+  TRANSPOSE4_PS_SSE2(hi[0], hi[1], hi[2], hi[3]);
+  TRANSPOSE4_PS_SSE2(x0, x1, x2, x3);
+  lo[4] = x0; lo[5] = x1; lo[6] = x2; lo[7] = x3;
+}
+
+/* Quantize four coefficients as forward_DCT_float does */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+quantize_float_sse2 (__m128 x, const FAST_FLOAT * divisors)
+{
+  x = _mm_add_ps(_mm_mul_ps(x, _mm_loadu_ps(divisors)),
+		 _mm_set1_ps((float) 16384.5));
+  return _mm_sub_epi32(_mm_cvttps_epi32(x), _mm_set1_epi32(16384));
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(void)
+jpeg_fdct_float_quant_sse2 (JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+			    JDIMENSION start_col, JDIMENSION num_blocks,
+			    const FAST_FLOAT * divisors)
+{
+  __m128 flo[8], fhi[8];
+  __m128i center = _mm_set1_epi32(CENTERJSAMPLE);
+  JCOEFPTR output_ptr;
+  int i;
+
+  for (; num_blocks > 0; num_blocks--, coef_blocks++, start_col += DCTSIZE) {
+    /* Load the samples, applying unsigned->signed conversion */
+    for (i = 0; i < 8; i++) {
+      __m128i s = _mm_loadu_si128((const __m128i *)
+				  (sample_data[i] + start_col));
+      flo[i] = _mm_cvtepi32_ps(
+	_mm_sub_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16), center));
+      fhi[i] = _mm_cvtepi32_ps(
+	_mm_sub_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16), center));
+    }
+
+    /* Pass 1: process rows. */
+    transpose8x8_ps_sse2(flo, fhi);
+    float_1d_sse2(flo);
+    float_1d_sse2(fhi);
+
+    /* Pass 2: process columns, back in row layout. */
+    transpose8x8_ps_sse2(flo, fhi);
+    float_1d_sse2(flo);
+    float_1d_sse2(fhi);
+
+    /* Quantize and store the coefficients */
+    output_ptr = (JCOEFPTR) (*coef_blocks);
+    for (i = 0; i < 8; i++) {
+      const FAST_FLOAT * divptr = divisors + DCTSIZE * i;
+
+      _mm_storeu_si128((__m128i *) (output_ptr + DCTSIZE * i),
+		       _mm_packs_epi32(quantize_float_sse2(flo[i], divptr),
+				       quantize_float_sse2(fhi[i],
+							   divptr + 4)));
+    }
+  }
+}
+
+
+/*
+ * AVX2 version.  Eight values fit in one register.
+ */
+
+#define MULC_AVX2(x,c)  _mm256_mullo_epi32(x, _mm256_set1_epi32((int) (c)))
+
+#define DESCALE_AVX2(x,n)  \
+  _mm256_srai_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(1 << ((n)-1))), n)
+
+/* High 32 bits of an unsigned 32x32 multiply */
+JSIMD_TARGET_AVX2 static INLINE __m256i
+mulhi_avx2 (__m256i a, __m256i b)
+{
+  __m256i even = _mm256_mul_epu32(a, b);
+  __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32),
+				 _mm256_srli_epi64(b, 32));
+  return _mm256_unpacklo_epi32(_mm256_shuffle_epi32(even, _MM_SHUFFLE(3,1,3,1)),
+			       _mm256_shuffle_epi32(odd, _MM_SHUFFLE(3,1,3,1)));
+}
+
+JSIMD_TARGET_AVX2 static INLINE void
+islow_1d_avx2 (__m256i * d, int pass)
+{
+  __m256i tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  __m256i tmp10, tmp11, tmp12, tmp13;
+  __m256i z1, z2, z3, z4, z5;
+
+  tmp0 = _mm256_add_epi32(d[0], d[7]);
+  tmp7 = _mm256_sub_epi32(d[0], d[7]);
+  tmp1 = _mm256_add_epi32(d[1], d[6]);
+  tmp6 = _mm256_sub_epi32(d[1], d[6]);
+  tmp2 = _mm256_add_epi32(d[2], d[5]);
+  tmp5 = _mm256_sub_epi32(d[2], d[5]);
+  tmp3 = _mm256_add_epi32(d[3], d[4]);
+  tmp4 = _mm256_sub_epi32(d[3], d[4]);
+
+  /* Even part */
+  tmp10 = _mm256_add_epi32(tmp0, tmp3);
+  tmp13 = _mm256_sub_epi32(tmp0, tmp3);
+  tmp11 = _mm256_add_epi32(tmp1, tmp2);
+  tmp12 = _mm256_sub_epi32(tmp1, tmp2);
+
+  z1 = MULC_AVX2(_mm256_add_epi32(tmp12, tmp13), FIX_0_541196100);
+  tmp12 = _mm256_add_epi32(z1, MULC_AVX2(tmp12, - FIX_1_847759065));
+  tmp13 = _mm256_add_epi32(z1, MULC_AVX2(tmp13, FIX_0_765366865));
+
+  if (pass == 1) {
+    d[0] = _mm256_slli_epi32(_mm256_add_epi32(tmp10, tmp11), PASS1_BITS);
+    d[4] = _mm256_slli_epi32(_mm256_sub_epi32(tmp10, tmp11), PASS1_BITS);
+    d[2] = DESCALE_AVX2(tmp13, CONST_BITS-PASS1_BITS);
+    d[6] = DESCALE_AVX2(tmp12, CONST_BITS-PASS1_BITS);
+  } else {
+    d[0] = DESCALE_AVX2(_mm256_add_epi32(tmp10, tmp11), PASS1_BITS);
+    d[4] = DESCALE_AVX2(_mm256_sub_epi32(tmp10, tmp11), PASS1_BITS);
+    d[2] = DESCALE_AVX2(tmp13, CONST_BITS+PASS1_BITS);
+    d[6] = DESCALE_AVX2(tmp12, CONST_BITS+PASS1_BITS);
+  }
+
+  /* Odd part */
+  z1 = _mm256_add_epi32(tmp4, tmp7);
+  z2 = _mm256_add_epi32(tmp5, tmp6);
+  z3 = _mm256_add_epi32(tmp4, tmp6);
+  z4 = _mm256_add_epi32(tmp5, tmp7);
+  z5 = MULC_AVX2(_mm256_add_epi32(z3, z4), FIX_1_175875602);
+
+  tmp4 = MULC_AVX2(tmp4, FIX_0_298631336);
+  tmp5 = MULC_AVX2(tmp5, FIX_2_053119869);
+  tmp6 = MULC_AVX2(tmp6, FIX_3_072711026);
+  tmp7 = MULC_AVX2(tmp7, FIX_1_501321110);
+  z1 = MULC_AVX2(z1, - FIX_0_899976223);
+  z2 = MULC_AVX2(z2, - FIX_2_562915447);
+  z3 = _mm256_add_epi32(MULC_AVX2(z3, - FIX_1_961570560), z5);
+  z4 = _mm256_add_epi32(MULC_AVX2(z4, - FIX_0_390180644), z5);
+
+  tmp4 = _mm256_add_epi32(tmp4, _mm256_add_epi32(z1, z3));
+  tmp5 = _mm256_add_epi32(tmp5, _mm256_add_epi32(z2, z4));
+  tmp6 = _mm256_add_epi32(tmp6, _mm256_add_epi32(z2, z3));
+  tmp7 = _mm256_add_epi32(tmp7, _mm256_add_epi32(z1, z4));
+
+  if (pass == 1) {
+    d[7] = DESCALE_AVX2(tmp4, CONST_BITS-PASS1_BITS);
+    d[5] = DESCALE_AVX2(tmp5, CONST_BITS-PASS1_BITS);
+    d[3] = DESCALE_AVX2(tmp6, CONST_BITS-PASS1_BITS);
+    d[1] = DESCALE_AVX2(tmp7, CONST_BITS-PASS1_BITS);
+  } else {
+    d[7] = DESCALE_AVX2(tmp4, CONST_BITS+PASS1_BITS);
+    d[5] = DESCALE_AVX2(tmp5, CONST_BITS+PASS1_BITS);
+    d[3] = DESCALE_AVX2(tmp6, CONST_BITS+PASS1_BITS);
+    d[1] = DESCALE_AVX2(tmp7, CONST_BITS+PASS1_BITS);
+  }
+}
+
+/* Transpose an 8x8 block of 32-bit values, one row per register */
+JSIMD_TARGET_AVX2 static INLINE void
+transpose8x8_avx2 (__m256i * r)
+{
+  __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+  __m256i u0, u1, u2, u3, u4, u5, u6, u7;
+
+  t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+  t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+  t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+  t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+  t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+  t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+  t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+  t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+  u0 = _mm256_unpacklo_epi64(t0, t2);
+  u1 = _mm256_unpackhi_epi64(t0, t2);
+  u2 = _mm256_unpacklo_epi64(t1, t3);
+  u3 = _mm256_unpackhi_epi64(t1, t3);
+  u4 = _mm256_unpacklo_epi64(t4, t6);
+  u5 = _mm256_unpackhi_epi64(t4, t6);
+  u6 = _mm256_unpacklo_epi64(t5, t7);
+  u7 = _mm256_unpackhi_epi64(t5, t7);
+
+  r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+  r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+  r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+  r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+  r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+/* Quantize a row of coefficients, with the entries at offset i of recip */
+JSIMD_TARGET_AVX2 static INLINE __m256i
+quantize_avx2 (__m256i x, const unsigned int * recip, int i)
+{
+  __m256i sign = _mm256_srai_epi32(x, 31);
+  __m256i q = _mm256_sub_epi32(_mm256_xor_si256(x, sign), sign);
+
+  q = _mm256_add_epi32(q, _mm256_loadu_si256((const __m256i *) (recip + i)));
+  q = mulhi_avx2(q, _mm256_loadu_si256((const __m256i *)
+				       (recip + DCTSIZE2 + i)));
+  q = mulhi_avx2(q, _mm256_loadu_si256((const __m256i *)
+				       (recip + 2 * DCTSIZE2 + i)));
+  return _mm256_sub_epi32(_mm256_xor_si256(q, sign), sign);
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(void)
+jpeg_fdct_islow_quant_avx2 (JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+			    JDIMENSION start_col, JDIMENSION num_blocks,
+			    const unsigned int * recip)
+{
+  __m256i d[8];
+  __m256i center = _mm256_set1_epi32(CENTERJSAMPLE);
+  JCOEFPTR output_ptr;
+  int i;
+
+  for (; num_blocks > 0; num_blocks--, coef_blocks++, start_col += DCTSIZE) {
+    /* Load the samples, applying unsigned->signed conversion */
+    for (i = 0; i < 8; i++)
+      d[i] = _mm256_sub_epi32(_mm256_cvtepi16_epi32(
+	_mm_loadu_si128((const __m128i *) (sample_data[i] + start_col))),
+			      center);
+
+    /* Pass 1: process rows. */
+    transpose8x8_avx2(d);
+    islow_1d_avx2(d, 1);
+
+    /* Pass 2: process columns. */
+    transpose8x8_avx2(d);
+    islow_1d_avx2(d, 2);
+
+    /* Quantize and store the coefficients */
+    output_ptr = (JCOEFPTR) (*coef_blocks);
+    for (i = 0; i < 8; i += 2) {
+      /* packs works per 128-bit lane, put rows i and i+1 back in order */
+      __m256i rows = _mm256_permute4x64_epi64(
+	_mm256_packs_epi32(quantize_avx2(d[i], recip, DCTSIZE * i),
+			   quantize_avx2(d[i + 1], recip, DCTSIZE * (i + 1))),
+	_MM_SHUFFLE(3,1,2,0));
+      _mm256_storeu_si256((__m256i *) (output_ptr + DCTSIZE * i), rows);
+    }
+  }
+}
+
+
+/* One 1-D pass of the AA&N float FDCT over eight lanes, in place */
+JSIMD_TARGET_AVX2 static INLINE void
+float_1d_avx2 (__m256 * d)
+{
+  __m256 tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  __m256 tmp10, tmp11, tmp12, tmp13;
+  __m256 z1, z2, z3, z4, z5, z11, z13;
+
+  tmp0 = _mm256_add_ps(d[0], d[7]);
+  tmp7 = _mm256_sub_ps(d[0], d[7]);
+  tmp1 = _mm256_add_ps(d[1], d[6]);
+  tmp6 = _mm256_sub_ps(d[1], d[6]);
+  tmp2 = _mm256_add_ps(d[2], d[5]);
+  tmp5 = _mm256_sub_ps(d[2], d[5]);
+  tmp3 = _mm256_add_ps(d[3], d[4]);
+  tmp4 = _mm256_sub_ps(d[3], d[4]);
+
+  /* Even part */
+  tmp10 = _mm256_add_ps(tmp0, tmp3);
+  tmp13 = _mm256_sub_ps(tmp0, tmp3);
+  tmp11 = _mm256_add_ps(tmp1, tmp2);
+  tmp12 = _mm256_sub_ps(tmp1, tmp2);
+
+  d[0] = _mm256_add_ps(tmp10, tmp11);
+  d[4] = _mm256_sub_ps(tmp10, tmp11);
+
+  z1 = _mm256_mul_ps(_mm256_add_ps(tmp12, tmp13),
+		     _mm256_set1_ps((float) 0.707106781));
+  d[2] = _mm256_add_ps(tmp13, z1);
+  d[6] = _mm256_sub_ps(tmp13, z1);
+
+  /* Odd part */
+  tmp10 = _mm256_add_ps(tmp4, tmp5);
+  tmp11 = _mm256_add_ps(tmp5, tmp6);
+  tmp12 = _mm256_add_ps(tmp6, tmp7);
+
+  z5 = _mm256_mul_ps(_mm256_sub_ps(tmp10, tmp12),
+		     _mm256_set1_ps((float) 0.382683433));
+  z2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps((float) 0.541196100),
+				   tmp10), z5);
+  z4 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps((float) 1.306562965),
+				   tmp12), z5);
+  z3 = _mm256_mul_ps(tmp11, _mm256_set1_ps((float) 0.707106781));
+
+  z11 = _mm256_add_ps(tmp7, z3);
+  z13 = _mm256_sub_ps(tmp7, z3);
+
+  d[5] = _mm256_add_ps(z13, z2);
+  d[3] = _mm256_sub_ps(z13, z2);
+  d[1] = _mm256_add_ps(z11, z4);
+  d[7] = _mm256_sub_ps(z11, z4);
+}
+
+/* Transpose an 8x8 block of floats, one row per register */
+JSIMD_TARGET_AVX2 static INLINE void
+transpose8x8_ps_avx2 (__m256 * r)
+{
+  __m256 t0, t1, t2, t3, t4, t5, t6, t7;
+  __m256 u0, u1, u2, u3, u4, u5, u6, u7;
+
+  t0 = _mm256_unpacklo_ps(r[0], r[1]);
+  t1 = _mm256_unpackhi_ps(r[0], r[1]);
+  t2 = _mm256_unpacklo_ps(r[2], r[3]);
+  t3 = _mm256_unpackhi_ps(r[2], r[3]);
+  t4 = _mm256_unpacklo_ps(r[4], r[5]);
+  t5 = _mm256_unpackhi_ps(r[4], r[5]);
+  t6 = _mm256_unpacklo_ps(r[6], r[7]);
+  t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+  u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0));
+  u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+  u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0));
+  u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+  u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1,0,1,0));
+  u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3,2,3,2));
+  u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1,0,1,0));
+  u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3,2,3,2));
+
+  r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+  r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+  r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+  r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+  r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+  r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+  r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+  r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+
+/* Quantize a row of coefficients as forward_DCT_float does */
+JSIMD_TARGET_AVX2 static INLINE __m256i
+quantize_float_avx2 (__m256 x, const FAST_FLOAT * divisors)
+{
+  x = _mm256_add_ps(_mm256_mul_ps(x, _mm256_loadu_ps(divisors)),
+		    _mm256_set1_ps((float) 16384.5));
+  return _mm256_sub_epi32(_mm256_cvttps_epi32(x), _mm256_set1_epi32(16384));
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(void)
+jpeg_fdct_float_quant_avx2 (JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+			    JDIMENSION start_col, JDIMENSION num_blocks,
+			    const FAST_FLOAT * divisors)
+{
+  __m256 f[8];
+  __m256i center = _mm256_set1_epi32(CENTERJSAMPLE);
+  JCOEFPTR output_ptr;
+  int i;
+
+  for (; num_blocks > 0; num_blocks--, coef_blocks++, start_col += DCTSIZE) {
+    /* Load the samples, applying unsigned->signed conversion */
+    for (i = 0; i < 8; i++)
+      f[i] = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepi16_epi32(
+	_mm_loadu_si128((const __m128i *) (sample_data[i] + start_col))),
+						 center));
+
+    /* Pass 1: process rows. */
+    transpose8x8_ps_avx2(f);
+    float_1d_avx2(f);
+
+    /* Pass 2: process columns. */
+    transpose8x8_ps_avx2(f);
+    float_1d_avx2(f);
+
+    /* Quantize and store the coefficients */
+    output_ptr = (JCOEFPTR) (*coef_blocks);
+    for (i = 0; i < 8; i += 2) {
+      /* packs works per 128-bit lane, put rows i and i+1 back in order */
+      __m256i rows = _mm256_permute4x64_epi64(
+	_mm256_packs_epi32(quantize_float_avx2(f[i], divisors + DCTSIZE * i),
+			   quantize_float_avx2(f[i + 1],
+					       divisors + DCTSIZE * (i + 1))),
+	_MM_SHUFFLE(3,1,2,0));
+      _mm256_storeu_si256((__m256i *) (output_ptr + DCTSIZE * i), rows);
+    }
+  }
+}
+
+#endif /* JSIMD_X86 */
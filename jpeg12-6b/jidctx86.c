@@ -0,0 +1,684 @@
+/*
+ * jidctx86.c
+ *
+ * This file contains SSE2 and AVX2 versions of the slow-but-accurate
+ * integer IDCT (jidctint.c) and of the floating-point IDCT (jidctflt.c),
+ * for 12-bit samples.  jddctmgr.c selects them at run time when the CPU
+ * supports the instruction set.  Each kernel also comes in a batched form
+ * that runs a whole block row with the constants kept in registers.
+ *
+ * Each routine performs the same arithmetic as the C code it replaces,
+ * in the same order, on all eight columns (then all eight rows) at once:
+ *   - the integer IDCT keeps every intermediate in 32-bit lanes, which is
+ *     what 12-bit data needs, so its output is bit-identical to
+ *     jpeg_idct_islow;
+ *   - the float IDCT uses single precision operations without contraction,
+ *     so on x86-64 it matches jpeg_idct_float as compiled for the same CPU.
+ * The shortcuts for all-zero AC columns and rows in the C code produce the
+ * same values as the full computation, so they are not needed here.
+ *
+ * The range limiting step is done arithmetically instead of through the
+ * sample_range_limit table.  The post-IDCT table maps a value x to
+ *   clamp(sign_extend_14(x & RANGE_MASK) + CENTERJSAMPLE, 0, MAXJSAMPLE)
+ * (see prepare_range_limit_table in jdmaster.c), including the wraparound
+ * for wildly out of range values, and that is what is computed below.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+#if DCTSIZE != 8
+  Sorry, this code only copes with 8x8 DCTs. /* deliberate syntax err */
+#endif
+
+#if BITS_IN_JSAMPLE != 12
+  Sorry, this code only copes with 12-bit samples. /* deliberate syntax err */
+#endif
+
+#include <immintrin.h>
+
+
+/* Constants and scaling, same as jidctint.c for 12-bit samples */
+
+#define CONST_BITS  13
+#define PASS1_BITS  1
+
+#define FIX_0_298631336  ((INT32)  2446)	/* FIX(0.298631336) */
+#define FIX_0_390180644  ((INT32)  3196)	/* FIX(0.390180644) */
+#define FIX_0_541196100  ((INT32)  4433)	/* FIX(0.541196100) */
+#define FIX_0_765366865  ((INT32)  6270)	/* FIX(0.765366865) */
+#define FIX_0_899976223  ((INT32)  7373)	/* FIX(0.899976223) */
+#define FIX_1_175875602  ((INT32)  9633)	/* FIX(1.175875602) */
+#define FIX_1_501321110  ((INT32)  12299)	/* FIX(1.501321110) */
+#define FIX_1_847759065  ((INT32)  15137)	/* FIX(1.847759065) */
+#define FIX_1_961570560  ((INT32)  16069)	/* FIX(1.961570560) */
+#define FIX_2_053119869  ((INT32)  16819)	/* FIX(2.053119869) */
+#define FIX_2_562915447  ((INT32)  20995)	/* FIX(2.562915447) */
+#define FIX_3_072711026  ((INT32)  25172)	/* FIX(3.072711026) */
+
+/* The range limit emulation needs the post-IDCT table to be this wide */
+#if RANGE_MASK != 16383
+  Sorry, the range limit emulation expects RANGE_MASK == 16383.
+#endif
+#define RANGE_BITS  14
+
+
+/*
+ * SSE2 helpers.  Eight columns are held in two registers of four lanes.
+ */
+
+/* Low 32 bits of a 32x32 multiply; SSE2 only has the unsigned 32x32->64
+ * form, which gives the right low half for signed inputs too.
+ */
+JSIMD_TARGET_SSE2 static INLINE __m128i
+mullo_sse2 (__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+			    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+#define MULC_SSE2(x,c)  mullo_sse2(x, _mm_set1_epi32((int) (c)))
+
+/* Sign extend 4 JCOEFs to 32 bits */
+#define WIDEN_LO_SSE2(x)  _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)
+#define WIDEN_HI_SSE2(x)  _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)
+
+/* One 1-D pass of the LL&M IDCT over four lanes, in place.
+ * d[0..7] hold the inputs in natural order, the outputs are descaled
+ * by "shift" bits with rounding.
+ */
+JSIMD_TARGET_SSE2 static INLINE void
+islow_1d_sse2 (__m128i * d, int shift)
+{
+  __m128i tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+  __m128i z1, z2, z3, z4, z5;
+  __m128i round = _mm_set1_epi32(1 << (shift - 1));
+  __m128i count = _mm_cvtsi32_si128(shift);
+
+  /* Even part */
+  z2 = d[2];
+  z3 = d[6];
+  z1 = MULC_SSE2(_mm_add_epi32(z2, z3), FIX_0_541196100);
+  tmp2 = _mm_add_epi32(z1, MULC_SSE2(z3, - FIX_1_847759065));
+  tmp3 = _mm_add_epi32(z1, MULC_SSE2(z2, FIX_0_765366865));
+
+  tmp0 = _mm_slli_epi32(_mm_add_epi32(d[0], d[4]), CONST_BITS);
+  tmp1 = _mm_slli_epi32(_mm_sub_epi32(d[0], d[4]), CONST_BITS);
+
+  tmp10 = _mm_add_epi32(tmp0, tmp3);
+  tmp13 = _mm_sub_epi32(tmp0, tmp3);
+  tmp11 = _mm_add_epi32(tmp1, tmp2);
+  tmp12 = _mm_sub_epi32(tmp1, tmp2);
+
+  /* Odd part */
+  tmp0 = d[7];
+  tmp1 = d[5];
+  tmp2 = d[3];
+  tmp3 = d[1];
+
+  z1 = _mm_add_epi32(tmp0, tmp3);
+  z2 = _mm_add_epi32(tmp1, tmp2);
+  z3 = _mm_add_epi32(tmp0, tmp2);
+  z4 = _mm_add_epi32(tmp1, tmp3);
+  z5 = MULC_SSE2(_mm_add_epi32(z3, z4), FIX_1_175875602);
+
+  tmp0 = MULC_SSE2(tmp0, FIX_0_298631336);
+  tmp1 = MULC_SSE2(tmp1, FIX_2_053119869);
+  tmp2 = MULC_SSE2(tmp2, FIX_3_072711026);
+  tmp3 = MULC_SSE2(tmp3, FIX_1_501321110);
+  z1 = MULC_SSE2(z1, - FIX_0_899976223);
+  z2 = MULC_SSE2(z2, - FIX_2_562915447);
+  z3 = _mm_add_epi32(MULC_SSE2(z3, - FIX_1_961570560), z5);
+  z4 = _mm_add_epi32(MULC_SSE2(z4, - FIX_0_390180644), z5);
+
+  tmp0 = _mm_add_epi32(tmp0, _mm_add_epi32(z1, z3));
+  tmp1 = _mm_add_epi32(tmp1, _mm_add_epi32(z2, z4));
+  tmp2 = _mm_add_epi32(tmp2, _mm_add_epi32(z2, z3));
+  tmp3 = _mm_add_epi32(tmp3, _mm_add_epi32(z1, z4));
+
+  /* Final output stage */
+  tmp10 = _mm_add_epi32(tmp10, round);
+  tmp11 = _mm_add_epi32(tmp11, round);
+  tmp12 = _mm_add_epi32(tmp12, round);
+  tmp13 = _mm_add_epi32(tmp13, round);
+  d[0] = _mm_sra_epi32(_mm_add_epi32(tmp10, tmp3), count);
+  d[7] = _mm_sra_epi32(_mm_sub_epi32(tmp10, tmp3), count);
+  d[1] = _mm_sra_epi32(_mm_add_epi32(tmp11, tmp2), count);
+  d[6] = _mm_sra_epi32(_mm_sub_epi32(tmp11, tmp2), count);
+  d[2] = _mm_sra_epi32(_mm_add_epi32(tmp12, tmp1), count);
+  d[5] = _mm_sra_epi32(_mm_sub_epi32(tmp12, tmp1), count);
+  d[3] = _mm_sra_epi32(_mm_add_epi32(tmp13, tmp0), count);
+  d[4] = _mm_sra_epi32(_mm_sub_epi32(tmp13, tmp0), count);
+}
+
+/* One 1-D pass of the AA&N float IDCT over four lanes, in place */
+JSIMD_TARGET_SSE2 static INLINE void
+float_1d_sse2 (__m128 * d)
+{
+  __m128 tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  __m128 tmp10, tmp11, tmp12, tmp13;
+  __m128 z5, z10, z11, z12, z13;
+
+  /* Even part */
+  tmp10 = _mm_add_ps(d[0], d[4]);
+  tmp11 = _mm_sub_ps(d[0], d[4]);
+  tmp13 = _mm_add_ps(d[2], d[6]);
+  tmp12 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(d[2], d[6]),
+				_mm_set1_ps(1.414213562f)), tmp13);
+
+  tmp0 = _mm_add_ps(tmp10, tmp13);
+  tmp3 = _mm_sub_ps(tmp10, tmp13);
+  tmp1 = _mm_add_ps(tmp11, tmp12);
+  tmp2 = _mm_sub_ps(tmp11, tmp12);
+
+  /* Odd part */
+  z13 = _mm_add_ps(d[5], d[3]);
+  z10 = _mm_sub_ps(d[5], d[3]);
+  z11 = _mm_add_ps(d[1], d[7]);
+  z12 = _mm_sub_ps(d[1], d[7]);
+
+  tmp7 = _mm_add_ps(z11, z13);
+  tmp11 = _mm_mul_ps(_mm_sub_ps(z11, z13), _mm_set1_ps(1.414213562f));
+
+  z5 = _mm_mul_ps(_mm_add_ps(z10, z12), _mm_set1_ps(1.847759065f));
+  tmp10 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.082392200f), z12), z5);
+  tmp12 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-2.613125930f), z10), z5);
+
+  tmp6 = _mm_sub_ps(tmp12, tmp7);
+  tmp5 = _mm_sub_ps(tmp11, tmp6);
+  tmp4 = _mm_add_ps(tmp10, tmp5);
+
+  d[0] = _mm_add_ps(tmp0, tmp7);
+  d[7] = _mm_sub_ps(tmp0, tmp7);
+  d[1] = _mm_add_ps(tmp1, tmp6);
+  d[6] = _mm_sub_ps(tmp1, tmp6);
+  d[2] = _mm_add_ps(tmp2, tmp5);
+  d[5] = _mm_sub_ps(tmp2, tmp5);
+  d[4] = _mm_add_ps(tmp3, tmp4);
+  d[3] = _mm_sub_ps(tmp3, tmp4);
+}
+
+/* Transpose a 4x4 block of 32-bit values held in a, b, c, d */
+#define TRANSPOSE4_SSE2(a,b,c,d)  \
+  { __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpackhi_epi32(a, b); \
+    __m128i t2 = _mm_unpacklo_epi32(c, d), t3 = _mm_unpackhi_epi32(c, d); \
+    a = _mm_unpacklo_epi64(t0, t2); b = _mm_unpackhi_epi64(t0, t2); \
+    c = _mm_unpacklo_epi64(t1, t3); d = _mm_unpackhi_epi64(t1, t3); }
+
+/* Transpose an 8x8 block of 32-bit values.  lo[r] holds columns 0-3 of
+ * row r and hi[r] columns 4-7; the result has the same layout.
+ */
+JSIMD_TARGET_SSE2 static INLINE void
+transpose8x8_sse2 (__m128i * lo, __m128i * hi)
+{
+  __m128i t;
+  int i;
+
+  TRANSPOSE4_SSE2(lo[0], lo[1], lo[2], lo[3]);
+  TRANSPOSE4_SSE2(hi[0], hi[1], hi[2], hi[3]);
+  TRANSPOSE4_SSE2(lo[4], lo[5], lo[6], lo[7]);
+  TRANSPOSE4_SSE2(hi[4], hi[5], hi[6], hi[7]);
+  /* Swap the off-diagonal blocks */
+  for (i = 0; i < 4; i++) {
+    t = hi[i];
+    hi[i] = lo[i + 4];
+    lo[i + 4] = t;
+  }
+}
+
+/* Range limit the descaled results and store them.  lo[c] and hi[c] hold
+ * column c of the output for rows 0-3 and 4-7.
+ */
+JSIMD_TARGET_SSE2 static INLINE void
+store_columns_sse2 (__m128i * lo, __m128i * hi,
+		    JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128i col[8], t[8];
+  __m128i center = _mm_set1_epi16(CENTERJSAMPLE);
+  __m128i zero = _mm_setzero_si128();
+  __m128i maxval = _mm_set1_epi16(MAXJSAMPLE);
+  int i;
+
+  /* Wrap to RANGE_BITS as the table would, then narrow; no saturation */
+  for (i = 0; i < 8; i++)
+    col[i] = _mm_packs_epi32(
+      _mm_srai_epi32(_mm_slli_epi32(lo[i], 32 - RANGE_BITS), 32 - RANGE_BITS),
+      _mm_srai_epi32(_mm_slli_epi32(hi[i], 32 - RANGE_BITS), 32 - RANGE_BITS));
+
+  /* Transpose 8x8 16-bit values, columns to rows.
+   * t[i] holds column pair 2i,2i+1 for rows 0-3, t[i+4] for rows 4-7.
+   */
+  for (i = 0; i < 4; i++) {
+    t[i] = _mm_unpacklo_epi16(col[2 * i], col[2 * i + 1]);
+    t[i + 4] = _mm_unpackhi_epi16(col[2 * i], col[2 * i + 1]);
+  }
+  /* col[p] holds columns 0-3 of rows 2p,2p+1, col[p+4] columns 4-7 */
+  col[0] = _mm_unpacklo_epi32(t[0], t[1]);
+  col[1] = _mm_unpackhi_epi32(t[0], t[1]);
+  col[2] = _mm_unpacklo_epi32(t[4], t[5]);
+  col[3] = _mm_unpackhi_epi32(t[4], t[5]);
+  col[4] = _mm_unpacklo_epi32(t[2], t[3]);
+  col[5] = _mm_unpackhi_epi32(t[2], t[3]);
+  col[6] = _mm_unpacklo_epi32(t[6], t[7]);
+  col[7] = _mm_unpackhi_epi32(t[6], t[7]);
+  for (i = 0; i < 4; i++) {
+    __m128i r0 = _mm_unpacklo_epi64(col[i], col[i + 4]);
+    __m128i r1 = _mm_unpackhi_epi64(col[i], col[i + 4]);
+    r0 = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(r0, center), zero), maxval);
+    r1 = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(r1, center), zero), maxval);
+    _mm_storeu_si128((__m128i *) (output_buf[2 * i] + output_col), r0);
+    _mm_storeu_si128((__m128i *) (output_buf[2 * i + 1] + output_col), r1);
+  }
+}
+
+
+JSIMD_TARGET_SSE2 static INLINE void
+islow_block_sse2 (ISLOW_MULT_TYPE * quantptr, JCOEFPTR coef_block,
+		   JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128i lo[8], hi[8];
+  int i;
+
+  /* Pass 1: process columns from input, dequantizing on load. */
+  for (i = 0; i < 8; i++) {
+    __m128i c = _mm_loadu_si128((const __m128i *) (coef_block + DCTSIZE * i));
+    lo[i] = mullo_sse2(WIDEN_LO_SSE2(c),
+		       _mm_loadu_si128((const __m128i *) (quantptr + DCTSIZE * i)));
+    hi[i] = mullo_sse2(WIDEN_HI_SSE2(c),
+		       _mm_loadu_si128((const __m128i *) (quantptr + DCTSIZE * i + 4)));
+  }
+  islow_1d_sse2(lo, CONST_BITS-PASS1_BITS);
+  islow_1d_sse2(hi, CONST_BITS-PASS1_BITS);
+
+  /* Pass 2: process rows from the work registers. */
+  /* After the transpose lo[c] holds column c of rows 0-3, hi[c] of rows 4-7 */
+  transpose8x8_sse2(lo, hi);
+  islow_1d_sse2(lo, CONST_BITS+PASS1_BITS+3);
+  islow_1d_sse2(hi, CONST_BITS+PASS1_BITS+3);
+  store_columns_sse2(lo, hi, output_buf, output_col);
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(void)
+jpeg_idct_islow_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  islow_block_sse2((ISLOW_MULT_TYPE *) compptr->dct_table, coef_block,
+		   output_buf, output_col);
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(void)
+jpeg_idct_islow_row_sse2 (j_decompress_ptr cinfo,
+			  jpeg_component_info * compptr,
+			  JBLOCKROW coef_row, JSAMPARRAY output_buf,
+			  JDIMENSION output_col, JDIMENSION num_blocks)
+{
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+
+  for (; num_blocks > 0; num_blocks--, coef_row++) {
+    islow_block_sse2(quantptr, (JCOEFPTR) coef_row, output_buf, output_col);
+    output_col += DCTSIZE;
+  }
+}
+
+
+JSIMD_TARGET_SSE2 static INLINE void
+float_block_sse2 (FLOAT_MULT_TYPE * quantptr, JCOEFPTR coef_block,
+		   JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128 flo[8], fhi[8];
+  __m128i lo[8], hi[8];
+  __m128i four = _mm_set1_epi32(4);
+  int i;
+
+  /* Pass 1: process columns from input, dequantizing on load. */
+  for (i = 0; i < 8; i++) {
+    __m128i c = _mm_loadu_si128((const __m128i *) (coef_block + DCTSIZE * i));
+    flo[i] = _mm_mul_ps(_mm_cvtepi32_ps(WIDEN_LO_SSE2(c)),
+			_mm_loadu_ps(quantptr + DCTSIZE * i));
+    fhi[i] = _mm_mul_ps(_mm_cvtepi32_ps(WIDEN_HI_SSE2(c)),
+			_mm_loadu_ps(quantptr + DCTSIZE * i + 4));
+  }
+  float_1d_sse2(flo);
+  float_1d_sse2(fhi);
+
+  /* Pass 2: process rows, the transpose works on the raw bits */
+  for (i = 0; i < 8; i++) {
+    lo[i] = _mm_castps_si128(flo[i]);
+    hi[i] = _mm_castps_si128(fhi[i]);
+  }
+  transpose8x8_sse2(lo, hi);
+  for (i = 0; i < 8; i++) {
+    flo[i] = _mm_castsi128_ps(lo[i]);
+    fhi[i] = _mm_castsi128_ps(hi[i]);
+  }
+  float_1d_sse2(flo);
+  float_1d_sse2(fhi);
+
+  /* Scale down by a factor of 8, as DESCALE((INT32) x, 3) */
+  for (i = 0; i < 8; i++) {
+    lo[i] = _mm_srai_epi32(_mm_add_epi32(_mm_cvttps_epi32(flo[i]), four), 3);
+    hi[i] = _mm_srai_epi32(_mm_add_epi32(_mm_cvttps_epi32(fhi[i]), four), 3);
+  }
+  store_columns_sse2(lo, hi, output_buf, output_col);
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(void)
+jpeg_idct_float_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  float_block_sse2((FLOAT_MULT_TYPE *) compptr->dct_table, coef_block,
+		   output_buf, output_col);
+}
+
+
+JSIMD_TARGET_SSE2 GLOBAL(void)
+jpeg_idct_float_row_sse2 (j_decompress_ptr cinfo,
+			  jpeg_component_info * compptr,
+			  JBLOCKROW coef_row, JSAMPARRAY output_buf,
+			  JDIMENSION output_col, JDIMENSION num_blocks)
+{
+  FLOAT_MULT_TYPE * quantptr = (FLOAT_MULT_TYPE *) compptr->dct_table;
+
+  for (; num_blocks > 0; num_blocks--, coef_row++) {
+    float_block_sse2(quantptr, (JCOEFPTR) coef_row, output_buf, output_col);
+    output_col += DCTSIZE;
+  }
+}
+
+
+/*
+ * AVX2 versions.  Eight columns fit in one register.
+ */
+
+#define MULC_AVX2(x,c)  _mm256_mullo_epi32(x, _mm256_set1_epi32((int) (c)))
+
+JSIMD_TARGET_AVX2 static INLINE void
+islow_1d_avx2 (__m256i * d, int shift)
+{
+  __m256i tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+  __m256i z1, z2, z3, z4, z5;
+  __m256i round = _mm256_set1_epi32(1 << (shift - 1));
+  __m128i count = _mm_cvtsi32_si128(shift);
+
+  /* Even part */
+  z2 = d[2];
+  z3 = d[6];
+  z1 = MULC_AVX2(_mm256_add_epi32(z2, z3), FIX_0_541196100);
+  tmp2 = _mm256_add_epi32(z1, MULC_AVX2(z3, - FIX_1_847759065));
+  tmp3 = _mm256_add_epi32(z1, MULC_AVX2(z2, FIX_0_765366865));
+
+  tmp0 = _mm256_slli_epi32(_mm256_add_epi32(d[0], d[4]), CONST_BITS);
+  tmp1 = _mm256_slli_epi32(_mm256_sub_epi32(d[0], d[4]), CONST_BITS);
+
+  tmp10 = _mm256_add_epi32(tmp0, tmp3);
+  tmp13 = _mm256_sub_epi32(tmp0, tmp3);
+  tmp11 = _mm256_add_epi32(tmp1, tmp2);
+  tmp12 = _mm256_sub_epi32(tmp1, tmp2);
+
+  /* Odd part */
+  tmp0 = d[7];
+  tmp1 = d[5];
+  tmp2 = d[3];
+  tmp3 = d[1];
+
+  z1 = _mm256_add_epi32(tmp0, tmp3);
+  z2 = _mm256_add_epi32(tmp1, tmp2);
+  z3 = _mm256_add_epi32(tmp0, tmp2);
+  z4 = _mm256_add_epi32(tmp1, tmp3);
+  z5 = MULC_AVX2(_mm256_add_epi32(z3, z4), FIX_1_175875602);
+
+  tmp0 = MULC_AVX2(tmp0, FIX_0_298631336);
+  tmp1 = MULC_AVX2(tmp1, FIX_2_053119869);
+  tmp2 = MULC_AVX2(tmp2, FIX_3_072711026);
+  tmp3 = MULC_AVX2(tmp3, FIX_1_501321110);
+  z1 = MULC_AVX2(z1, - FIX_0_899976223);
+  z2 = MULC_AVX2(z2, - FIX_2_562915447);
+  z3 = _mm256_add_epi32(MULC_AVX2(z3, - FIX_1_961570560), z5);
+  z4 = _mm256_add_epi32(MULC_AVX2(z4, - FIX_0_390180644), z5);
+
+  tmp0 = _mm256_add_epi32(tmp0, _mm256_add_epi32(z1, z3));
+  tmp1 = _mm256_add_epi32(tmp1, _mm256_add_epi32(z2, z4));
+  tmp2 = _mm256_add_epi32(tmp2, _mm256_add_epi32(z2, z3));
+  tmp3 = _mm256_add_epi32(tmp3, _mm256_add_epi32(z1, z4));
+
+  /* Final output stage */
+  tmp10 = _mm256_add_epi32(tmp10, round);
+  tmp11 = _mm256_add_epi32(tmp11, round);
+  tmp12 = _mm256_add_epi32(tmp12, round);
+  tmp13 = _mm256_add_epi32(tmp13, round);
+  d[0] = _mm256_sra_epi32(_mm256_add_epi32(tmp10, tmp3), count);
+  d[7] = _mm256_sra_epi32(_mm256_sub_epi32(tmp10, tmp3), count);
+  d[1] = _mm256_sra_epi32(_mm256_add_epi32(tmp11, tmp2), count);
+  d[6] = _mm256_sra_epi32(_mm256_sub_epi32(tmp11, tmp2), count);
+  d[2] = _mm256_sra_epi32(_mm256_add_epi32(tmp12, tmp1), count);
+  d[5] = _mm256_sra_epi32(_mm256_sub_epi32(tmp12, tmp1), count);
+  d[3] = _mm256_sra_epi32(_mm256_add_epi32(tmp13, tmp0), count);
+  d[4] = _mm256_sra_epi32(_mm256_sub_epi32(tmp13, tmp0), count);
+}
+
+JSIMD_TARGET_AVX2 static INLINE void
+float_1d_avx2 (__m256 * d)
+{
+  __m256 tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  __m256 tmp10, tmp11, tmp12, tmp13;
+  __m256 z5, z10, z11, z12, z13;
+
+  /* Even part */
+  tmp10 = _mm256_add_ps(d[0], d[4]);
+  tmp11 = _mm256_sub_ps(d[0], d[4]);
+  tmp13 = _mm256_add_ps(d[2], d[6]);
+  tmp12 = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(d[2], d[6]),
+				      _mm256_set1_ps(1.414213562f)), tmp13);
+
+  tmp0 = _mm256_add_ps(tmp10, tmp13);
+  tmp3 = _mm256_sub_ps(tmp10, tmp13);
+  tmp1 = _mm256_add_ps(tmp11, tmp12);
+  tmp2 = _mm256_sub_ps(tmp11, tmp12);
+
+  /* Odd part */
+  z13 = _mm256_add_ps(d[5], d[3]);
+  z10 = _mm256_sub_ps(d[5], d[3]);
+  z11 = _mm256_add_ps(d[1], d[7]);
+  z12 = _mm256_sub_ps(d[1], d[7]);
+
+  tmp7 = _mm256_add_ps(z11, z13);
+  tmp11 = _mm256_mul_ps(_mm256_sub_ps(z11, z13), _mm256_set1_ps(1.414213562f));
+
+  z5 = _mm256_mul_ps(_mm256_add_ps(z10, z12), _mm256_set1_ps(1.847759065f));
+  tmp10 = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(1.082392200f), z12), z5);
+  tmp12 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-2.613125930f), z10), z5);
+
+  tmp6 = _mm256_sub_ps(tmp12, tmp7);
+  tmp5 = _mm256_sub_ps(tmp11, tmp6);
+  tmp4 = _mm256_add_ps(tmp10, tmp5);
+
+  d[0] = _mm256_add_ps(tmp0, tmp7);
+  d[7] = _mm256_sub_ps(tmp0, tmp7);
+  d[1] = _mm256_add_ps(tmp1, tmp6);
+  d[6] = _mm256_sub_ps(tmp1, tmp6);
+  d[2] = _mm256_add_ps(tmp2, tmp5);
+  d[5] = _mm256_sub_ps(tmp2, tmp5);
+  d[4] = _mm256_add_ps(tmp3, tmp4);
+  d[3] = _mm256_sub_ps(tmp3, tmp4);
+}
+
+/* Transpose an 8x8 block of 32-bit values, one row per register */
+JSIMD_TARGET_AVX2 static INLINE void
+transpose8x8_avx2 (__m256i * r)
+{
+  __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+  __m256i u0, u1, u2, u3, u4, u5, u6, u7;
+
+  t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+  t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+  t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+  t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+  t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+  t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+  t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+  t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+  u0 = _mm256_unpacklo_epi64(t0, t2);
+  u1 = _mm256_unpackhi_epi64(t0, t2);
+  u2 = _mm256_unpacklo_epi64(t1, t3);
+  u3 = _mm256_unpackhi_epi64(t1, t3);
+  u4 = _mm256_unpacklo_epi64(t4, t6);
+  u5 = _mm256_unpackhi_epi64(t4, t6);
+  u6 = _mm256_unpacklo_epi64(t5, t7);
+  u7 = _mm256_unpackhi_epi64(t5, t7);
+
+  r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+  r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+  r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+  r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+  r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+/* Range limit the descaled results and store them, d[c] holds column c */
+JSIMD_TARGET_AVX2 static INLINE void
+store_columns_avx2 (__m256i * d, JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m256i center = _mm256_set1_epi16(CENTERJSAMPLE);
+  __m256i zero = _mm256_setzero_si256();
+  __m256i maxval = _mm256_set1_epi16(MAXJSAMPLE);
+  int i;
+
+  for (i = 0; i < 8; i++)
+    d[i] = _mm256_srai_epi32(_mm256_slli_epi32(d[i], 32 - RANGE_BITS),
+			     32 - RANGE_BITS);
+  transpose8x8_avx2(d);
+
+  for (i = 0; i < 8; i += 2) {
+    /* packs works per 128-bit lane, put rows i and i+1 back in order */
+    __m256i rows = _mm256_permute4x64_epi64(_mm256_packs_epi32(d[i], d[i + 1]),
+					    _MM_SHUFFLE(3,1,2,0));
+    rows = _mm256_min_epi16(_mm256_max_epi16(_mm256_add_epi16(rows, center),
+					     zero), maxval);
+    _mm_storeu_si128((__m128i *) (output_buf[i] + output_col),
+		     _mm256_castsi256_si128(rows));
+    _mm_storeu_si128((__m128i *) (output_buf[i + 1] + output_col),
+		     _mm256_extracti128_si256(rows, 1));
+  }
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE void
+islow_block_avx2 (ISLOW_MULT_TYPE * quantptr, JCOEFPTR coef_block,
+		   JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m256i d[8];
+  int i;
+
+  /* Pass 1: process columns from input, dequantizing on load. */
+  for (i = 0; i < 8; i++)
+    d[i] = _mm256_mullo_epi32(
+      _mm256_cvtepi16_epi32(
+	_mm_loadu_si128((const __m128i *) (coef_block + DCTSIZE * i))),
+      _mm256_loadu_si256((const __m256i *) (quantptr + DCTSIZE * i)));
+  islow_1d_avx2(d, CONST_BITS-PASS1_BITS);
+
+  /* Pass 2: process rows. */
+  transpose8x8_avx2(d);
+  islow_1d_avx2(d, CONST_BITS+PASS1_BITS+3);
+  store_columns_avx2(d, output_buf, output_col);
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(void)
+jpeg_idct_islow_avx2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  islow_block_avx2((ISLOW_MULT_TYPE *) compptr->dct_table, coef_block,
+		   output_buf, output_col);
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(void)
+jpeg_idct_islow_row_avx2 (j_decompress_ptr cinfo,
+			  jpeg_component_info * compptr,
+			  JBLOCKROW coef_row, JSAMPARRAY output_buf,
+			  JDIMENSION output_col, JDIMENSION num_blocks)
+{
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+
+  for (; num_blocks > 0; num_blocks--, coef_row++) {
+    islow_block_avx2(quantptr, (JCOEFPTR) coef_row, output_buf, output_col);
+    output_col += DCTSIZE;
+  }
+}
+
+
+JSIMD_TARGET_AVX2 static INLINE void
+float_block_avx2 (FLOAT_MULT_TYPE * quantptr, JCOEFPTR coef_block,
+		   JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m256 f[8];
+  __m256i d[8];
+  __m256i four = _mm256_set1_epi32(4);
+  int i;
+
+  /* Pass 1: process columns from input, dequantizing on load. */
+  for (i = 0; i < 8; i++)
+    f[i] = _mm256_mul_ps(
+      _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+	_mm_loadu_si128((const __m128i *) (coef_block + DCTSIZE * i)))),
+      _mm256_loadu_ps(quantptr + DCTSIZE * i));
+  float_1d_avx2(f);
+
+  /* Pass 2: process rows. */
+  for (i = 0; i < 8; i++)
+    d[i] = _mm256_castps_si256(f[i]);
+  transpose8x8_avx2(d);
+  for (i = 0; i < 8; i++)
+    f[i] = _mm256_castsi256_ps(d[i]);
+  float_1d_avx2(f);
+
+  /* Scale down by a factor of 8, as DESCALE((INT32) x, 3) */
+  for (i = 0; i < 8; i++)
+    d[i] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(f[i]),
+					      four), 3);
+  store_columns_avx2(d, output_buf, output_col);
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(void)
+jpeg_idct_float_avx2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  float_block_avx2((FLOAT_MULT_TYPE *) compptr->dct_table, coef_block,
+		   output_buf, output_col);
+}
+
+
+JSIMD_TARGET_AVX2 GLOBAL(void)
+jpeg_idct_float_row_avx2 (j_decompress_ptr cinfo,
+			  jpeg_component_info * compptr,
+			  JBLOCKROW coef_row, JSAMPARRAY output_buf,
+			  JDIMENSION output_col, JDIMENSION num_blocks)
+{
+  FLOAT_MULT_TYPE * quantptr = (FLOAT_MULT_TYPE *) compptr->dct_table;
+
+  for (; num_blocks > 0; num_blocks--, coef_row++) {
+    float_block_avx2(quantptr, (JCOEFPTR) coef_row, output_buf, output_col);
+    output_col += DCTSIZE;
+  }
+}
+
+#endif /* JSIMD_X86 */
@@ -131,6 +131,19 @@ typedef struct {
   /* This counts total space obtained from jpeg_get_small/large */
   long total_space_allocated;
 
+  /* Statistics for get_stats; see struct jpeg_memory_stats */
+  long peak_space_allocated;	/* high-water mark of the total */
+  long pool_space[JPOOL_NUMPOOLS]; /* space held by each pool */
+  long pool_peak[JPOOL_NUMPOOLS]; /* high-water mark of each pool */
+  long small_requests;		/* calls to alloc_small */
+  long large_requests;		/* calls to alloc_large */
+  long virt_sarray_space;	/* full size of realized virtual arrays */
+  long virt_barray_space;
+  long virt_mem_space;		/* their in-memory buffers */
+  long virt_sarray_peak;	/* high-water marks of the three */
+  long virt_barray_peak;
+  long virt_mem_peak;
+
   /* alloc_sarray and alloc_barray set this value for use by virtual
    * array routines.
    */
@@ -213,6 +226,20 @@ print_mem_stats (j_common_ptr cinfo, int pool_id)
 #endif /* MEM_STATS */
 
 
+/* Account for space obtained for a pool, or given back if negative */
+
+LOCAL(void)
+count_space (my_mem_ptr mem, int pool_id, long space)
+{
+  mem->total_space_allocated += space;
+  if (mem->peak_space_allocated < mem->total_space_allocated)
+    mem->peak_space_allocated = mem->total_space_allocated;
+  mem->pool_space[pool_id] += space;
+  if (mem->pool_peak[pool_id] < mem->pool_space[pool_id])
+    mem->pool_peak[pool_id] = mem->pool_space[pool_id];
+}
+
+
 LOCAL(void)
 out_of_memory (j_common_ptr cinfo, int which)
 /* Report an out-of-memory error and stop execution */
@@ -274,6 +301,7 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   /* See if space is available in any existing pool */
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
+  mem->small_requests++;
   prev_hdr_ptr = NULL;
   hdr_ptr = mem->small_list[pool_id];
   while (hdr_ptr != NULL) {
@@ -303,7 +331,7 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
       if (slop < MIN_SLOP)	/* give up when it gets real small */
 	out_of_memory(cinfo, 2); /* jpeg_get_small failed */
     }
-    mem->total_space_allocated += (long)(min_request + slop);
+    count_space(mem, pool_id, (long)(min_request + slop));
     /* Success, initialize the new pool header and add to end of list */
     hdr_ptr->hdr.next = NULL;
     hdr_ptr->hdr.bytes_used = 0;
@@ -358,12 +386,13 @@ alloc_large (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   /* Always make a new pool */
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
+  mem->large_requests++;
 
   hdr_ptr = (large_pool_ptr) jpeg_get_large(cinfo, sizeofobject +
 					    SIZEOF(large_pool_hdr));
   if (hdr_ptr == NULL)
     out_of_memory(cinfo, 4);	/* jpeg_get_large failed */
-  mem->total_space_allocated += (long)(sizeofobject + SIZEOF(large_pool_hdr));
+  count_space(mem, pool_id, (long)(sizeofobject + SIZEOF(large_pool_hdr)));
 
   /* Success, initialize the new pool header and add to list */
   hdr_ptr->hdr.next = mem->large_list[pool_id];
@@ -653,6 +682,10 @@ realize_virt_arrays (j_common_ptr cinfo)
       }
       sptr->mem_buffer = alloc_sarray(cinfo, JPOOL_IMAGE,
 				      sptr->samplesperrow, sptr->rows_in_mem);
+      mem->virt_sarray_space += (long) sptr->rows_in_array *
+				(long) sptr->samplesperrow * SIZEOF(JSAMPLE);
+      mem->virt_mem_space += (long) sptr->rows_in_mem *
+			     (long) sptr->samplesperrow * SIZEOF(JSAMPLE);
       sptr->rowsperchunk = mem->last_rowsperchunk;
       sptr->cur_start_row = 0;
       sptr->first_undef_row = 0;
@@ -677,12 +710,20 @@ realize_virt_arrays (j_common_ptr cinfo)
       }
       bptr->mem_buffer = alloc_barray(cinfo, JPOOL_IMAGE,
 				      bptr->blocksperrow, bptr->rows_in_mem);
+      mem->virt_barray_space += (long) bptr->rows_in_array *
+				(long) bptr->blocksperrow * SIZEOF(JBLOCK);
+      mem->virt_mem_space += (long) bptr->rows_in_mem *
+			     (long) bptr->blocksperrow * SIZEOF(JBLOCK);
       bptr->rowsperchunk = mem->last_rowsperchunk;
       bptr->cur_start_row = 0;
       bptr->first_undef_row = 0;
       bptr->dirty = FALSE;
     }
   }
+
+  mem->virt_sarray_peak = MAX(mem->virt_sarray_peak, mem->virt_sarray_space);
+  mem->virt_barray_peak = MAX(mem->virt_barray_peak, mem->virt_barray_space);
+  mem->virt_mem_peak = MAX(mem->virt_mem_peak, mem->virt_mem_space);
 }
 
 
@@ -961,6 +1002,9 @@ free_pool (j_common_ptr cinfo, int pool_id)
       }
     }
     mem->virt_barray_list = NULL;
+    mem->virt_sarray_space = 0;
+    mem->virt_barray_space = 0;
+    mem->virt_mem_space = 0;
   }
 
   /* Release large objects */
@@ -973,7 +1017,7 @@ free_pool (j_common_ptr cinfo, int pool_id)
 		  lhdr_ptr->hdr.bytes_left +
 		  SIZEOF(large_pool_hdr);
     jpeg_free_large(cinfo, (void FAR *) lhdr_ptr, space_freed);
-    mem->total_space_allocated -= (long)(space_freed);
+    count_space(mem, pool_id, - (long)(space_freed));
     lhdr_ptr = next_lhdr_ptr;
   }
 
@@ -987,12 +1031,36 @@ free_pool (j_common_ptr cinfo, int pool_id)
 		  shdr_ptr->hdr.bytes_left +
 		  SIZEOF(small_pool_hdr);
     jpeg_free_small(cinfo, (void *) shdr_ptr, space_freed);
-    mem->total_space_allocated -= (long)(space_freed);
+    count_space(mem, pool_id, - (long)(space_freed));
     shdr_ptr = next_shdr_ptr;
   }
 }
 
 
+/*
+ * Report memory usage statistics.
+ */
+
+METHODDEF(void)
+get_stats (j_common_ptr cinfo, struct jpeg_memory_stats * stats)
+{
+  my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
+  int pool;
+
+  stats->current_bytes = mem->total_space_allocated;
+  stats->peak_bytes = mem->peak_space_allocated;
+  for (pool = 0; pool < JPOOL_NUMPOOLS; pool++) {
+    stats->pool_bytes[pool] = mem->pool_space[pool];
+    stats->pool_peak_bytes[pool] = mem->pool_peak[pool];
+  }
+  stats->small_allocs = mem->small_requests;
+  stats->large_allocs = mem->large_requests;
+  stats->virt_sarray_bytes = mem->virt_sarray_peak;
+  stats->virt_barray_bytes = mem->virt_barray_peak;
+  stats->virt_mem_bytes = mem->virt_mem_peak;
+}
+
+
 /*
  * Close up shop entirely.
  * Note that this cannot be called unless cinfo->mem is non-NULL.
@@ -1075,21 +1143,31 @@ jinit_memory_mgr (j_common_ptr cinfo)
   mem->pub.access_virt_barray = access_virt_barray;
   mem->pub.free_pool = free_pool;
   mem->pub.self_destruct = self_destruct;
+  mem->pub.get_stats = get_stats;
 
   /* Make MAX_ALLOC_CHUNK accessible to other modules */
   mem->pub.max_alloc_chunk = MAX_ALLOC_CHUNK;
 
   /* Initialize working state */
   mem->pub.max_memory_to_use = max_to_use;
+  mem->pub.arena = NULL;
 
   for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
     mem->small_list[pool] = NULL;
     mem->large_list[pool] = NULL;
+    mem->pool_space[pool] = 0;
+    mem->pool_peak[pool] = 0;
   }
   mem->virt_sarray_list = NULL;
   mem->virt_barray_list = NULL;
 
   mem->total_space_allocated = SIZEOF(my_memory_mgr);
+  mem->peak_space_allocated = mem->total_space_allocated;
+  mem->small_requests = 0;
+  mem->large_requests = 0;
+  mem->virt_sarray_space = mem->virt_sarray_peak = 0;
+  mem->virt_barray_space = mem->virt_barray_peak = 0;
+  mem->virt_mem_space = mem->virt_mem_peak = 0;
 
   /* Declare ourselves open for business */
   cinfo->mem = & mem->pub;
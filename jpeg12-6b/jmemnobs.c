@@ -6,13 +6,25 @@
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file provides a really simple implementation of the system-
- * dependent portion of the JPEG memory manager.  This implementation
- * assumes that no backing-store files are needed: all required space
- * can be obtained from malloc().
+ * dependent portion of the JPEG memory manager.  All required space is
+ * obtained from malloc().
  * This is very portable in the sense that it'll compile on almost anything,
  * but you'd better have lots of main memory (or virtual memory) if you want
  * to process big images.
- * Note that the max_memory_to_use option is ignored by this implementation.
+ *
+ * Where mmap() is available (USE_MMAP_BACKING_STORE, see jconfig.h), the
+ * max_memory_to_use option is honored when it is set: virtual arrays that
+ * don't fit are paged through temporary files mapped into memory, so even
+ * huge multi-scan images can be processed in bounded RAM.  Otherwise, and
+ * by default (max_memory_to_use = 0), the option is ignored and no backing
+ * store is ever needed.
+ *
+ * Optionally, the pool memory of a JPEG object can come from an arena
+ * instead (see mem->arena).  An arena hands out memory from a chain of
+ * large slabs; freeing is a no-op, and resetting the arena makes all of it
+ * available again in constant time.  When many small images are decoded
+ * one after the other, this avoids a round of malloc() and free() calls
+ * per image and the heap fragmentation they can cause.
  */
 
 #define JPEG_INTERNALS
@@ -25,22 +37,193 @@ extern void * malloc JPP((size_t size));
 extern void free JPP((void *ptr));
 #endif
 
+#ifdef USE_MMAP_BACKING_STORE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+/*
+ * Arena management.
+ *
+ * Slabs are only ever added to the chain.  Allocation moves forward along
+ * it, so the slabs past the current one are unused; a slab's fill level is
+ * cleared when the allocator moves onto it.  Resetting just goes back to
+ * the first slab.
+ */
+
+#define ARENA_ALIGN	16	/* at least what malloc() guarantees */
+
+#define ARENA_ROUND(size)  (((size) + ARENA_ALIGN-1) & ~((size_t) ARENA_ALIGN-1))
+
+typedef struct arena_slab_struct {
+  struct arena_slab_struct * next; /* next slab in chain, or NULL */
+  size_t size;			/* usable bytes, following the header */
+  size_t used;			/* bytes handed out, if this slab is current */
+} arena_slab;
+
+#define SLAB_HDR_SIZE	ARENA_ROUND(SIZEOF(arena_slab))
+
+#define SLAB_DATA(slab)	((char *) (slab) + SLAB_HDR_SIZE)
+
+struct jpeg_arena_control {
+  arena_slab * first;		/* head of the chain, or NULL */
+  arena_slab * current;		/* slab being allocated from */
+  size_t slab_size;		/* usable size of a new slab */
+  size_t reserved;		/* total bytes obtained from malloc() */
+};
+
+
+/* Make a new slab of at least min_size bytes and chain it after the
+ * current one.  Returns NULL if out of memory.
+ */
+
+LOCAL(arena_slab *)
+add_slab (jpeg_arena_ptr arena, size_t min_size)
+{
+  size_t size = MAX(arena->slab_size, min_size);
+  arena_slab * slab = (arena_slab *) malloc(SLAB_HDR_SIZE + size);
+
+  if (slab == NULL)
+    return NULL;
+  slab->size = size;
+  slab->used = 0;
+  if (arena->current == NULL) {
+    slab->next = arena->first;
+    arena->first = slab;
+  } else {
+    slab->next = arena->current->next;
+    arena->current->next = slab;
+  }
+  arena->reserved += SLAB_HDR_SIZE + size;
+  return slab;
+}
+
+
+LOCAL(void *)
+arena_alloc (jpeg_arena_ptr arena, size_t sizeofobject)
+{
+  arena_slab * slab = arena->current;
+  size_t size = ARENA_ROUND(sizeofobject);
+
+  if (slab == NULL || slab->size - slab->used < size) {
+    /* Move on to the first later slab big enough, else make one */
+    for (slab = (slab == NULL ? arena->first : slab->next);
+	 slab != NULL; slab = slab->next) {
+      if (slab->size >= size)
+	break;
+    }
+    if (slab == NULL && (slab = add_slab(arena, size)) == NULL)
+      return NULL;
+    slab->used = 0;
+    arena->current = slab;
+  }
+  slab->used += size;
+  return (void *) (SLAB_DATA(slab) + slab->used - size);
+}
+
+
+/* Was this object handed out by the arena? */
+
+LOCAL(boolean)
+arena_owns (jpeg_arena_ptr arena, void * object)
+{
+  arena_slab * slab;
+
+  for (slab = arena->first; slab != NULL; slab = slab->next) {
+    if ((char *) object >= SLAB_DATA(slab) &&
+	(char *) object < SLAB_DATA(slab) + slab->size)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+
+/* The arena in use by a JPEG object, if any.  Note that cinfo->mem is not
+ * set while the memory manager itself is being allocated.
+ */
+
+#define ARENA_OF(cinfo)  ((cinfo)->mem != NULL ? (cinfo)->mem->arena : NULL)
+
+
+GLOBAL(jpeg_arena_ptr)
+jpeg_arena_create (size_t slab_size)
+{
+  jpeg_arena_ptr arena;
+
+  arena = (jpeg_arena_ptr) malloc(SIZEOF(struct jpeg_arena_control));
+  if (arena == NULL)
+    return NULL;
+  arena->first = NULL;
+  arena->current = NULL;
+  arena->slab_size = ARENA_ROUND(slab_size);
+  arena->reserved = 0;
+  /* Reserve the first slab up front */
+  if (slab_size > 0 && add_slab(arena, 0) == NULL) {
+    free(arena);
+    return NULL;
+  }
+  return arena;
+}
+
+
+/* Only valid once nothing allocated from the arena is in use */
+
+GLOBAL(void)
+jpeg_arena_reset (jpeg_arena_ptr arena)
+{
+  arena->current = arena->first;
+  if (arena->current != NULL)
+    arena->current->used = 0;
+}
+
+
+GLOBAL(size_t)
+jpeg_arena_reserved (jpeg_arena_ptr arena)
+{
+  return arena->reserved;
+}
+
+
+GLOBAL(void)
+jpeg_arena_destroy (jpeg_arena_ptr arena)
+{
+  arena_slab * slab;
+
+  if (arena == NULL)
+    return;
+  while ((slab = arena->first) != NULL) {
+    arena->first = slab->next;
+    free(slab);
+  }
+  free(arena);
+}
+
 
 /*
  * Memory allocation and freeing are controlled by the regular library
- * routines malloc() and free().
+ * routines malloc() and free(), unless an arena is in use.  Objects from
+ * an arena are not freed individually.  Some may have been obtained from
+ * malloc() before the arena was attached, so each one is checked.
  */
 
 GLOBAL(void *)
 jpeg_get_small (j_common_ptr cinfo, size_t sizeofobject)
 {
+  jpeg_arena_ptr arena = ARENA_OF(cinfo);
+
+  if (arena != NULL)
+    return arena_alloc(arena, sizeofobject);
   return (void *) malloc(sizeofobject);
 }
 
 GLOBAL(void)
 jpeg_free_small (j_common_ptr cinfo, void * object, size_t sizeofobject)
 {
-  free(object);
+  jpeg_arena_ptr arena = ARENA_OF(cinfo);
+
+  if (arena == NULL || ! arena_owns(arena, object))
+    free(object);
 }
 
 
@@ -54,29 +237,142 @@ jpeg_free_small (j_common_ptr cinfo, void * object, size_t sizeofobject)
 GLOBAL(void FAR *)
 jpeg_get_large (j_common_ptr cinfo, size_t sizeofobject)
 {
-  return (void FAR *) malloc(sizeofobject);
+  return (void FAR *) jpeg_get_small(cinfo, sizeofobject);
 }
 
 GLOBAL(void)
 jpeg_free_large (j_common_ptr cinfo, void FAR * object, size_t sizeofobject)
 {
-  free(object);
+  jpeg_free_small(cinfo, (void *) object, sizeofobject);
 }
 
 
 /*
  * This routine computes the total memory space available for allocation.
- * Here we always say, "we got all you want bud!"
+ * Unless there is a limit to keep to, we say "we got all you want bud!"
  */
 
 GLOBAL(long)
 jpeg_mem_available (j_common_ptr cinfo, long min_bytes_needed,
 		    long max_bytes_needed, long already_allocated)
 {
+#ifdef USE_MMAP_BACKING_STORE
+  if (cinfo->mem->max_memory_to_use > 0)
+    return cinfo->mem->max_memory_to_use - already_allocated;
+#endif
   return max_bytes_needed;
 }
 
 
+#ifdef USE_MMAP_BACKING_STORE
+
+/*
+ * Backing store (temporary file) management.
+ * Each backing-store object is a temporary file, unlinked as soon as it is
+ * created and mapped into memory as a whole.  Reading and writing are then
+ * just copies; the kernel pages the data to and from the file as needed,
+ * so only the strips being worked on have to stay resident.
+ */
+
+#ifndef TEMP_DIRECTORY		/* can override from jconfig.h or Makefile */
+#define TEMP_DIRECTORY  "/tmp"	/* used if TMPDIR is not set */
+#endif
+
+
+/* Drop the whole pages of a range that has been copied from our address
+ * space.  Written data stays in the file (or the page cache), and this
+ * keeps the resident size down to the in-memory buffers.
+ */
+
+LOCAL(void)
+release_pages (backing_store_ptr info, long file_offset, long byte_count)
+{
+  long page = (long) sysconf(_SC_PAGESIZE);
+  long start = (file_offset + page - 1) / page * page;
+  long end = (file_offset + byte_count) / page * page;
+
+  if (end > start)
+    madvise((void *) (info->map_base + start), (size_t) (end - start),
+	    MADV_DONTNEED);
+}
+
+
+METHODDEF(void)
+read_backing_store (j_common_ptr cinfo, backing_store_ptr info,
+		    void FAR * buffer_address,
+		    long file_offset, long byte_count)
+{
+  if (file_offset < 0 || byte_count > info->map_size - file_offset)
+    ERREXIT(cinfo, JERR_TFILE_READ);
+  MEMCOPY(buffer_address, info->map_base + file_offset, byte_count);
+  release_pages(info, file_offset, byte_count);
+}
+
+
+METHODDEF(void)
+write_backing_store (j_common_ptr cinfo, backing_store_ptr info,
+		     void FAR * buffer_address,
+		     long file_offset, long byte_count)
+{
+  if (file_offset < 0 || byte_count > info->map_size - file_offset)
+    ERREXIT(cinfo, JERR_TFILE_WRITE);
+  MEMCOPY(info->map_base + file_offset, buffer_address, byte_count);
+  release_pages(info, file_offset, byte_count);
+}
+
+
+METHODDEF(void)
+close_backing_store (j_common_ptr cinfo, backing_store_ptr info)
+{
+  munmap((void *) info->map_base, (size_t) info->map_size);
+  close(info->temp_fd);
+  TRACEMSS(cinfo, 1, JTRC_TFILE_CLOSE, info->temp_name);
+}
+
+
+/*
+ * Initial opening of a backing-store object.  The file gets its full size
+ * up front, so the mapping never has to change.
+ */
+
+GLOBAL(void)
+jpeg_open_backing_store (j_common_ptr cinfo, backing_store_ptr info,
+			 long total_bytes_needed)
+{
+  const char * tmpdir = NULL;
+  void * base;
+
+#ifndef NO_GETENV
+  tmpdir = getenv("TMPDIR");
+#endif
+  if (tmpdir == NULL || tmpdir[0] == '\0' ||
+      strlen(tmpdir) > TEMP_NAME_LENGTH - sizeof("/JPGXXXXXX"))
+    tmpdir = TEMP_DIRECTORY;
+  sprintf(info->temp_name, "%s/JPGXXXXXX", tmpdir);
+
+  if ((info->temp_fd = mkstemp(info->temp_name)) < 0)
+    ERREXITS(cinfo, JERR_TFILE_CREATE, info->temp_name);
+  unlink(info->temp_name);	/* goes away when closed, even on a crash */
+  if (ftruncate(info->temp_fd, (off_t) total_bytes_needed) != 0) {
+    close(info->temp_fd);
+    ERREXITS(cinfo, JERR_TFILE_CREATE, info->temp_name);
+  }
+  base = mmap(NULL, (size_t) total_bytes_needed, PROT_READ | PROT_WRITE,
+	      MAP_SHARED, info->temp_fd, 0);
+  if (base == MAP_FAILED) {
+    close(info->temp_fd);
+    ERREXITS(cinfo, JERR_TFILE_CREATE, info->temp_name);
+  }
+  info->map_base = (char FAR *) base;
+  info->map_size = total_bytes_needed;
+  info->read_backing_store = read_backing_store;
+  info->write_backing_store = write_backing_store;
+  info->close_backing_store = close_backing_store;
+  TRACEMSS(cinfo, 1, JTRC_TFILE_OPEN, info->temp_name);
+}
+
+#else /* ! USE_MMAP_BACKING_STORE */
+
 /*
  * Backing store (temporary file) management.
  * Since jpeg_mem_available always promised the moon,
@@ -90,6 +386,8 @@ jpeg_open_backing_store (j_common_ptr cinfo, backing_store_ptr info,
   ERREXIT(cinfo, JERR_NO_BACKING_STORE);
 }
 
+#endif /* USE_MMAP_BACKING_STORE */
+
 
 /*
  * These routines take care of any system-dependent initialization and
@@ -99,7 +397,11 @@ jpeg_open_backing_store (j_common_ptr cinfo, backing_store_ptr info,
 GLOBAL(long)
 jpeg_mem_init (j_common_ptr cinfo)
 {
-  return 0;			/* just set max_memory_to_use to 0 */
+#ifdef DEFAULT_MAX_MEM
+  return DEFAULT_MAX_MEM;
+#else
+  return 0;			/* just set max_memory_to_use to 0, no limit */
+#endif
 }
 
 GLOBAL(void)
@@ -171,12 +171,20 @@ typedef struct backing_store_struct {
   short temp_file;		/* file reference number to temp file */
   FSSpec tempSpec;		/* the FSSpec for the temp file */
   char temp_name[TEMP_NAME_LENGTH]; /* name if it's a file */
+#else
+#ifdef USE_MMAP_BACKING_STORE
+  /* For memory-mapped temp files (jmemnobs.c), we need: */
+  int temp_fd;			/* descriptor of the (unlinked) temp file */
+  char FAR * map_base;		/* where the whole file is mapped */
+  long map_size;		/* size of the file and the mapping */
+  char temp_name[TEMP_NAME_LENGTH]; /* name the temp file had */
 #else
   /* For a typical implementation with temp files, we need: */
   FILE * temp_file;		/* stdio reference to temp file */
   char temp_name[TEMP_NAME_LENGTH]; /* name of temp file */
 #endif
 #endif
+#endif
 } backing_store_info;
 
 
@@ -234,10 +234,20 @@ typedef JMETHOD(void, inverse_DCT_method_ptr,
 		 JCOEFPTR coef_block,
 		 JSAMPARRAY output_buf, JDIMENSION output_col));
 
+/* Same, for num_blocks consecutive blocks of one block row; the output
+ * of each block goes DCT_scaled_size samples to the right of the previous.
+ */
+typedef JMETHOD(void, inverse_DCT_row_method_ptr,
+		(j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		 JBLOCKROW coef_row, JSAMPARRAY output_buf,
+		 JDIMENSION output_col, JDIMENSION num_blocks));
+
 struct jpeg_inverse_dct {
   JMETHOD(void, start_pass, (j_decompress_ptr cinfo));
   /* It is useful to allow each component to have a separate IDCT method. */
   inverse_DCT_method_ptr inverse_DCT[MAX_COMPONENTS];
+  /* Batched form of inverse_DCT, always set up along with it */
+  inverse_DCT_row_method_ptr inverse_DCT_row[MAX_COMPONENTS];
 };
 
 /* Upsampling (note that upsampler must also call color converter) */
@@ -439,6 +439,14 @@ struct jpeg_decompress_struct {
   boolean do_fancy_upsampling;	/* TRUE=apply fancy upsampling */
   boolean do_block_smoothing;	/* TRUE=apply interblock smoothing */
 
+  /* Optional sample mask, for single-component images at full scale only.
+   * It has 8 bytes per DCT block, one per sample row with bit x for column x,
+   * and the blocks in raster order: ceil(image_width/8) by
+   * ceil(image_height/8).  Samples whose bit is clear are output as zero,
+   * the others are forced nonzero.  Blocks with no bit set skip the IDCT.
+   */
+  const UINT8 * block_mask;	/* NULL=no mask */
+
   boolean quantize_colors;	/* TRUE=colormapped output wanted */
   /* the following are ignored if not quantize_colors: */
   J_DITHER_MODE dither_mode;	/* type of color dithering to use */
@@ -757,6 +765,27 @@ struct jpeg_source_mgr {
 
 typedef struct jvirt_sarray_control * jvirt_sarray_ptr;
 typedef struct jvirt_barray_control * jvirt_barray_ptr;
+typedef struct jpeg_arena_control * jpeg_arena_ptr;
+
+/* Memory usage of a JPEG object, as reported by get_stats.  Sizes are the
+ * bytes obtained from the system, including pool overhead; the peaks and
+ * request counts cover the whole life of the object.
+ */
+
+struct jpeg_memory_stats {
+  long current_bytes;		/* all space held now */
+  long peak_bytes;		/* high-water mark of current_bytes */
+  long pool_bytes[JPOOL_NUMPOOLS]; /* space held by each pool now */
+  long pool_peak_bytes[JPOOL_NUMPOOLS]; /* high-water mark of each pool */
+  long small_allocs;		/* number of alloc_small requests */
+  long large_allocs;		/* number of alloc_large requests */
+  /* Peak total size of the virtual arrays, and of their in-memory buffers
+   * (smaller than the arrays when backing store is used).
+   */
+  long virt_sarray_bytes;
+  long virt_barray_bytes;
+  long virt_mem_bytes;
+};
 
 
 struct jpeg_memory_mgr {
@@ -796,6 +825,8 @@ struct jpeg_memory_mgr {
 					    boolean writable));
   JMETHOD(void, free_pool, (j_common_ptr cinfo, int pool_id));
   JMETHOD(void, self_destruct, (j_common_ptr cinfo));
+  JMETHOD(void, get_stats, (j_common_ptr cinfo,
+			    struct jpeg_memory_stats * stats));
 
   /* Limit on memory allocation for this JPEG object.  (Note that this is
    * merely advisory, not a guaranteed maximum; it only affects the space
@@ -806,6 +837,12 @@ struct jpeg_memory_mgr {
 
   /* Maximum allocation request accepted by alloc_large. */
   long max_alloc_chunk;
+
+  /* Arena to take pool memory from, or NULL to use the system allocator.
+   * May be set by outer application after creating the JPEG object; it
+   * must then stay set until the object is destroyed.  See jmemnobs.c.
+   */
+  jpeg_arena_ptr arena;
 };
 
 
@@ -883,6 +920,11 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 #define jpeg_abort		jAbort
 #define jpeg_destroy		jDestroy
 #define jpeg_resync_to_restart	jResyncRestart
+#define jpeg_get_memory_stats	jGetMemStats
+#define jpeg_arena_create	jArenaCreate
+#define jpeg_arena_reset	jArenaReset
+#define jpeg_arena_reserved	jArenaReserved
+#define jpeg_arena_destroy	jArenaDestroy
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 /* Sometimes it is desirable to build with special external names for 12bit, so that 8bit and 12bit
@@ -937,6 +979,11 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 #define jpeg_abort		jpeg_abort_12
 #define jpeg_destroy		jpeg_destroy_12
 #define jpeg_resync_to_restart	jpeg_resync_to_restart_12
+#define jpeg_get_memory_stats	jpeg_get_memory_stats_12
+#define jpeg_arena_create	jpeg_arena_create_12
+#define jpeg_arena_reset	jpeg_arena_reset_12
+#define jpeg_arena_reserved	jpeg_arena_reserved_12
+#define jpeg_arena_destroy	jpeg_arena_destroy_12
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 
@@ -1097,6 +1144,20 @@ EXTERN(void) jpeg_destroy JPP((j_common_ptr cinfo));
 EXTERN(boolean) jpeg_resync_to_restart JPP((j_decompress_ptr cinfo,
 					    int desired));
 
+/* Memory usage statistics of either flavor of JPEG object */
+EXTERN(void) jpeg_get_memory_stats JPP((j_common_ptr cinfo,
+					struct jpeg_memory_stats * stats));
+
+/* Arenas supply pool memory from preallocated slabs, for applications that
+ * decode many small images in turn; see mem->arena.  An arena may be reset
+ * once no JPEG object using it is left, and its slabs are then reused.
+ * jpeg_arena_create returns NULL if out of memory.
+ */
+EXTERN(jpeg_arena_ptr) jpeg_arena_create JPP((size_t slab_size));
+EXTERN(void) jpeg_arena_reset JPP((jpeg_arena_ptr arena));
+EXTERN(size_t) jpeg_arena_reserved JPP((jpeg_arena_ptr arena));
+EXTERN(void) jpeg_arena_destroy JPP((jpeg_arena_ptr arena));
+
 
 /* These marker codes are exported since applications and data source modules
  * are likely to want to use them.
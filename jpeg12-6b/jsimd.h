@@ -0,0 +1,347 @@
+/*
+ * jsimd.h
+ *
+ * This include file contains declarations for the SIMD kernels that
+ * replace some of the portable C routines at run time.  These declarations
+ * are private to the modules that select an implementation (jddctmgr.c and
+ * friends) and to the kernels themselves.
+ *
+ * The kernels are compiled for x86 and x86-64 targets, and for WebAssembly
+ * when the compiler is told it may use SIMD128 (-msimd128, which build.sh
+ * only passes with SIMD=1).  Each one is required to produce results
+ * bit-identical to the C routine it replaces, so the choice of
+ * implementation is never visible in the output.
+ * Define JSIMD_NONE when compiling the library to leave them out entirely.
+ */
+
+#if !defined(JSIMD_NONE) && \
+    (defined(__x86_64__) || defined(_M_X64) || \
+     defined(__i386__) || defined(_M_IX86))
+#define JSIMD_X86
+#endif
+
+#if !defined(JSIMD_NONE) && defined(__wasm_simd128__)
+#define JSIMD_WASM
+#endif
+
+#if defined(JSIMD_X86) || defined(JSIMD_WASM)
+#define JSIMD_ANY		/* some kernels are compiled in */
+#endif
+
+#ifdef JSIMD_X86
+
+/* The kernels for the newer instruction sets are compiled without requiring
+ * the whole library to be built for them; they are only called after the
+ * CPU has been checked at run time.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define JSIMD_TARGET_SSE2  __attribute__((target("sse2")))
+#define JSIMD_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define JSIMD_TARGET_SSE2
+#define JSIMD_TARGET_AVX2
+#endif
+
+/* Instruction set flags returned by jsimd_cpu_features() */
+
+#define JSIMD_SSE2	0x01
+#define JSIMD_AVX2	0x02
+
+#ifdef NEED_12_BIT_NAMES
+#define jsimd_cpu_features		jsimd_cpu_features_12
+#define jpeg_idct_islow_sse2		jpeg_idct_islow_sse2_12
+#define jpeg_idct_islow_avx2		jpeg_idct_islow_avx2_12
+#define jpeg_idct_float_sse2		jpeg_idct_float_sse2_12
+#define jpeg_idct_float_avx2		jpeg_idct_float_avx2_12
+#define jpeg_idct_islow_row_sse2	jpeg_idct_islow_row_sse2_12
+#define jpeg_idct_islow_row_avx2	jpeg_idct_islow_row_avx2_12
+#define jpeg_idct_float_row_sse2	jpeg_idct_float_row_sse2_12
+#define jpeg_idct_float_row_avx2	jpeg_idct_float_row_avx2_12
+#define jpeg_ycc_rgb_sse2		jpeg_ycc_rgb_sse2_12
+#define jpeg_ycc_rgb_avx2		jpeg_ycc_rgb_avx2_12
+#define jpeg_gray_rgb_sse2		jpeg_gray_rgb_sse2_12
+#define jpeg_gray_rgb_avx2		jpeg_gray_rgb_avx2_12
+#define jpeg_h2v1_merged_sse2		jpeg_h2v1_merged_sse2_12
+#define jpeg_h2v1_merged_avx2		jpeg_h2v1_merged_avx2_12
+#define jpeg_h2v2_merged_sse2		jpeg_h2v2_merged_sse2_12
+#define jpeg_h2v2_merged_avx2		jpeg_h2v2_merged_avx2_12
+#define jpeg_h2v1_fancy_sse2		jpeg_h2v1_fancy_sse2_12
+#define jpeg_h2v1_fancy_avx2		jpeg_h2v1_fancy_avx2_12
+#define jpeg_h2v2_fancy_sse2		jpeg_h2v2_fancy_sse2_12
+#define jpeg_h2v2_fancy_avx2		jpeg_h2v2_fancy_avx2_12
+#define jpeg_fdct_islow_quant_sse2	jpeg_fdct_islow_quant_sse2_12
+#define jpeg_fdct_islow_quant_avx2	jpeg_fdct_islow_quant_avx2_12
+#define jpeg_fdct_float_quant_sse2	jpeg_fdct_float_quant_sse2_12
+#define jpeg_fdct_float_quant_avx2	jpeg_fdct_float_quant_avx2_12
+#define jpeg_rgb_ycc_sse2		jpeg_rgb_ycc_sse2_12
+#define jpeg_rgb_ycc_avx2		jpeg_rgb_ycc_avx2_12
+#define jpeg_h2v1_downsample_sse2	jpeg_h2v1_downsample_sse2_12
+#define jpeg_h2v1_downsample_avx2	jpeg_h2v1_downsample_avx2_12
+#define jpeg_h2v2_downsample_sse2	jpeg_h2v2_downsample_sse2_12
+#define jpeg_h2v2_downsample_avx2	jpeg_h2v2_downsample_avx2_12
+#define jpeg_h2v2_smooth_downsample_sse2  jpeg_h2v2_smooth_downsample_sse2_12
+#define jpeg_h2v2_smooth_downsample_avx2  jpeg_h2v2_smooth_downsample_avx2_12
+#endif /* NEED_12_BIT_NAMES */
+
+/* Returns the usable instruction sets, detected once.  The environment
+ * variable JSIMD_FORCENONE=1 disables all kernels and JSIMD_FORCESSE2=1
+ * limits them to SSE2, which is handy for comparing against the C code.
+ */
+EXTERN(int) jsimd_cpu_features JPP((void));
+
+EXTERN(void) jpeg_idct_islow_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_islow_avx2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_float_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_float_avx2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+
+/* Batched forms, see inverse_DCT_row in jpegint.h */
+EXTERN(void) jpeg_idct_islow_row_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JBLOCKROW coef_row, JSAMPARRAY output_buf,
+	 JDIMENSION output_col, JDIMENSION num_blocks));
+EXTERN(void) jpeg_idct_islow_row_avx2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JBLOCKROW coef_row, JSAMPARRAY output_buf,
+	 JDIMENSION output_col, JDIMENSION num_blocks));
+EXTERN(void) jpeg_idct_float_row_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JBLOCKROW coef_row, JSAMPARRAY output_buf,
+	 JDIMENSION output_col, JDIMENSION num_blocks));
+EXTERN(void) jpeg_idct_float_row_avx2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JBLOCKROW coef_row, JSAMPARRAY output_buf,
+	 JDIMENSION output_col, JDIMENSION num_blocks));
+
+/* YCbCr->RGB and gray->RGB conversion of one row, to interleaved RGB.
+ * The kernels only do whole vectors; they return the number of columns
+ * converted and the caller does the rest.
+ */
+EXTERN(JDIMENSION) jpeg_ycc_rgb_sse2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_ycc_rgb_avx2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_gray_rgb_sse2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_gray_rgb_avx2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+
+/* Merged 2h1v and 2h2v upsampling and YCbCr->RGB conversion (jdmerge.c),
+ * from one or two Y rows and the shared Cb and Cr rows.  num_cols counts
+ * output pixels; the kernels only do whole vectors and return the count.
+ */
+EXTERN(JDIMENSION) jpeg_h2v1_merged_sse2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v1_merged_avx2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_merged_sse2
+    JPP((JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1,
+	 JSAMPROW inptr2, JSAMPROW outptr0, JSAMPROW outptr1,
+	 JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_merged_avx2
+    JPP((JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1,
+	 JSAMPROW inptr2, JSAMPROW outptr0, JSAMPROW outptr1,
+	 JDIMENSION num_cols));
+
+/* The general case columns of the fancy 2h1v and 2h2v upsamplers
+ * (jdsample.c).  inptr points to the first column to do, and the columns
+ * on either side are read too; for h2v2, inptr1 is the next nearest row.
+ * The number of columns done is returned.
+ */
+EXTERN(JDIMENSION) jpeg_h2v1_fancy_sse2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v1_fancy_avx2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_fancy_sse2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_fancy_avx2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION num_cols));
+
+/* The integer forward DCT of jfdctint.c followed by the quantization of
+ * forward_DCT in jcdctmgr.c, for num_blocks blocks starting at start_col
+ * of the eight sample rows.  recip is a JSIMD_RECIP_SIZE table, below.
+ */
+EXTERN(void) jpeg_fdct_islow_quant_sse2
+    JPP((JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+	 JDIMENSION start_col, JDIMENSION num_blocks,
+	 const unsigned int * recip));
+EXTERN(void) jpeg_fdct_islow_quant_avx2
+    JPP((JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+	 JDIMENSION start_col, JDIMENSION num_blocks,
+	 const unsigned int * recip));
+
+/* The same for the floating-point FDCT of jfdctflt.c and the quantization
+ * of forward_DCT_float, with the float_divisors table of jcdctmgr.c.
+ */
+EXTERN(void) jpeg_fdct_float_quant_sse2
+    JPP((JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+	 JDIMENSION start_col, JDIMENSION num_blocks,
+	 const FAST_FLOAT * divisors));
+EXTERN(void) jpeg_fdct_float_quant_avx2
+    JPP((JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+	 JDIMENSION start_col, JDIMENSION num_blocks,
+	 const FAST_FLOAT * divisors));
+
+/* RGB->YCbCr conversion of one row of RGB triplets (jccolor.c), to separate
+ * Y, Cb and Cr rows.  Whole vectors only; the number of columns converted
+ * is returned.
+ */
+EXTERN(JDIMENSION) jpeg_rgb_ycc_sse2
+    JPP((JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+	 JSAMPROW outptr2, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_rgb_ycc_avx2
+    JPP((JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+	 JSAMPROW outptr2, JDIMENSION num_cols));
+
+/* The 2h1v and 2h2v downsamplers of jcsample.c, for num_cols output
+ * columns of one output row, starting at an even column so the rounding
+ * bias follows the C code.  The smoothing kernel does the general case
+ * columns: the pointers are advanced to the input pair of the first column
+ * to do, and the columns either side are read too.  The number of output
+ * columns done is returned.
+ */
+EXTERN(JDIMENSION) jpeg_h2v1_downsample_sse2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v1_downsample_avx2
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_downsample_sse2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_downsample_avx2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_smooth_downsample_sse2
+    JPP((JSAMPROW above_ptr, JSAMPROW inptr0, JSAMPROW inptr1,
+	 JSAMPROW below_ptr, JSAMPROW outptr, JDIMENSION num_cols,
+	 int memberscale, int neighscale));
+EXTERN(JDIMENSION) jpeg_h2v2_smooth_downsample_avx2
+    JPP((JSAMPROW above_ptr, JSAMPROW inptr0, JSAMPROW inptr1,
+	 JSAMPROW below_ptr, JSAMPROW outptr, JDIMENSION num_cols,
+	 int memberscale, int neighscale));
+
+#endif /* JSIMD_X86 */
+
+#ifdef JSIMD_WASM
+
+#ifdef NEED_12_BIT_NAMES
+#define jpeg_ycc_rgb_wasm		jpeg_ycc_rgb_wasm_12
+#define jpeg_gray_rgb_wasm		jpeg_gray_rgb_wasm_12
+#define jpeg_h2v1_merged_wasm		jpeg_h2v1_merged_wasm_12
+#define jpeg_h2v2_merged_wasm		jpeg_h2v2_merged_wasm_12
+#define jpeg_h2v1_fancy_wasm		jpeg_h2v1_fancy_wasm_12
+#define jpeg_h2v2_fancy_wasm		jpeg_h2v2_fancy_wasm_12
+#define jpeg_fdct_islow_quant_wasm	jpeg_fdct_islow_quant_wasm_12
+#define jpeg_fdct_float_quant_wasm	jpeg_fdct_float_quant_wasm_12
+#define jpeg_rgb_ycc_wasm		jpeg_rgb_ycc_wasm_12
+#define jpeg_h2v1_downsample_wasm	jpeg_h2v1_downsample_wasm_12
+#define jpeg_h2v2_downsample_wasm	jpeg_h2v2_downsample_wasm_12
+#define jpeg_h2v2_smooth_downsample_wasm  jpeg_h2v2_smooth_downsample_wasm_12
+#endif /* NEED_12_BIT_NAMES */
+
+/* Same as the x86 kernels */
+EXTERN(JDIMENSION) jpeg_ycc_rgb_wasm
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_gray_rgb_wasm
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v1_merged_wasm
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_merged_wasm
+    JPP((JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1,
+	 JSAMPROW inptr2, JSAMPROW outptr0, JSAMPROW outptr1,
+	 JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v1_fancy_wasm
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_fancy_wasm
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION num_cols));
+EXTERN(void) jpeg_fdct_islow_quant_wasm
+    JPP((JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+	 JDIMENSION start_col, JDIMENSION num_blocks,
+	 const unsigned int * recip));
+EXTERN(void) jpeg_fdct_float_quant_wasm
+    JPP((JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+	 JDIMENSION start_col, JDIMENSION num_blocks,
+	 const FAST_FLOAT * divisors));
+EXTERN(JDIMENSION) jpeg_rgb_ycc_wasm
+    JPP((JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+	 JSAMPROW outptr2, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v1_downsample_wasm
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_downsample_wasm
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION num_cols));
+EXTERN(JDIMENSION) jpeg_h2v2_smooth_downsample_wasm
+    JPP((JSAMPROW above_ptr, JSAMPROW inptr0, JSAMPROW inptr1,
+	 JSAMPROW below_ptr, JSAMPROW outptr, JDIMENSION num_cols,
+	 int memberscale, int neighscale));
+
+#endif /* JSIMD_WASM */
+
+#ifdef JSIMD_ANY
+
+/* The color conversion kernels avoid the jdcolor.c tables by splitting each
+ * 16-bit fixed-point constant into a multiple of 2^16 plus a remainder that
+ * fits a signed 16-bit multiplier:
+ *	R = Y + Cr + ((JSIMD_FIX_R * Cr + ONE_HALF) >> 16)
+ *	G = Y - Cr + ((JSIMD_FIX_G_CB * Cb + JSIMD_FIX_G_CR * Cr + ONE_HALF) >> 16)
+ *	B = Y + 2*Cb + ((JSIMD_FIX_B * Cb + ONE_HALF) >> 16)
+ * with Cb and Cr relative to CENTERJSAMPLE.  This gives exactly the same
+ * integers as the table-driven code.
+ */
+#define JSIMD_FIX_R	26345	/* FIX(1.40200) - 65536 */
+#define JSIMD_FIX_G_CB	(-22554) /* -FIX(0.34414) */
+#define JSIMD_FIX_G_CR	18734	/* 65536 - FIX(0.71414) */
+#define JSIMD_FIX_B	(-14942) /* FIX(1.77200) - 131072 */
+
+/* The RGB->YCbCr kernels form the same sums as the jccolor.c tables, with
+ * the constants that do not fit a signed 16-bit multiplier split the same
+ * way:
+ *	Y  = JSIMD_FIX_Y_R * R + (JSIMD_FIX_Y_G + 32767) * G + JSIMD_FIX_Y_B * B
+ *	     + ONE_HALF
+ *	Cb = JSIMD_FIX_CB_R * R + JSIMD_FIX_CB_G * G + 16384 * (B + B)
+ *	     + CBCR_OFFSET + ONE_HALF-1
+ *	Cr = 16384 * (R + R) + JSIMD_FIX_CR_G * G + JSIMD_FIX_CR_B * B
+ *	     + CBCR_OFFSET + ONE_HALF-1
+ * each then shifted down by 16.
+ */
+#define JSIMD_FIX_Y_R	19595	/* FIX(0.29900) */
+#define JSIMD_FIX_Y_G	5703	/* FIX(0.58700) - 32767 */
+#define JSIMD_FIX_Y_B	7471	/* FIX(0.11400) */
+#define JSIMD_FIX_CB_R	(-11059) /* -FIX(0.16874) */
+#define JSIMD_FIX_CB_G	(-21709) /* -FIX(0.33126) */
+#define JSIMD_FIX_CR_G	(-27439) /* -FIX(0.41869) */
+#define JSIMD_FIX_CR_B	(-5329)	/* -FIX(0.08131) */
+
+/* The smoothing downsampler kernels weight 16-bit sums by memberscale and
+ * twice neighscale, so they take smoothing factors up to this; the C code
+ * is used above it.
+ */
+#define JSIMD_MAX_SMOOTHING  100
+
+/* The forward DCT kernels quantize by reciprocal multiplication.  For a
+ * divisor d, with s = MAX(33, 19 + ceil(log2(d))), the table has
+ *	d >> 1,  m = ceil(2^s / d)  and  p = 2^(64-s)
+ * in three runs of DCTSIZE2 unsigned 32-bit entries, in natural order.
+ * Writing mulhi(a, b) for the high 32 bits of the 64-bit product,
+ *	mulhi(mulhi(x, m), p) == x / d	for any 0 <= x < 2^19
+ * which covers x = |coef| + (d >> 1) for the outputs of the 12-bit FDCT.
+ * So the quotient is exactly the one of the division in jcdctmgr.c.
+ */
+#define JSIMD_RECIP_SIZE  (3 * DCTSIZE2)
+
+#endif /* JSIMD_ANY */
@@ -0,0 +1,93 @@
+/*
+ * jsimdcpu.c
+ *
+ * This file contains the run-time detection of the instruction sets used
+ * by the SIMD kernels declared in jsimd.h.  The detection is done once,
+ * the first time any module asks for it.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jsimd.h"
+
+#ifdef JSIMD_X86
+
+/* The features are cached in an atomic, as decoders and encoders can be
+ * started on several threads at once.  Every thread computes the same
+ * value, so relaxed loads and stores are enough.
+ */
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+/* Aligned int accesses are atomic on x86, volatile keeps them as single
+ * loads and stores (MSVC has no stdatomic.h before C11 support) */
+static volatile int simd_features = -1;	/* -1 until the first call */
+#define LOAD_FEATURES()		(simd_features)
+#define STORE_FEATURES(value)	(simd_features = (value))
+#else
+#include <stdatomic.h>
+static atomic_int simd_features = -1;	/* -1 until the first call */
+#define LOAD_FEATURES()  \
+  atomic_load_explicit(&simd_features, memory_order_relaxed)
+#define STORE_FEATURES(value)  \
+  atomic_store_explicit(&simd_features, (value), memory_order_relaxed)
+#endif
+
+
+LOCAL(int)
+detect_features (void)
+{
+  int features = 0;
+
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    features |= JSIMD_SSE2;
+  if (__builtin_cpu_supports("avx2"))
+    features |= JSIMD_AVX2;
+#elif defined(_MSC_VER)
+  int regs[4];
+
+  __cpuid(regs, 1);
+  if (regs[3] & (1 << 26))
+    features |= JSIMD_SSE2;
+  /* AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0) */
+  if ((regs[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6) {
+    __cpuidex(regs, 7, 0);
+    if (regs[1] & (1 << 5))
+      features |= JSIMD_AVX2;
+  }
+#endif
+
+  /* AVX2 kernels may use SSE2 helpers */
+  if (! (features & JSIMD_SSE2))
+    features = 0;
+  return features;
+}
+
+
+LOCAL(boolean)
+env_flag (const char * name)
+{
+  const char * value = getenv(name);
+  return (value != NULL && value[0] == '1');
+}
+
+
+GLOBAL(int)
+jsimd_cpu_features (void)
+{
+  int features = LOAD_FEATURES();
+
+  if (features < 0) {
+    features = detect_features();
+    if (env_flag("JSIMD_FORCENONE"))
+      features = 0;
+    else if (env_flag("JSIMD_FORCESSE2"))
+      features &= JSIMD_SSE2;
+    STORE_FEATURES(features);
+  }
+  return features;
+}
+
+#endif /* JSIMD_X86 */
@@ -1,7 +1,19 @@
 #include <cstdint>
 #include <csetjmp>
+#ifdef __EMSCRIPTEN__
 #include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE // Native build, see jpeg12enc.cpp
+#endif
 #include <cstring>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <system_error>
+#include <chrono>
 
 #include "json.hpp"
 #define PACKER
@@ -12,6 +24,7 @@ extern "C"
 {
 #include "jpeg12-6b/jpeglib.h"
 #include "jpeg12-6b/jerror.h"
+#include "jpeg12-6b/jchuff.h"
 }
 
 // The exported functions
@@ -25,10 +38,108 @@ extern "C"
     // On failure, the json.message contains the error message
     EMSCRIPTEN_KEEPALIVE
     char *decode(uint8_t *, size_t, uint16_t *, size_t);
+
+    // Same as decode, and also returns the Zen validity mask in a separate buffer
+    // The last argument is a combination of the ZEN_MASK options below
+    // Pixels are all valid if there is no Zen chunk
+    EMSCRIPTEN_KEEPALIVE
+    char *decodewithmask(uint8_t *, size_t, uint16_t *, size_t, uint8_t *, size_t, int);
+
+    // Returns a json string with the memory used by the last decode, decodewithmask or getcoefficients
+    // call on this thread; transcodes and transforms leave it unchanged
+    EMSCRIPTEN_KEEPALIVE
+    char *getmemorystats();
+
+    // Reads the quantized DCT coefficients and the quantization tables, without the IDCT
+    // Returns a json string with the block layout of each component
+    // On failure, the json.error contains the error message
+    EMSCRIPTEN_KEEPALIVE
+    char *getcoefficients(uint8_t *, size_t, int16_t *, size_t, uint16_t *, size_t);
+
+    // Encodes 12 bit pixels, interleaved by pixel, as a JPEG12 in the output buffer
+    // Arguments are pixels, width, height, number of components, quality, output buffer and size
+    // Returns a json string with the JPEG size in outputSize
+    // If the output buffer is too small, the json.error is set and outputSize is the size needed
+    EMSCRIPTEN_KEEPALIVE
+    char *encode(uint16_t *, int, int, int, int, uint8_t *, size_t);
+
+    // Same as encode, and also writes a Zen chunk with the validity mask
+    // The mask buffer is in the decodewithmask format selected by the options, only ZEN_MASK_BYTES applies
+    // If the mask is null, pixels with any component not zero are valid
+    // Arguments are as for encode, with the mask, mask size and options before the output buffer
+    EMSCRIPTEN_KEEPALIVE
+    char *encodewithmask(uint16_t *, int, int, int, int, uint8_t *, size_t, int, uint8_t *, size_t);
+
+    // Same as encode, with restart markers and an index of the restart segments
+    // The argument after quality is the restart interval in MCUs, or in MCU rows if negative
+    // The index is in APP4 "Idx" markers before the frame header, with the file offset of the
+    // first byte of each segment as a 32 bit big endian value. It is split over several markers
+    // when there are more than 16382 segments
+    EMSCRIPTEN_KEEPALIVE
+    char *encodewithindex(uint16_t *, int, int, int, int, int, uint8_t *, size_t);
+
+    // Encodes a raster as square tiles, each one a separate JPEG12, on a number of threads
+    // Arguments are pixels, width, height, number of components, quality, tile size, options,
+    // threads, output buffer and size. Zero threads uses all the cores
+    // Tiles are in row major order, clipped at the right and bottom edges, and stored one after
+    // the other in the output. The json.tiles array has the offset and size of each one
+    EMSCRIPTEN_KEEPALIVE
+    char *encodetiles(uint16_t *, int, int, int, int, int, int, int, uint8_t *, size_t);
+
+    // Re-encodes JPEG12 tiles with optimized Huffman tables, without changing the coefficients
+    // Arguments are the tiles one after the other, the size of each one, the tile count,
+    // threads, output buffer and size. Zero threads uses all the cores
+    // Markers are kept, Zen chunks included, and a restart index is rebuilt for the new offsets
+    // A tile that doesn't get smaller or can't be read is stored as is, with json.tiles[].error
+    // set in the second case. The json has the inputSize, outputSize and saved byte totals
+    // The output can be the input buffer, no tile grows so they are moved down in place
+    EMSCRIPTEN_KEEPALIVE
+    char *transcodetiles(uint8_t *, uint32_t *, int, int, uint8_t *, size_t);
+
+    // Crops, flips or rotates a JPEG12 without loss, on its DCT coefficients, with the Zen mask to match
+    // Arguments are the JPEG12 and its size, one of the TRANSFORM codes below, the crop x, y, width
+    // and height in source pixels, output buffer and size. A zero width or height crops to the edge
+    // The crop is applied before the transform, its top left corner is moved up and left to an
+    // MCU boundary. An axis that gets mirrored loses the partial MCU at its far edge, if any
+    // Returns a json string with the new width and height, the crop used and the outputSize
+    EMSCRIPTEN_KEEPALIVE
+    char *transformimage(uint8_t *, size_t, int, int, int, int, int, uint8_t *, size_t);
+
+    // Encodes an image of any height a band of rows at a time, in memory that doesn't depend on
+    // the height: the rows come from one callback and the JPEG12 goes out through another
+    // Arguments are width, height, number of components, quality, rows per band, the row and
+    // output callbacks and a context pointer passed to both
+    // The row callback fills the buffer with count rows starting at first, interleaved by pixel,
+    // the output callback takes the next size bytes. Both return zero on failure
+    // The Huffman tables are fitted to the first band, of at least 64 rows, and extended to code
+    // any 12 bit value
+    // Returns a json string with the outputSize, the time taken and the throughput
+    EMSCRIPTEN_KEEPALIVE
+    char *encodestream(int, int, int, int, int, int (*)(void *, uint16_t *, int, int),
+                       int (*)(void *, const uint8_t *, size_t), void *);
 }
 
 using json = nlohmann::json;
 
+// decodewithmask options
+// The mask is one byte per pixel, 0 or 255, usable as alpha
+// Otherwise it is packed, (width + 7) / 8 bytes per row, with the leftmost pixel in the low bit
+#define ZEN_MASK_BYTES 1
+// Pixel values are left as decoded, instead of zero for invalid and non zero for valid
+#define ZEN_MASK_KEEP_PIXELS 2
+// encodetiles writes a Zen chunk in every tile, pixels with any component not zero are valid
+#define ZEN_CHUNK_FROM_PIXELS 4
+
+// transformimage transforms, as in jpegtran, rotations are clockwise
+#define TRANSFORM_NONE 0
+#define TRANSFORM_FLIP_H 1
+#define TRANSFORM_FLIP_V 2
+#define TRANSFORM_TRANSPOSE 3   // Across the top left to bottom right diagonal
+#define TRANSFORM_TRANSVERSE 4  // Across the other diagonal
+#define TRANSFORM_ROT_90 5
+#define TRANSFORM_ROT_180 6
+#define TRANSFORM_ROT_270 7
+
 struct jpeginfo
 {
     int width;
@@ -97,6 +208,7 @@ static bool isjpeg(uint8_t *data, size_t size, jpeginfo *info)
 
         case 0xc0: // SOF0
         case 0xc1: // SOF1, also baseline
+        case 0xc2: // SOF2, progressive, decode rejects it later
         {
             // Make sure we can read the size
             if (data > last - 2)
@@ -168,6 +280,8 @@ struct JPG12Handle
         JOCTET *buffer;
         size_t size;
     } zenChunk;
+    // Joins the Zen segments when there is more than one
+    std::vector<JOCTET> *zenParts;
 };
 
 static void emitMessage(j_common_ptr cinfo, int msg_level)
@@ -213,10 +327,83 @@ static boolean fill_input_buffer_dec(j_decompress_ptr cinfo)
     return FALSE;
 }
 
+// Source manager for a jpeg that is fully in memory
+static void initSource(jpeg_source_mgr &s, uint8_t *data, size_t size)
+{
+    s.next_input_byte = (JOCTET *)data;
+    s.bytes_in_buffer = size;
+    s.term_source = s.init_source = stub_source_dec;
+    s.skip_input_data = skip_input_data_dec;
+    s.fill_input_buffer = fill_input_buffer_dec;
+    s.resync_to_restart = jpeg_resync_to_restart;
+}
+
+// Destination manager that writes to a caller buffer
+// Once that is full the output goes to a growable buffer, so the total size is still known
+struct MemDestination
+{
+    jpeg_destination_mgr pub;
+    JOCTET *buffer;
+    size_t size;
+    std::vector<JOCTET> spill; // Kept between calls, only grows
+    bool spilling;
+    size_t total; // Set when done
+};
+
+// Called when the current buffer is full, either the caller one or the spill
+static boolean empty_output_buffer_mem(j_compress_ptr cinfo)
+{
+    auto dest = reinterpret_cast<MemDestination *>(cinfo->dest);
+    const size_t used = dest->spilling ? dest->spill.size() : 0;
+    if (dest->spill.size() < used + 4096)
+        dest->spill.resize(std::max(used + 4096, 2 * used));
+    dest->spilling = true;
+    dest->pub.next_output_byte = dest->spill.data() + used;
+    dest->pub.free_in_buffer = dest->spill.size() - used;
+    return TRUE;
+}
+
+static void init_destination_mem(j_compress_ptr cinfo)
+{
+    auto dest = reinterpret_cast<MemDestination *>(cinfo->dest);
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = dest->size;
+    dest->spilling = false;
+    dest->total = 0;
+    // The library expects room for at least one byte
+    if (dest->size == 0)
+        empty_output_buffer_mem(cinfo);
+}
+
+// Bytes written so far
+static size_t bytesWritten(const MemDestination &dest)
+{
+    if (dest.spilling)
+        return dest.size + (dest.pub.next_output_byte - dest.spill.data());
+    return dest.pub.next_output_byte - dest.buffer;
+}
+
+static void term_destination_mem(j_compress_ptr cinfo)
+{
+    auto dest = reinterpret_cast<MemDestination *>(cinfo->dest);
+    dest->total = bytesWritten(*dest);
+}
+
+// Destination manager for a caller buffer, which can be too small
+static void initDestination(MemDestination &d, uint8_t *buffer, size_t size)
+{
+    d.pub.init_destination = init_destination_mem;
+    d.pub.empty_output_buffer = empty_output_buffer_mem;
+    d.pub.term_destination = term_destination_mem;
+    d.buffer = buffer;
+    d.size = size;
+}
+
 //
 // JPEG marker processor, for the Zen app3 marker
 // Can't return error, only works if the Zen chunk is fully in buffer
 // Since this decoder has the whole JPEG in memory, we can just store a pointer
+// Large masks continue in the following Zen segments, which are joined in order
 //
 #define CHUNK_NAME "Zen"
 #define CHUNK_NAME_SIZE 4
@@ -252,73 +439,151 @@ static boolean zenChunkHandler(j_decompress_ptr cinfo)
     len -= static_cast<int>(CHUNK_NAME_SIZE);
 
     auto jh = reinterpret_cast<JPG12Handle *>(cinfo->client_data);
-    // Store a pointer to the Zen chunk in the handler
-    jh->zenChunk.buffer = const_cast<JOCTET *>(src->next_input_byte);
-    jh->zenChunk.size = len;
+    if (!jh->zenChunk.buffer || !jh->zenParts)
+    {
+        // Store a pointer to the Zen chunk in the handler
+        jh->zenChunk.buffer = const_cast<JOCTET *>(src->next_input_byte);
+        jh->zenChunk.size = len;
+    }
+    else
+    {
+        // A continuation, the marker headers are in the way so the parts get copied
+        auto &parts = *jh->zenParts;
+        if (parts.empty())
+            parts.assign(jh->zenChunk.buffer, jh->zenChunk.buffer + jh->zenChunk.size);
+        parts.insert(parts.end(), src->next_input_byte, src->next_input_byte + len);
+        jh->zenChunk.buffer = parts.data();
+        jh->zenChunk.size = parts.size();
+    }
 
     src->bytes_in_buffer -= len;
     src->next_input_byte += len;
     return true;
 }
 
+// Applies one row of a mask unit to up to 8 pixels of nc samples each
+// Pixels with the bit set are forced non zero, the others are zeroed
+template <typename T>
+static inline void apply_mask_row(T *s, unsigned int bits, int cols, int nc)
+{
+    if (bits == 0xff)
+    {
+        for (int i = 0; i < cols * nc; i++)
+            s[i] += (s[i] == 0);
+    }
+    else if (bits == 0)
+        memset(s, 0, cols * nc * sizeof(T));
+    else
+    {
+        for (int x = 0; x < cols; x++, bits >>= 1)
+        {
+            const T keep = T(0) - T(bits & 1); // all ones or zero
+            for (int c = 0; c < nc; c++, s++)
+                *s = (*s + (*s == 0)) & keep;
+        }
+    }
+}
+
 // Apply the mask to the buffer, in place
 // Needs to know the number of channels since the mask is per pixel
+// Works on the 8x8 mask units directly, so full and empty units need no per pixel tests
 template <typename T>
 static void apply_mask(BitMap2D<uint64_t> &mask, T *s, int nc)
 {
-    if (nc == 1)
-    {
-        for (int y = 0; y < mask.getHeight(); y++)
-            for (int x = 0; x < mask.getWidth(); x++)
-            {
-                if (mask.isSet(x, y))
-                { // Non zero pixel
-                    if (*s == 0)
-                        *s = 1;
-                }
-                else
-                { // Zero pixel
-                    if (*s != 0)
-                        *s = 0;
-                }
-                s++;
-            }
-        return;
-    }
+    const int width = mask.getWidth();
+    const int height = mask.getHeight();
+    const size_t linesize = size_t(width) * nc;
 
-    for (int y = 0; y < mask.getHeight(); y++)
-        for (int x = 0; x < mask.getWidth(); x++)
+    for (int uy = 0; uy < mask.getUnitHeight(); uy++)
+    {
+        const int rows = std::min(8, height - uy * 8);
+        for (int ux = 0; ux < mask.getUnitWidth(); ux++)
         {
-            if (mask.isSet(x, y))
-            { // Non zero pixel
-                for (int c = 0; c < nc; c++, s++)
-                {
-                    if (*s == 0)
-                        *s = 1;
-                }
+            const int cols = std::min(8, width - ux * 8);
+            const uint64_t unit = mask.getUnit(ux, uy);
+            T *p = s + uy * 8 * linesize + size_t(ux) * 8 * nc;
+            if (unit == ~uint64_t(0) || unit == 0)
+            { // Same for every row
+                for (int y = 0; y < rows; y++, p += linesize)
+                    apply_mask_row(p, unit ? 0xffu : 0u, cols, nc);
             }
             else
-            { // Zero pixel
-                for (int c = 0; c < nc; c++)
-                    *s++ = 0;
+            {
+                for (int y = 0; y < rows; y++, p += linesize)
+                    apply_mask_row(p, unsigned(unit >> (8 * y)) & 0xff, cols, nc);
             }
         }
+    }
 }
 
-// Unpacks and applies the Zen chunk in place
-static void applyZenChunk(const jpeginfo &info, const JPG12Handle &handle, uint16_t *output)
+// Unpacks the Zen chunk, without the signature, into the mask, which stays all set if the chunk is empty
+// Returns false if the chunk can't be unpacked
+static bool loadZenChunk(const JOCTET *buffer, size_t size, BitMap2D<uint64_t> &bm)
 {
-    BitMap2D<uint64_t> bm(info.width, info.height);
+    if (size == 0)
+        return true;
+
     RLEC3Packer packer;
     bm.set_packer(&packer);
     storage_manager src = {
-        reinterpret_cast<char *>(handle.zenChunk.buffer),
-        handle.zenChunk.size
+        reinterpret_cast<char *>(const_cast<JOCTET *>(buffer)),
+        size
     };
+    bool result = bm.load(&src) != 0;
+    bm.set_packer(nullptr);
+    return result;
+}
+
+// Writes the validity mask in the decodewithmask format, all pixels are valid if there is no mask
+static void storeMask(const BitMap2D<uint64_t> *mask, int width, int height, uint8_t *dst, bool bytes)
+{
+    const int rowbytes = Chunks<8>(width);
+    for (int y = 0; y < height; y++)
+        for (int ux = 0; ux < rowbytes; ux++)
+        {
+            const int cols = std::min(8, width - ux * 8);
+            unsigned int bits = mask ? unsigned(mask->getUnit(ux, y / 8) >> (8 * (y % 8))) : 0xffu;
+            bits &= (1u << cols) - 1;
+            if (!bytes)
+            {
+                *dst++ = uint8_t(bits);
+                continue;
+            }
+            for (int x = 0; x < cols; x++, bits >>= 1)
+                *dst++ = uint8_t(0 - (bits & 1));
+        }
+}
 
-    // load and apply the mask
-    if (bm.load(&src))
-        apply_mask(bm, output, info.num_components);
+// Whole image decode for single band images with a width that is a multiple of 8
+// The raw data interface skips the main and post controllers and the color conversion,
+// the IDCT writes each block row straight into the output buffer
+// Rows past the bottom of the image go to a scratch row
+// The row buffers come from the image pool, jpeg_read_raw_data can longjmp past any destructor
+static bool canDecodeDirect(const jpeg_decompress_struct &cinfo)
+{
+    return cinfo.num_components == 1 && cinfo.image_width % DCTSIZE == 0;
+}
+
+static void decodeDirect(jpeg_decompress_struct &cinfo, uint16_t *output)
+{
+    const size_t linesize = cinfo.output_width;
+    const int lines = cinfo.max_v_samp_factor * cinfo.min_DCT_scaled_size;
+    JSAMPROW scratch = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE, linesize, 1)[0];
+    JSAMPARRAY rows = (JSAMPARRAY)(*cinfo.mem->alloc_small)((j_common_ptr)&cinfo, JPOOL_IMAGE,
+                                                            lines * sizeof(JSAMPROW));
+    JSAMPARRAY planes[1] = {rows};
+
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        for (int i = 0; i < lines; i++)
+        {
+            auto line = cinfo.output_scanline + i;
+            rows[i] = line < cinfo.output_height
+                          ? (JSAMPROW)(output + line * linesize)
+                          : scratch;
+        }
+        jpeg_read_raw_data(&cinfo, planes, lines);
+    }
 }
 
 // These would be double macros, they need to be redefined to use the 12bit version
@@ -332,11 +597,43 @@ static void applyZenChunk(const jpeginfo &info, const JPG12Handle &handle, uint1
     jpeg_CreateDecompress_12((cinfo), JPEG_LIB_VERSION, \
                              (size_t)sizeof(struct jpeg_decompress_struct))
 
+// The decoder memory comes from an arena kept between calls, one per thread
+// It grows to fit the largest image seen, and is reset once the decoder is destroyed
+#define ARENA_SLAB_SIZE (1 << 20)
+
+struct DecoderArena
+{
+    jpeg_arena_ptr ptr = jpeg_arena_create(ARENA_SLAB_SIZE);
+    ~DecoderArena() { jpeg_arena_destroy(ptr); }
+};
+
+static thread_local DecoderArena arena;
+
+// Memory statistics of the last decode or getcoefficients call on this thread
+static thread_local jpeg_memory_stats lastStats;
+
+static void createDecompress(jpeg_decompress_struct &cinfo)
+{
+    jpeg_create_decompress(&cinfo);
+    cinfo.mem->arena = arena.ptr; // malloc is used if the arena could not be created
+}
+
+// saveStats keeps the memory statistics for getmemorystats, the transcoders and transforms don't
+static void destroyDecompress(jpeg_decompress_struct &cinfo, bool saveStats)
+{
+    if (saveStats && cinfo.mem)
+        jpeg_get_memory_stats((j_common_ptr)&cinfo, &lastStats);
+    jpeg_destroy_decompress(&cinfo);
+    if (arena.ptr)
+        jpeg_arena_reset(arena.ptr);
+}
+
 //
-// Decodes the JPEG12 data into a buffer
+// Decodes the JPEG12 data into a buffer, and the Zen mask into another one if mask is not null
 // Returns a json string containing either the error message or the info about the decoded image
 //
-char *decode(uint8_t *jpeg12, size_t size, uint16_t *output, size_t outsize)
+static char *decodeImage(uint8_t *jpeg12, size_t size, uint16_t *output, size_t outsize,
+                         uint8_t *mask, size_t masksize, int options)
 {
     // Get the info before we start
     jpeginfo info = {};
@@ -360,34 +657,52 @@ char *decode(uint8_t *jpeg12, size_t size, uint16_t *output, size_t outsize)
         return strdup(j.dump().c_str());
     }
 
+    const bool maskBytes = (options & ZEN_MASK_BYTES) != 0;
+    const bool keepPixels = mask && (options & ZEN_MASK_KEEP_PIXELS);
+    size_t expected_masksize = size_t(info.height) * (maskBytes ? info.width : Chunks<8>(info.width));
+    if (mask && expected_masksize != masksize)
+    {
+        json j = {
+            {"error", "Mask buffer size mismatch"},
+            {"maskSize", expected_masksize},
+        };
+        return strdup(j.dump().c_str());
+    }
+
     struct jpeg_decompress_struct cinfo;
+    std::unique_ptr<BitMap2D<uint64_t>> zenMask; // Outside of the setjmp scope
+    std::vector<JOCTET> zenParts;
+    json j = {
+        {"width", info.width},
+        {"height", info.height},
+        {"numComponents", info.num_components},
+        {"dataPrecision", info.data_precision}
+    };
     JPG12Handle handle;
     handle.zenChunk.buffer = nullptr;
     memset(&handle, 0, sizeof(handle));
     jpeg_error_mgr jerr;
     memset(&jerr, 0, sizeof(jerr));
     handle.message = info.error; // reuse the info for the error message
+    handle.zenParts = &zenParts;
 
-    struct jpeg_source_mgr s = {(JOCTET *)jpeg12, size};
+    struct jpeg_source_mgr s;
     cinfo.err = jpeg_std_error(&jerr);
     jerr.error_exit = errorExit;
     jerr.emit_message = emitMessage;
 
-    s.term_source = s.init_source = stub_source_dec;
-    s.skip_input_data = skip_input_data_dec;
-    s.fill_input_buffer = fill_input_buffer_dec;
-    s.resync_to_restart = jpeg_resync_to_restart;
+    initSource(s, jpeg12, size);
     cinfo.client_data = &handle;
 
     if (setjmp(handle.setjmp_buffer))
     {
-        jpeg_destroy_decompress(&cinfo);
+        destroyDecompress(cinfo, true);
         return nullptr;
         json j = {{"error", info.error}};
         return strdup(j.dump().c_str());
     }
 
-    jpeg_create_decompress(&cinfo);
+    createDecompress(cinfo);
     cinfo.src = &s;
     // This is the only marker we are interested in, saves the pointer and size
     // If present, it does get called in the read_header, before the data is decoded
@@ -403,7 +718,7 @@ char *decode(uint8_t *jpeg12, size_t size, uint16_t *output, size_t outsize)
 
     if (0 != strlen(info.error))
     {
-        jpeg_destroy_decompress(&cinfo);
+        destroyDecompress(cinfo, true);
         json j = {{"error", info.error}};
         return strdup(j.dump().c_str());
     }
@@ -412,43 +727,1429 @@ char *decode(uint8_t *jpeg12, size_t size, uint16_t *output, size_t outsize)
     // It is faster than JDCT_ISLOW and almost as fast as JDCT_IFAST
     cinfo.dct_method = JDCT_FLOAT;
 
+#ifndef IGNORE_ZEN_CHUNK
+    // Flag the caller that the zen chunk was detected and processed
+    if (handle.zenChunk.buffer)
+    {
+        j["zenChunkSize"] = handle.zenChunk.size;
+        zenMask.reset(new BitMap2D<uint64_t>(info.width, info.height));
+        if (!loadZenChunk(handle.zenChunk.buffer, handle.zenChunk.size, *zenMask))
+            zenMask.reset(); // Not usable, ignore it
+
+        // A tile with no valid pixels is all zeros, the scan data is not even read
+        // unless the caller asked for the pixels as they are
+        const bool empty = zenMask && zenMask->isEmpty();
+        j["zenMaskEmpty"] = empty;
+        if (empty && !keepPixels)
+        {
+            destroyDecompress(cinfo, true);
+            memset(output, 0, outsize);
+            if (mask)
+                storeMask(zenMask.get(), info.width, info.height, mask, maskBytes);
+            return strdup(j.dump().c_str());
+        }
+    }
+
+    // Single band images get the mask applied by the IDCT, which skips fully masked blocks
+    // The 64 bit units are little endian, so each one is 8 bytes with one block row per byte
+    if (zenMask && !keepPixels && info.num_components == 1)
+        cinfo.block_mask = reinterpret_cast<const UINT8 *>(zenMask->data());
+#endif
+
     // Decode and return the info
+    cinfo.raw_data_out = canDecodeDirect(cinfo);
     jpeg_start_decompress(&cinfo);
-    auto linesize = info.width * info.num_components;
-    while (cinfo.output_scanline < cinfo.output_height)
+    if (cinfo.raw_data_out)
+        decodeDirect(cinfo, output);
+    else
     {
-        auto rp = (JSAMPROW)(output + cinfo.output_scanline * linesize);
-        jpeg_read_scanlines(&cinfo, &rp, 1);
+        auto linesize = info.width * info.num_components;
+        while (cinfo.output_scanline < cinfo.output_height)
+        {
+            auto rp = (JSAMPROW)(output + cinfo.output_scanline * linesize);
+            jpeg_read_scanlines(&cinfo, &rp, 1);
+        }
     }
 
     jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
+    destroyDecompress(cinfo, true);
+
+#ifndef IGNORE_ZEN_CHUNK
+    // Multi band images get the mask applied after decoding
+    if (zenMask && !keepPixels && info.num_components != 1)
+        apply_mask(*zenMask, output, info.num_components);
+#endif
+
+    if (mask)
+        storeMask(zenMask.get(), info.width, info.height, mask, maskBytes);
 
     // Done, return the info, no error
+    return strdup(j.dump().c_str());
+}
+
+char *decode(uint8_t *jpeg12, size_t size, uint16_t *output, size_t outsize)
+{
+    return decodeImage(jpeg12, size, output, outsize, nullptr, 0, 0);
+}
+
+char *decodewithmask(uint8_t *jpeg12, size_t size, uint16_t *output, size_t outsize,
+                     uint8_t *mask, size_t masksize, int options)
+{
+    return decodeImage(jpeg12, size, output, outsize, mask, masksize, options);
+}
+//
+// Reads the quantized DCT coefficients of a JPEG12 image, skipping the IDCT and everything after it
+// The coefficient buffer holds the components one after the other, each one as heightInBlocks rows
+// of widthInBlocks blocks, with the 64 coefficients of a block in natural (row major) order
+// The quant buffer gets the 64 entry quantization table of each component, also in natural order
+// Both sizes are in bytes. If they don't match, the error json includes the expected sizes
+// Progressive images are supported, the coefficients are those after the last scan
+//
+char *getcoefficients(uint8_t *jpeg12, size_t size, int16_t *coefs, size_t coefsize,
+                      uint16_t *quant, size_t quantsize)
+{
+    jpeginfo info = {};
+    if (!isjpeg(jpeg12, size, &info))
+    {
+        json j = {{"error", info.error}};
+        return strdup(j.dump().c_str());
+    }
+
+    if (info.data_precision != 12)
+    {
+        json j = {{"error", "JPEG data precision not 12 bits"}};
+        return strdup(j.dump().c_str());
+    }
+
+    struct jpeg_decompress_struct cinfo;
+    JPG12Handle handle;
+    memset(&handle, 0, sizeof(handle));
+    jpeg_error_mgr jerr;
+    memset(&jerr, 0, sizeof(jerr));
+    handle.message = info.error;
+
+    struct jpeg_source_mgr s;
+    cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = errorExit;
+    jerr.emit_message = emitMessage;
+
+    initSource(s, jpeg12, size);
+    cinfo.client_data = &handle;
+
+    if (setjmp(handle.setjmp_buffer))
+    {
+        destroyDecompress(cinfo, true);
+        json j = {{"error", info.error}};
+        return strdup(j.dump().c_str());
+    }
+
+    createDecompress(cinfo);
+    cinfo.src = &s;
+    jpeg_read_header(&cinfo, TRUE);
+
+    // The block layout is known once the header is read
+    size_t ncoefs = 0;
+    json components = json::array();
+    for (int ci = 0; ci < cinfo.num_components; ci++)
+    {
+        const jpeg_component_info *compptr = cinfo.comp_info + ci;
+        components.push_back({
+            {"widthInBlocks", compptr->width_in_blocks},
+            {"heightInBlocks", compptr->height_in_blocks},
+            {"hSampFactor", compptr->h_samp_factor},
+            {"vSampFactor", compptr->v_samp_factor},
+            {"offset", ncoefs},
+        });
+        ncoefs += size_t(compptr->width_in_blocks) * compptr->height_in_blocks * DCTSIZE2;
+    }
+
     json j = {
         {"width", info.width},
         {"height", info.height},
         {"numComponents", info.num_components},
-        {"dataPrecision", info.data_precision}
+        {"dataPrecision", info.data_precision},
     };
 
-#ifndef IGNORE_ZEN_CHUNK
-    // Flag the caller that the zen chunk was detected and processed
-    if (handle.zenChunk.buffer)
-        j["zenChunkSize"] = handle.zenChunk.size;
-    // If the zen chunk is present
-    if (handle.zenChunk.buffer)
+    const size_t expected_coefsize = ncoefs * sizeof(int16_t);
+    const size_t expected_quantsize = size_t(cinfo.num_components) * DCTSIZE2 * sizeof(uint16_t);
+    if (coefsize != expected_coefsize || quantsize != expected_quantsize)
     {
-        if (handle.zenChunk.size > 0) // Not empty
-            applyZenChunk(info, handle, output);
-        else
-        { // present but empty zen chunk, force all values non-zero
-            for (size_t i = 0; i < outsize / 2; i++)
-                if (output[i] == 0)
-                    output[i] = 1;
+        destroyDecompress(cinfo, true);
+        j["error"] = "Output buffer size mismatch";
+        j["coefficientsSize"] = expected_coefsize;
+        j["quantSize"] = expected_quantsize;
+        return strdup(j.dump().c_str());
+    }
+
+    jvirt_barray_ptr *coef_arrays = jpeg_read_coefficients(&cinfo);
+
+    for (int ci = 0; ci < cinfo.num_components; ci++)
+    {
+        jpeg_component_info *compptr = cinfo.comp_info + ci;
+        int16_t *dst = coefs + components[ci]["offset"].get<size_t>();
+        const size_t rowsize = size_t(compptr->width_in_blocks) * DCTSIZE2;
+        for (JDIMENSION row = 0; row < compptr->height_in_blocks; row++)
+        {
+            JBLOCKARRAY blocks = (*cinfo.mem->access_virt_barray)(
+                (j_common_ptr)&cinfo, coef_arrays[ci], row, 1, FALSE);
+            memcpy(dst, blocks[0], rowsize * sizeof(JCOEF));
+            dst += rowsize;
         }
+
+        // The table latched for the scans, or the current one if the component had no scan
+        const JQUANT_TBL *qtbl = compptr->quant_table
+                                     ? compptr->quant_table
+                                     : cinfo.quant_tbl_ptrs[compptr->quant_tbl_no];
+        if (!qtbl)
+            ERREXIT1(&cinfo, JERR_NO_QUANT_TABLE, compptr->quant_tbl_no);
+        memcpy(quant + ci * DCTSIZE2, qtbl->quantval, DCTSIZE2 * sizeof(uint16_t));
+        components[ci]["quantTable"] = compptr->quant_tbl_no;
     }
-#endif
 
+    jpeg_finish_decompress(&cinfo);
+    destroyDecompress(cinfo, true);
+
+    j["components"] = components;
     return strdup(j.dump().c_str());
-}
\ No newline at end of file
+}
+
+// Builds the Zen mask from a caller mask in the decodewithmask format, a byte or a bit per pixel,
+// or if there is no mask from the pixels, where those with any component not zero are valid
+// Pixel rows are linesize samples apart. Bits past the right and bottom edges stay set
+// Returns true if all pixels are valid
+static bool buildZenMask(BitMap2D<uint64_t> &bm, const uint16_t *pixels, size_t linesize,
+                         int num_components, const uint8_t *mask, bool bytes)
+{
+    const int width = bm.getWidth();
+    const int height = bm.getHeight();
+    const int rowbytes = Chunks<8>(width);
+    bool full = true;
+    for (int y = 0; y < height; y++)
+        for (int ux = 0; ux < rowbytes; ux++)
+        {
+            const int cols = std::min(8, width - ux * 8);
+            unsigned int bits = 0;
+            if (mask && !bytes)
+                bits = mask[size_t(y) * rowbytes + ux];
+            else if (mask)
+            {
+                const uint8_t *m = mask + size_t(y) * width + ux * 8;
+                for (int x = 0; x < cols; x++)
+                    bits |= unsigned(m[x] != 0) << x;
+            }
+            else
+            {
+                const uint16_t *p = pixels + size_t(y) * linesize + ux * 8 * num_components;
+                for (int x = 0; x < cols; x++)
+                    for (int c = 0; c < num_components; c++)
+                        bits |= unsigned(*p++ != 0) << x;
+            }
+            bits |= 0xffu << cols; // Past the right edge
+            bits &= 0xff;
+            full = full && bits == 0xff;
+
+            const int shift = 8 * (y % 8);
+            const uint64_t unit = bm.getUnit(ux, y / 8) & ~(uint64_t(0xff) << shift);
+            bm.setUnit(ux, y / 8, unit | (uint64_t(bits) << shift));
+        }
+    return full;
+}
+
+// Packs the Zen mask as the payload of the APP3 marker, signature included
+// An empty payload, just the signature, means all pixels are valid
+static void packZenChunk(BitMap2D<uint64_t> &bm, bool full, std::vector<char> &chunk)
+{
+    chunk.assign(CHUNK_NAME, CHUNK_NAME + CHUNK_NAME_SIZE);
+    if (full)
+        return;
+
+    // The packer needs room for the worst case
+    const size_t N = bm.size();
+    chunk.resize(CHUNK_NAME_SIZE + 1 + N + N / 256);
+    RLEC3Packer packer;
+    bm.set_packer(&packer);
+    storage_manager dst = {chunk.data() + CHUNK_NAME_SIZE, chunk.size() - CHUNK_NAME_SIZE};
+    bm.store(&dst);
+    bm.set_packer(nullptr);
+    chunk.resize(CHUNK_NAME_SIZE + dst.size);
+}
+
+// A marker segment holds up to 65533 bytes, a larger Zen chunk is split
+// over consecutive APP3 segments, each one starting with the signature
+static void writeZenChunk(j_compress_ptr cinfo, const std::vector<char> &chunk)
+{
+    const size_t max_part = 65533 - CHUNK_NAME_SIZE;
+    size_t offset = CHUNK_NAME_SIZE;
+    do
+    {
+        const size_t len = std::min(max_part, chunk.size() - offset);
+        jpeg_write_m_header(cinfo, JPEG_APP0 + 3, static_cast<unsigned int>(CHUNK_NAME_SIZE + len));
+        for (size_t i = 0; i < CHUNK_NAME_SIZE; i++)
+            jpeg_write_m_byte(cinfo, chunk[i]);
+        for (size_t i = 0; i < len; i++)
+            jpeg_write_m_byte(cinfo, chunk[offset + i]);
+        offset += len;
+    } while (offset < chunk.size());
+}
+
+// The restart index, APP4 segments with a signature and the offsets of the restart segments
+#define INDEX_NAME "Idx"
+#define INDEX_NAME_SIZE 4
+#define INDEX_PART_ENTRIES ((65533 - INDEX_NAME_SIZE) / 4)
+
+// Writes the restart index with zero offsets, keeping the position of the offsets in each segment
+static void writeRestartIndex(j_compress_ptr cinfo, const MemDestination &dest, size_t segments,
+                              std::vector<size_t> &parts)
+{
+    parts.clear();
+    for (size_t done = 0; done < segments; done += INDEX_PART_ENTRIES)
+    {
+        const size_t n = std::min<size_t>(INDEX_PART_ENTRIES, segments - done);
+        jpeg_write_m_header(cinfo, JPEG_APP0 + 4, static_cast<unsigned int>(INDEX_NAME_SIZE + 4 * n));
+        for (size_t i = 0; i < INDEX_NAME_SIZE; i++)
+            jpeg_write_m_byte(cinfo, INDEX_NAME[i]);
+        parts.push_back(bytesWritten(dest));
+        for (size_t i = 0; i < 4 * n; i++)
+            jpeg_write_m_byte(cinfo, 0);
+    }
+}
+
+// Fills in the restart index, from the restart markers found in the entropy coded data
+// The first segment starts right after the SOS header, the others after each RSTn
+// Returns false if the JPEG is not in one piece or the segment count doesn't match
+static bool patchRestartIndex(MemDestination &dest, size_t segments, const std::vector<size_t> &parts)
+{
+    JOCTET *data = dest.total <= dest.size ? dest.buffer : dest.size == 0 ? dest.spill.data() : nullptr;
+    if (!data)
+        return false;
+    const size_t total = dest.total;
+
+    // Skip the marker segments, up to the end of the SOS header
+    size_t pos = 2;
+    for (;;)
+    {
+        if (pos + 4 > total || data[pos] != 0xff)
+            return false;
+        const int marker = data[pos + 1];
+        pos += 2 + (size_t(data[pos + 2]) << 8 | data[pos + 3]);
+        if (marker == 0xda) // SOS
+            break;
+    }
+
+    std::vector<size_t> offsets(1, pos);
+    while (pos + 1 < total)
+    {
+        auto p = static_cast<JOCTET *>(memchr(data + pos, 0xff, total - pos - 1));
+        if (!p)
+            break;
+        pos = p - data + 2;
+        if (p[1] >= JPEG_RST0 && p[1] <= JPEG_RST0 + 7)
+            offsets.push_back(pos);
+        else if (p[1] != 0) // Not a stuffed byte, the EOI
+            break;
+    }
+    if (offsets.size() != segments)
+        return false;
+
+    for (size_t k = 0; k < segments; k++)
+    {
+        JOCTET *entry = data + parts[k / INDEX_PART_ENTRIES] + 4 * (k % INDEX_PART_ENTRIES);
+        for (int i = 0; i < 4; i++)
+            entry[i] = static_cast<JOCTET>(offsets[k] >> (24 - 8 * i));
+    }
+    return true;
+}
+
+// The compressor is created on first use and kept, one per thread
+// jpeg_finish_compress and jpeg_abort_compress leave it ready for the next image,
+// with the tables from the permanent pool reused
+struct Encoder
+{
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    JPG12Handle handle;
+    MemDestination dest;
+    std::vector<size_t> indexParts;
+    size_t restartSegments;
+    char message[JMSG_LENGTH_MAX];
+    bool created = false;
+
+    ~Encoder()
+    {
+        if (created)
+            jpeg_destroy_compress(&cinfo);
+    }
+};
+
+static thread_local Encoder encoder;
+
+// Sets up the error handling of the compressor of this thread, before the setjmp
+static void prepareEncoder(Encoder &enc)
+{
+    if (!enc.created)
+    {
+        enc.cinfo.err = jpeg_std_error(&enc.jerr);
+        enc.jerr.error_exit = errorExit;
+        enc.jerr.emit_message = emitMessage;
+        enc.handle.message = enc.message;
+        enc.cinfo.client_data = &enc.handle;
+    }
+    enc.jerr.num_warnings = 0;
+    enc.message[0] = 0;
+}
+
+// Creates the compressor on first use, after the setjmp
+static void createEncoder(Encoder &enc)
+{
+    if (!enc.created)
+    {
+        jpeg_create_compress(&enc.cinfo);
+        enc.cinfo.dest = &enc.dest.pub;
+        enc.created = true;
+    }
+}
+
+// Sets the image and the encoding parameters, gray for one component, YCbCr for three
+static void setEncodingParameters(jpeg_compress_struct &cinfo, int width, int height,
+                                  int num_components, int quality)
+{
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = num_components;
+    cinfo.in_color_space = num_components == 1   ? JCS_GRAYSCALE
+                           : num_components == 3 ? JCS_RGB
+                                                 : JCS_UNKNOWN;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+}
+
+// Writes count pixel rows, linesize samples apart
+static void writeRows(jpeg_compress_struct &cinfo, uint16_t *pixels, size_t linesize, JDIMENSION count)
+{
+    JSAMPROW rows[DCTSIZE * MAX_SAMP_FACTOR];
+    for (JDIMENSION done = 0; done < count;)
+    {
+        const JDIMENSION n = std::min<JDIMENSION>(DCTSIZE * MAX_SAMP_FACTOR, count - done);
+        for (JDIMENSION i = 0; i < n; i++)
+            rows[i] = reinterpret_cast<JSAMPROW>(pixels + (done + i) * linesize);
+        done += jpeg_write_scanlines(&cinfo, rows, n);
+    }
+}
+
+//
+// Compresses the pixel rows, linesize samples apart, with the compressor of this thread
+// The Zen chunk is written if not null. A non zero restart adds restart markers every
+// restart MCUs, or every -restart MCU rows, and the restart index, with the segment count
+// in encoder.restartSegments. The JPEG size is in encoder.dest.total, data past the output
+// buffer goes to encoder.dest.spill. On failure, encoder.message has the error
+//
+static bool compressImage(uint16_t *pixels, size_t linesize, int width, int height,
+                          int num_components, int quality, const std::vector<char> *zenChunk,
+                          int restart, uint8_t *output, size_t outsize)
+{
+    Encoder &enc = encoder;
+    jpeg_compress_struct &cinfo = enc.cinfo;
+    prepareEncoder(enc);
+
+    if (setjmp(enc.handle.setjmp_buffer))
+    {
+        if (enc.created)
+            jpeg_abort_compress(&cinfo);
+        return false;
+    }
+
+    createEncoder(enc);
+
+    initDestination(enc.dest, output, outsize);
+    setEncodingParameters(cinfo, width, height, num_components, quality);
+    // The default tables are poor for 12 bit data. The first pass keeps the quantized
+    // coefficients in the full buffer, the Huffman pass reuses them without another FDCT
+    cinfo.optimize_coding = TRUE;
+    if (restart > 0)
+        cinfo.restart_interval = restart;
+    else if (restart < 0)
+        cinfo.restart_in_rows = -restart;
+
+    jpeg_start_compress(&cinfo, TRUE);
+    if (zenChunk)
+        writeZenChunk(&cinfo, *zenChunk);
+    // The scan setup has converted restart_in_rows to MCUs
+    enc.restartSegments = 0;
+    if (restart)
+    {
+        const size_t mcus = size_t(cinfo.MCUs_per_row) * cinfo.MCU_rows_in_scan;
+        enc.restartSegments = 1 + (mcus - 1) / cinfo.restart_interval;
+        writeRestartIndex(&cinfo, enc.dest, enc.restartSegments, enc.indexParts);
+    }
+    writeRows(cinfo, pixels, linesize, cinfo.image_height);
+    jpeg_finish_compress(&cinfo);
+
+    // When the output doesn't fit, the caller reports that instead
+    if (restart && (enc.dest.total <= outsize || outsize == 0) &&
+        !patchRestartIndex(enc.dest, enc.restartSegments, enc.indexParts))
+    {
+        strcpy(enc.message, "Restart index mismatch");
+        return false;
+    }
+    return true;
+}
+
+//
+// Encodes 12 bit pixels as a JPEG12, gray for one component, YCbCr for three
+// Any other number of components is stored as is
+// With zen set, a Zen chunk is written, from the mask if not null or from the pixels otherwise
+//
+static char *encodeImage(uint16_t *pixels, int width, int height, int num_components, int quality,
+                         bool zen, uint8_t *mask, size_t masksize, int options, int restart,
+                         uint8_t *output, size_t outsize)
+{
+    if (width < 1 || width > JPEG_MAX_DIMENSION || height < 1 || height > JPEG_MAX_DIMENSION ||
+        num_components < 1 || num_components > MAX_COMPONENTS || quality < 1 || quality > 100 ||
+        restart < -65535 || restart > 65535)
+    {
+        json j = {{"error", "Invalid encoding parameters"}};
+        return strdup(j.dump().c_str());
+    }
+
+    // The compressor indexes tables with the sample values
+    const size_t linesize = size_t(width) * num_components;
+    if (std::any_of(pixels, pixels + linesize * height, [](uint16_t v) { return v > MAXJSAMPLE; }))
+    {
+        json j = {{"error", "Sample value larger than 12 bits"}};
+        return strdup(j.dump().c_str());
+    }
+
+    std::vector<char> zenChunk;
+    if (zen)
+    {
+        const bool maskBytes = (options & ZEN_MASK_BYTES) != 0;
+        const size_t expected_masksize = size_t(height) * (maskBytes ? width : Chunks<8>(width));
+        if (mask && expected_masksize != masksize)
+        {
+            json j = {
+                {"error", "Mask buffer size mismatch"},
+                {"maskSize", expected_masksize},
+            };
+            return strdup(j.dump().c_str());
+        }
+
+        BitMap2D<uint64_t> bm(width, height);
+        packZenChunk(bm, buildZenMask(bm, pixels, linesize, num_components, mask, maskBytes), zenChunk);
+    }
+
+    if (!compressImage(pixels, linesize, width, height, num_components, quality,
+                       zen ? &zenChunk : nullptr, restart, output, outsize))
+    {
+        json j = {{"error", encoder.message}};
+        return strdup(j.dump().c_str());
+    }
+
+    const Encoder &enc = encoder;
+    json j = {
+        {"width", width},
+        {"height", height},
+        {"numComponents", num_components},
+        {"quality", quality},
+        {"outputSize", enc.dest.total},
+    };
+    if (zen)
+        j["zenChunkSize"] = zenChunk.size() - CHUNK_NAME_SIZE;
+    if (restart)
+    {
+        j["restartInterval"] = enc.cinfo.restart_interval;
+        j["restartSegments"] = enc.restartSegments;
+    }
+    if (enc.dest.total > outsize)
+        j["error"] = "Output buffer too small";
+    return strdup(j.dump().c_str());
+}
+
+char *encode(uint16_t *pixels, int width, int height, int num_components, int quality,
+             uint8_t *output, size_t outsize)
+{
+    return encodeImage(pixels, width, height, num_components, quality, false, nullptr, 0, 0, 0,
+                       output, outsize);
+}
+
+char *encodewithmask(uint16_t *pixels, int width, int height, int num_components, int quality,
+                     uint8_t *mask, size_t masksize, int options, uint8_t *output, size_t outsize)
+{
+    return encodeImage(pixels, width, height, num_components, quality, true, mask, masksize,
+                       options, 0, output, outsize);
+}
+
+char *encodewithindex(uint16_t *pixels, int width, int height, int num_components, int quality,
+                      int restart, uint8_t *output, size_t outsize)
+{
+    return encodeImage(pixels, width, height, num_components, quality, false, nullptr, 0, 0,
+                       restart, output, outsize);
+}
+
+// Work shared by the encodetiles threads, each one takes the next tile until none are left
+struct TileJob
+{
+    uint16_t *pixels;
+    int width;
+    int height;
+    int num_components;
+    int quality;
+    int tilesize;
+    int tilesX;
+    bool zen;
+    std::atomic<int> next;
+
+    struct Tile
+    {
+        std::vector<JOCTET> data;
+        size_t zenChunkSize;
+        std::string error;
+    };
+    std::vector<Tile> tiles;
+};
+
+// A wasm build only gets the workers of its pool while the calling thread waits, and has C++
+// exceptions disabled by default, so a thread that can't start would abort the module
+// The thread count is capped instead, build with the same -DPTHREAD_POOL_SIZE and -sPTHREAD_POOL_SIZE
+#if defined(__EMSCRIPTEN_PTHREADS__) && !defined(PTHREAD_POOL_SIZE)
+#define PTHREAD_POOL_SIZE 4
+#endif
+
+// Runs the worker on up to threads threads, the calling one included, zero meaning all the cores
+// Returns the number of threads that were used
+template <typename Job>
+static int runWorkers(void (*worker)(Job *), Job *job, int threads, int tasks)
+{
+    int nthreads = threads ? threads : static_cast<int>(std::thread::hardware_concurrency());
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    nthreads = 1; // Built without -pthread
+#elif defined(__EMSCRIPTEN_PTHREADS__)
+    nthreads = std::min(nthreads, PTHREAD_POOL_SIZE + 1);
+#endif
+    nthreads = std::max(1, std::min(nthreads, tasks));
+    std::vector<std::thread> pool;
+    try
+    {
+        while (static_cast<int>(pool.size()) < nthreads - 1)
+            pool.emplace_back(worker, job);
+    }
+    catch (const std::system_error &)
+    {
+        // Out of threads in a native build, use the ones already running
+    }
+    worker(job);
+    for (auto &t : pool)
+        t.join();
+    return static_cast<int>(pool.size()) + 1;
+}
+
+static void tileWorker(TileJob *job)
+{
+    const size_t linesize = size_t(job->width) * job->num_components;
+    const int ntiles = static_cast<int>(job->tiles.size());
+    std::vector<char> zenChunk;
+    for (int t = job->next++; t < ntiles; t = job->next++)
+    {
+        const int x = (t % job->tilesX) * job->tilesize;
+        const int y = (t / job->tilesX) * job->tilesize;
+        const int w = std::min(job->tilesize, job->width - x);
+        const int h = std::min(job->tilesize, job->height - y);
+        uint16_t *origin = job->pixels + size_t(y) * linesize + size_t(x) * job->num_components;
+        TileJob::Tile &tile = job->tiles[t];
+
+        if (job->zen)
+        {
+            BitMap2D<uint64_t> bm(w, h);
+            packZenChunk(bm, buildZenMask(bm, origin, linesize, job->num_components, nullptr, false),
+                         zenChunk);
+            tile.zenChunkSize = zenChunk.size() - CHUNK_NAME_SIZE;
+        }
+
+        // Without an output buffer the whole tile goes to the spill buffer of this thread
+        if (!compressImage(origin, linesize, w, h, job->num_components, job->quality,
+                           job->zen ? &zenChunk : nullptr, 0, nullptr, 0))
+        {
+            tile.error = encoder.message;
+            continue;
+        }
+        const std::vector<JOCTET> &spill = encoder.dest.spill;
+        tile.data.assign(spill.begin(), spill.begin() + encoder.dest.total);
+    }
+}
+
+char *encodetiles(uint16_t *pixels, int width, int height, int num_components, int quality,
+                  int tilesize, int options, int threads, uint8_t *output, size_t outsize)
+{
+    if (width < 1 || width > JPEG_MAX_DIMENSION || height < 1 || height > JPEG_MAX_DIMENSION ||
+        num_components < 1 || num_components > MAX_COMPONENTS || quality < 1 || quality > 100 ||
+        tilesize < 1 || threads < 0)
+    {
+        json j = {{"error", "Invalid encoding parameters"}};
+        return strdup(j.dump().c_str());
+    }
+
+    const size_t linesize = size_t(width) * num_components;
+    if (std::any_of(pixels, pixels + linesize * height, [](uint16_t v) { return v > MAXJSAMPLE; }))
+    {
+        json j = {{"error", "Sample value larger than 12 bits"}};
+        return strdup(j.dump().c_str());
+    }
+
+    TileJob job;
+    job.pixels = pixels;
+    job.width = width;
+    job.height = height;
+    job.num_components = num_components;
+    job.quality = quality;
+    job.tilesize = tilesize;
+    job.tilesX = 1 + (width - 1) / tilesize;
+    job.zen = (options & ZEN_CHUNK_FROM_PIXELS) != 0;
+    job.next = 0;
+    const int ntiles = job.tilesX * (1 + (height - 1) / tilesize);
+    job.tiles.resize(ntiles);
+
+    // Each thread has its own compressor
+    const int nthreads = runWorkers(tileWorker, &job, threads, ntiles);
+
+    json tiles = json::array();
+    size_t total = 0;
+    for (const auto &tile : job.tiles)
+    {
+        if (!tile.error.empty())
+        {
+            json j = {{"error", tile.error}};
+            return strdup(j.dump().c_str());
+        }
+        json info = {{"offset", total}, {"size", tile.data.size()}};
+        if (job.zen)
+            info["zenChunkSize"] = tile.zenChunkSize;
+        tiles.push_back(info);
+        if (total + tile.data.size() <= outsize)
+            memcpy(output + total, tile.data.data(), tile.data.size());
+        total += tile.data.size();
+    }
+
+    json j = {
+        {"width", width},
+        {"height", height},
+        {"numComponents", num_components},
+        {"quality", quality},
+        {"tileSize", tilesize},
+        {"threads", nthreads},
+        {"outputSize", total},
+        {"tiles", tiles},
+    };
+    if (total > outsize)
+        j["error"] = "Output buffer too small";
+    return strdup(j.dump().c_str());
+}
+
+// Is the saved marker a Zen chunk segment
+static bool isZenMarker(jpeg_saved_marker_ptr m)
+{
+    return m->marker == JPEG_APP0 + 3 && m->data_length >= CHUNK_NAME_SIZE &&
+           !memcmp(m->data, CHUNK_NAME, CHUNK_NAME_SIZE);
+}
+
+// Copies the APPn and COM markers saved by the decompressor, after jpeg_write_coefficients
+// The JFIF and Adobe markers are those written by the compressor, the restart index is rebuilt
+// for the new offsets, and the Zen chunk is copied only if zen is set
+static void copyMarkers(jpeg_decompress_struct &dinfo, Encoder &enc, bool zen)
+{
+    jpeg_compress_struct &cinfo = enc.cinfo;
+    // The output is a single scan, interleaved if there is more than one component
+    enc.restartSegments = 0;
+    enc.indexParts.clear();
+    for (jpeg_saved_marker_ptr m = dinfo.marker_list; m; m = m->next)
+    {
+        const bool jfif = m->marker == JPEG_APP0 && m->data_length >= 5 && !memcmp(m->data, "JFIF", 5);
+        const bool adobe = m->marker == JPEG_APP0 + 14 && m->data_length >= 5 && !memcmp(m->data, "Adobe", 5);
+        if ((jfif && cinfo.write_JFIF_header) || (adobe && cinfo.write_Adobe_marker))
+            continue;
+        if (!zen && isZenMarker(m))
+            continue;
+        if (m->marker == JPEG_APP0 + 4 && m->data_length >= INDEX_NAME_SIZE &&
+            !memcmp(m->data, INDEX_NAME, INDEX_NAME_SIZE))
+        {
+            if (enc.restartSegments || !cinfo.restart_interval)
+                continue; // Already rebuilt, or stale
+            const jpeg_component_info *comp = cinfo.comp_info;
+            const size_t mcus = cinfo.num_components == 1
+                                    ? size_t(comp->width_in_blocks) * comp->height_in_blocks
+                                    : size_t(1 + (cinfo.image_width - 1) / (cinfo.max_h_samp_factor * DCTSIZE)) *
+                                          (1 + (cinfo.image_height - 1) / (cinfo.max_v_samp_factor * DCTSIZE));
+            enc.restartSegments = 1 + (mcus - 1) / cinfo.restart_interval;
+            writeRestartIndex(&cinfo, enc.dest, enc.restartSegments, enc.indexParts);
+            continue;
+        }
+        jpeg_write_marker(&cinfo, m->marker, m->data, m->data_length);
+    }
+}
+
+//
+// Re-encodes a JPEG12 from its coefficients with optimized Huffman tables, into the spill buffer
+// of the compressor of this thread. Only the entropy coded data changes, the restart interval
+// is kept and the APPn and COM markers are copied, except for the restart index which is rebuilt.
+// The JFIF and Adobe markers are those written by the compressor. On failure, or if the source
+// has corrupt data, encoder.message has the error
+//
+static bool transcodeImage(uint8_t *jpeg12, size_t size)
+{
+    Encoder &enc = encoder;
+    jpeg_compress_struct &cinfo = enc.cinfo;
+    prepareEncoder(enc);
+
+    // Errors from both objects land in the encoder handle
+    struct jpeg_decompress_struct dinfo;
+    memset(&dinfo, 0, sizeof(dinfo)); // Can be destroyed before it is created
+    jpeg_error_mgr jerr;
+    memset(&jerr, 0, sizeof(jerr));
+    struct jpeg_source_mgr s;
+    dinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = errorExit;
+    jerr.emit_message = emitMessage;
+    dinfo.client_data = &enc.handle;
+    initSource(s, jpeg12, size);
+
+    if (setjmp(enc.handle.setjmp_buffer))
+    {
+        if (enc.created)
+            jpeg_abort_compress(&cinfo);
+        destroyDecompress(dinfo, false);
+        return false;
+    }
+
+    createEncoder(enc);
+    createDecompress(dinfo);
+    dinfo.src = &s;
+    jpeg_save_markers(&dinfo, JPEG_COM, 0xffff);
+    for (int m = 0; m < 16; m++)
+        jpeg_save_markers(&dinfo, JPEG_APP0 + m, 0xffff);
+    jpeg_read_header(&dinfo, TRUE);
+    jvirt_barray_ptr *coef_arrays = jpeg_read_coefficients(&dinfo);
+    if (!coef_arrays) // Suspended, the source has no more data
+        ERREXIT(&dinfo, JERR_INPUT_EOF);
+    // Corrupt data would be baked into the new entropy coded data
+    if (jerr.num_warnings)
+        longjmp(enc.handle.setjmp_buffer, 1);
+
+    initDestination(enc.dest, nullptr, 0);
+    jpeg_copy_critical_parameters(&dinfo, &cinfo);
+    cinfo.optimize_coding = TRUE;
+    cinfo.restart_interval = dinfo.restart_interval;
+    jpeg_write_coefficients(&cinfo, coef_arrays);
+
+    copyMarkers(dinfo, enc, true);
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_finish_decompress(&dinfo);
+    destroyDecompress(dinfo, false);
+
+    if (enc.restartSegments && !patchRestartIndex(enc.dest, enc.restartSegments, enc.indexParts))
+    {
+        strcpy(enc.message, "Restart index mismatch");
+        return false;
+    }
+    return true;
+}
+
+// Work shared by the transcodetiles threads
+struct TranscodeJob
+{
+    uint8_t *input;
+    std::vector<size_t> offsets;
+    std::vector<size_t> sizes;
+    std::atomic<int> next;
+
+    struct Tile
+    {
+        std::vector<JOCTET> data; // Empty if the input is kept
+        std::string error;
+    };
+    std::vector<Tile> tiles;
+};
+
+static void transcodeWorker(TranscodeJob *job)
+{
+    const int ntiles = static_cast<int>(job->tiles.size());
+    for (int t = job->next++; t < ntiles; t = job->next++)
+    {
+        TranscodeJob::Tile &tile = job->tiles[t];
+        if (!transcodeImage(job->input + job->offsets[t], job->sizes[t]))
+        {
+            tile.error = encoder.message;
+            continue;
+        }
+        if (encoder.dest.total < job->sizes[t])
+        {
+            const std::vector<JOCTET> &spill = encoder.dest.spill;
+            tile.data.assign(spill.begin(), spill.begin() + encoder.dest.total);
+        }
+    }
+}
+
+char *transcodetiles(uint8_t *input, uint32_t *sizes, int count, int threads,
+                     uint8_t *output, size_t outsize)
+{
+    if (count < 1 || threads < 0)
+    {
+        json j = {{"error", "Invalid transcoding parameters"}};
+        return strdup(j.dump().c_str());
+    }
+
+    TranscodeJob job;
+    job.input = input;
+    job.next = 0;
+    size_t inputSize = 0;
+    for (int t = 0; t < count; t++)
+    {
+        job.offsets.push_back(inputSize);
+        job.sizes.push_back(sizes[t]);
+        inputSize += sizes[t];
+    }
+    job.tiles.resize(count);
+
+    // Each thread has its own compressor and decompressor
+    const int nthreads = runWorkers(transcodeWorker, &job, threads, count);
+
+    json tiles = json::array();
+    size_t total = 0;
+    for (int t = 0; t < count; t++)
+    {
+        const TranscodeJob::Tile &tile = job.tiles[t];
+        const uint8_t *data = tile.data.empty() ? input + job.offsets[t] : tile.data.data();
+        const size_t size = tile.data.empty() ? job.sizes[t] : tile.data.size();
+        json info = {{"offset", total}, {"size", size}, {"inputSize", job.sizes[t]}};
+        if (!tile.error.empty())
+            info["error"] = tile.error;
+        tiles.push_back(info);
+        if (total + size <= outsize)
+            memmove(output + total, data, size);
+        total += size;
+    }
+
+    json j = {
+        {"threads", nthreads},
+        {"inputSize", inputSize},
+        {"outputSize", total},
+        {"saved", inputSize - total},
+        {"tiles", tiles},
+    };
+    if (total > outsize)
+        j["error"] = "Output buffer too small";
+    return strdup(j.dump().c_str());
+}
+
+//
+// The transforms of transformimage, each one a transposition, if any, followed by mirroring the
+// source axes. Destination pixel x, y comes from source pixel a, b, which is y, x if transposed,
+// with a counted from the right if mirrorX and b from the bottom if mirrorY
+// In the DCT domain, a block is mirrored by negating its odd frequencies along that axis
+//
+struct Transform
+{
+    bool transpose;
+    bool mirrorX;
+    bool mirrorY;
+};
+
+static const Transform transforms[] = {
+    {false, false, false}, // TRANSFORM_NONE
+    {false, true, false},  // TRANSFORM_FLIP_H
+    {false, false, true},  // TRANSFORM_FLIP_V
+    {true, false, false},  // TRANSFORM_TRANSPOSE
+    {true, true, true},    // TRANSFORM_TRANSVERSE
+    {true, false, true},   // TRANSFORM_ROT_90
+    {false, true, true},   // TRANSFORM_ROT_180
+    {true, true, false},   // TRANSFORM_ROT_270
+};
+
+// Where each coefficient of a destination block comes from, and if it changes sign
+struct BlockTransform
+{
+    int from[DCTSIZE2];
+    bool negate[DCTSIZE2];
+
+    explicit BlockTransform(const Transform &t)
+    {
+        for (int v = 0; v < DCTSIZE; v++)
+            for (int u = 0; u < DCTSIZE; u++)
+            {
+                const int sv = t.transpose ? u : v; // Source row and column frequencies
+                const int su = t.transpose ? v : u;
+                from[v * DCTSIZE + u] = sv * DCTSIZE + su;
+                negate[v * DCTSIZE + u] = ((t.mirrorX && (su & 1)) != (t.mirrorY && (sv & 1)));
+            }
+    }
+
+    void apply(const JCOEF *src, JCOEF *dst) const
+    {
+        for (int k = 0; k < DCTSIZE2; k++)
+            dst[k] = negate[k] ? JCOEF(-src[from[k]]) : src[from[k]];
+    }
+};
+
+// Crop of one component, in blocks
+struct ComponentCrop
+{
+    JDIMENSION x, y, width, height;
+};
+
+// Fills the destination array of a component from the source one. Every row of the destination,
+// padding included, is written in order, the virtual array doesn't allow reading undefined rows
+// With a memory limit the source can be swapped to the backing store, a row pointer is then only
+// valid until the next access to the same array, so the source rows are fetched as they are needed
+static void transformComponent(jpeg_decompress_struct &dinfo, jvirt_barray_ptr src, jvirt_barray_ptr dst,
+                               JDIMENSION dstRows, const ComponentCrop &crop, const Transform &t,
+                               const BlockTransform &bt)
+{
+    const JDIMENSION width = t.transpose ? crop.height : crop.width;
+    const JDIMENSION height = t.transpose ? crop.width : crop.height;
+    for (JDIMENSION by = 0; by < dstRows; by++)
+    {
+        JBLOCKROW out = (*dinfo.mem->access_virt_barray)((j_common_ptr)&dinfo, dst, by, 1, TRUE)[0];
+        if (by >= height)
+            continue; // Padding, not read by the compressor
+        JBLOCKROW row = nullptr;
+        JDIMENSION rowY = 0;
+        for (JDIMENSION bx = 0; bx < width; bx++)
+        {
+            const JDIMENSION a = t.transpose ? by : bx;
+            const JDIMENSION b = t.transpose ? bx : by;
+            const JDIMENSION sx = t.mirrorX ? crop.width - 1 - a : a;
+            const JDIMENSION sy = t.mirrorY ? crop.height - 1 - b : b;
+            // Once per destination row, or for every block when transposing
+            if (!row || sy != rowY)
+            {
+                row = (*dinfo.mem->access_virt_barray)((j_common_ptr)&dinfo, src, crop.y + sy, 1, FALSE)[0] +
+                      crop.x;
+                rowY = sy;
+            }
+            bt.apply(row[sx], out[bx]);
+        }
+    }
+}
+
+// Transforms the Zen mask of the crop at x, y into the destination mask
+// Returns true if all the destination pixels are valid
+static bool transformZenMask(const BitMap2D<uint64_t> &src, int x, int y, const Transform &t,
+                             BitMap2D<uint64_t> &dst)
+{
+    const int width = dst.getWidth();
+    const int height = dst.getHeight();
+    const int cropWidth = t.transpose ? height : width;
+    const int cropHeight = t.transpose ? width : height;
+    bool full = true;
+    for (int py = 0; py < height; py++)
+        for (int px = 0; px < width; px++)
+        {
+            const int a = t.transpose ? py : px;
+            const int b = t.transpose ? px : py;
+            const bool valid = src.isSet(x + (t.mirrorX ? cropWidth - 1 - a : a),
+                                         y + (t.mirrorY ? cropHeight - 1 - b : b));
+            dst.assign(px, py, valid);
+            full = full && valid;
+        }
+    return full;
+}
+
+//
+// Crop and transform on the coefficients, written with optimized Huffman tables
+// Markers are copied as in transcodetiles, the Zen chunk is rebuilt for the new geometry
+// Transposing also transposes the quantization tables and swaps the sampling factors
+//
+char *transformimage(uint8_t *jpeg12, size_t size, int transform, int x, int y, int width, int height,
+                     uint8_t *output, size_t outsize)
+{
+    if (transform < TRANSFORM_NONE || transform > TRANSFORM_ROT_270 || x < 0 || y < 0 || width < 0 ||
+        height < 0)
+    {
+        json j = {{"error", "Invalid transform parameters"}};
+        return strdup(j.dump().c_str());
+    }
+    const Transform &t = transforms[transform];
+    const BlockTransform bt(t);
+
+    Encoder &enc = encoder;
+    jpeg_compress_struct &cinfo = enc.cinfo;
+    prepareEncoder(enc);
+
+    // Outside of the setjmp scope
+    std::vector<JOCTET> zenParts;
+    std::unique_ptr<BitMap2D<uint64_t>> srcMask, dstMask;
+    std::vector<char> zenChunk;
+
+    // Errors from both objects land in the encoder handle
+    struct jpeg_decompress_struct dinfo;
+    memset(&dinfo, 0, sizeof(dinfo)); // Can be destroyed before it is created
+    jpeg_error_mgr jerr;
+    memset(&jerr, 0, sizeof(jerr));
+    struct jpeg_source_mgr s;
+    dinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = errorExit;
+    jerr.emit_message = emitMessage;
+    dinfo.client_data = &enc.handle;
+    initSource(s, jpeg12, size);
+
+    if (setjmp(enc.handle.setjmp_buffer))
+    {
+        if (enc.created)
+            jpeg_abort_compress(&cinfo);
+        destroyDecompress(dinfo, false);
+        json j = {{"error", enc.message}};
+        return strdup(j.dump().c_str());
+    }
+
+    createEncoder(enc);
+    createDecompress(dinfo);
+    dinfo.src = &s;
+    jpeg_save_markers(&dinfo, JPEG_COM, 0xffff);
+    for (int m = 0; m < 16; m++)
+        jpeg_save_markers(&dinfo, JPEG_APP0 + m, 0xffff);
+    jpeg_read_header(&dinfo, TRUE);
+
+    // The crop in source pixels, from an iMCU boundary
+    const int imageWidth = dinfo.image_width;
+    const int imageHeight = dinfo.image_height;
+    const int mcuWidth = dinfo.max_h_samp_factor * DCTSIZE;
+    const int mcuHeight = dinfo.max_v_samp_factor * DCTSIZE;
+    if (x >= imageWidth || y >= imageHeight)
+    {
+        strcpy(enc.message, "Crop outside of the image");
+        longjmp(enc.handle.setjmp_buffer, 1);
+    }
+    const int cropX = x - x % mcuWidth;
+    const int cropY = y - y % mcuHeight;
+    int cropWidth = (width && width < imageWidth - x ? x + width : imageWidth) - cropX;
+    int cropHeight = (height && height < imageHeight - y ? y + height : imageHeight) - cropY;
+    // A partial iMCU can't move to the near edge
+    if (t.mirrorX)
+        cropWidth -= cropWidth % mcuWidth;
+    if (t.mirrorY)
+        cropHeight -= cropHeight % mcuHeight;
+    if (cropWidth == 0 || cropHeight == 0)
+    {
+        strcpy(enc.message, "Crop too small for the transform");
+        longjmp(enc.handle.setjmp_buffer, 1);
+    }
+
+    // The destination arrays are realized with the source ones, by jpeg_read_coefficients
+    ComponentCrop crops[MAX_COMPONENTS];
+    JDIMENSION dstRows[MAX_COMPONENTS];
+    jvirt_barray_ptr dstArrays[MAX_COMPONENTS];
+    for (int ci = 0; ci < dinfo.num_components; ci++)
+    {
+        const jpeg_component_info *comp = dinfo.comp_info + ci;
+        ComponentCrop &crop = crops[ci];
+        crop.x = cropX / mcuWidth * comp->h_samp_factor;
+        crop.y = cropY / mcuHeight * comp->v_samp_factor;
+        crop.width = 1 + (cropWidth * comp->h_samp_factor - 1) / mcuWidth;
+        crop.height = 1 + (cropHeight * comp->v_samp_factor - 1) / mcuHeight;
+
+        // Rounded up to whole MCUs, with the destination sampling factors
+        const int h = t.transpose ? comp->v_samp_factor : comp->h_samp_factor;
+        const int v = t.transpose ? comp->h_samp_factor : comp->v_samp_factor;
+        const JDIMENSION w = t.transpose ? crop.height : crop.width;
+        dstRows[ci] = t.transpose ? crop.width : crop.height;
+        dstRows[ci] = (dstRows[ci] + v - 1) / v * v;
+        dstArrays[ci] = (*dinfo.mem->request_virt_barray)((j_common_ptr)&dinfo, JPOOL_IMAGE, FALSE,
+                                                          (w + h - 1) / h * h, dstRows[ci], v);
+    }
+
+    jvirt_barray_ptr *coef_arrays = jpeg_read_coefficients(&dinfo);
+    if (!coef_arrays) // Suspended, the source has no more data
+        ERREXIT(&dinfo, JERR_INPUT_EOF);
+    // Corrupt data would be baked into the new entropy coded data
+    if (jerr.num_warnings)
+        longjmp(enc.handle.setjmp_buffer, 1);
+
+    for (int ci = 0; ci < dinfo.num_components; ci++)
+        transformComponent(dinfo, coef_arrays[ci], dstArrays[ci], dstRows[ci], crops[ci], t, bt);
+
+    // The Zen chunk, possibly in more than one segment
+    bool zen = false;
+    for (jpeg_saved_marker_ptr m = dinfo.marker_list; m; m = m->next)
+        if (isZenMarker(m))
+        {
+            zenParts.insert(zenParts.end(), m->data + CHUNK_NAME_SIZE, m->data + m->data_length);
+            zen = true;
+        }
+    const int dstWidth = t.transpose ? cropHeight : cropWidth;
+    const int dstHeight = t.transpose ? cropWidth : cropHeight;
+    if (zen)
+    {
+        srcMask.reset(new BitMap2D<uint64_t>(imageWidth, imageHeight));
+        if (!loadZenChunk(zenParts.data(), zenParts.size(), *srcMask))
+        {
+            strcpy(enc.message, "Zen chunk can't be unpacked");
+            longjmp(enc.handle.setjmp_buffer, 1);
+        }
+        dstMask.reset(new BitMap2D<uint64_t>(dstWidth, dstHeight));
+        packZenChunk(*dstMask, transformZenMask(*srcMask, cropX, cropY, t, *dstMask), zenChunk);
+    }
+
+    initDestination(enc.dest, output, outsize);
+    jpeg_copy_critical_parameters(&dinfo, &cinfo);
+    cinfo.image_width = dstWidth;
+    cinfo.image_height = dstHeight;
+    if (t.transpose)
+    {
+        for (int ci = 0; ci < cinfo.num_components; ci++)
+            std::swap(cinfo.comp_info[ci].h_samp_factor, cinfo.comp_info[ci].v_samp_factor);
+        for (int q = 0; q < NUM_QUANT_TBLS; q++)
+        {
+            JQUANT_TBL *qtbl = cinfo.quant_tbl_ptrs[q];
+            if (!qtbl)
+                continue;
+            for (int i = 0; i < DCTSIZE; i++)
+                for (int k = 0; k < i; k++)
+                    std::swap(qtbl->quantval[i * DCTSIZE + k], qtbl->quantval[k * DCTSIZE + i]);
+        }
+    }
+    cinfo.optimize_coding = TRUE;
+    cinfo.restart_interval = dinfo.restart_interval;
+    jpeg_write_coefficients(&cinfo, dstArrays);
+    if (zen)
+        writeZenChunk(&cinfo, zenChunk);
+    copyMarkers(dinfo, enc, false);
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_finish_decompress(&dinfo);
+    destroyDecompress(dinfo, false);
+
+    // When the output doesn't fit, the caller reports that instead
+    if (enc.restartSegments && (enc.dest.total <= outsize || outsize == 0) &&
+        !patchRestartIndex(enc.dest, enc.restartSegments, enc.indexParts))
+    {
+        json j = {{"error", "Restart index mismatch"}};
+        return strdup(j.dump().c_str());
+    }
+
+    json j = {
+        {"width", dstWidth},
+        {"height", dstHeight},
+        {"numComponents", cinfo.num_components},
+        {"transform", transform},
+        {"x", cropX},
+        {"y", cropY},
+        {"cropWidth", cropWidth},
+        {"cropHeight", cropHeight},
+        {"outputSize", enc.dest.total},
+    };
+    if (zen)
+        j["zenChunkSize"] = zenChunk.size() - CHUNK_NAME_SIZE;
+    if (enc.dest.total > outsize)
+        j["error"] = "Output buffer too small";
+    return strdup(j.dump().c_str());
+}
+
+// Destination manager that hands the output to a callback, a buffer at a time
+// Without a callback the output is only counted
+#define STREAM_BUFFER_SIZE 65536
+// Rows in the first band at least, the sample for the Huffman tables
+#define STREAM_SAMPLE_ROWS 64
+
+struct StreamDestination
+{
+    jpeg_destination_mgr pub;
+    int (*write)(void *, const uint8_t *, size_t);
+    void *context;
+    std::vector<JOCTET> buffer;
+    size_t total;
+};
+
+static void flushStream(j_compress_ptr cinfo, size_t count)
+{
+    auto dest = reinterpret_cast<StreamDestination *>(cinfo->dest);
+    if (count && dest->write && !dest->write(dest->context, dest->buffer.data(), count))
+        ERREXIT(cinfo, JERR_FILE_WRITE);
+    dest->total += count;
+    dest->pub.next_output_byte = dest->buffer.data();
+    dest->pub.free_in_buffer = dest->buffer.size();
+}
+
+static void init_destination_stream(j_compress_ptr cinfo)
+{
+    auto dest = reinterpret_cast<StreamDestination *>(cinfo->dest);
+    dest->total = 0;
+    flushStream(cinfo, 0);
+}
+
+// The whole buffer is written, whatever free_in_buffer says
+static boolean empty_output_buffer_stream(j_compress_ptr cinfo)
+{
+    auto dest = reinterpret_cast<StreamDestination *>(cinfo->dest);
+    flushStream(cinfo, dest->buffer.size());
+    return TRUE;
+}
+
+static void term_destination_stream(j_compress_ptr cinfo)
+{
+    auto dest = reinterpret_cast<StreamDestination *>(cinfo->dest);
+    flushStream(cinfo, dest->buffer.size() - dest->pub.free_in_buffer);
+}
+
+// Rebuilds a Huffman table fitted to a sample so that it codes every symbol of 12 bit data,
+// DC categories up to 15 and AC sizes up to 14, with the ones missing from the sample
+// getting the longest codes. A code of length l stands for a frequency of about 2^-l
+static void extendHuffmanTable(j_compress_ptr cinfo, JHUFF_TBL *htbl, bool ac)
+{
+    long freq[257] = {};
+    for (int l = 1, k = 0; l <= 16; l++)
+        for (int i = 0; i < htbl->bits[l]; i++)
+            freq[htbl->huffval[k++]] = 1L << (24 - l);
+
+    if (ac)
+    {
+        for (int run = 0; run < 16; run++)
+            for (int size = 1; size <= 14; size++)
+                freq[run << 4 | size] = std::max(freq[run << 4 | size], 1L);
+        freq[0x00] = std::max(freq[0x00], 1L); // EOB
+        freq[0xf0] = std::max(freq[0xf0], 1L); // ZRL
+    }
+    else
+        for (int category = 0; category <= 15; category++)
+            freq[category] = std::max(freq[category], 1L);
+
+    jpeg_gen_optimal_table(cinfo, htbl, freq);
+}
+
+char *encodestream(int width, int height, int num_components, int quality, int bandrows,
+                   int (*readrows)(void *, uint16_t *, int, int),
+                   int (*writedata)(void *, const uint8_t *, size_t), void *context)
+{
+    if (width < 1 || width > JPEG_MAX_DIMENSION || height < 1 || height > JPEG_MAX_DIMENSION ||
+        num_components < 1 || num_components > MAX_COMPONENTS || quality < 1 || quality > 100 ||
+        bandrows < 1 || !readrows || !writedata)
+    {
+        json j = {{"error", "Invalid encoding parameters"}};
+        return strdup(j.dump().c_str());
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t linesize = size_t(width) * num_components;
+    const int firstrows = std::min(std::max(bandrows, STREAM_SAMPLE_ROWS), height);
+    std::vector<uint16_t> band(firstrows * linesize);
+    char message[JMSG_LENGTH_MAX] = "";
+
+    struct jpeg_compress_struct cinfo;
+    JPG12Handle handle;
+    memset(&handle, 0, sizeof(handle));
+    jpeg_error_mgr jerr;
+    memset(&jerr, 0, sizeof(jerr));
+    handle.message = message;
+    cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = errorExit;
+    jerr.emit_message = emitMessage;
+    cinfo.client_data = &handle;
+
+    StreamDestination dest;
+    dest.pub.init_destination = init_destination_stream;
+    dest.pub.empty_output_buffer = empty_output_buffer_stream;
+    dest.pub.term_destination = term_destination_stream;
+    dest.context = context;
+    dest.buffer.resize(STREAM_BUFFER_SIZE);
+
+    if (setjmp(handle.setjmp_buffer))
+    {
+        jpeg_destroy_compress(&cinfo);
+        json j = {{"error", message}};
+        return strdup(j.dump().c_str());
+    }
+
+    jpeg_create_compress(&cinfo);
+    cinfo.dest = &dest.pub;
+
+    // Fills the band with the rows from first on, the compressor indexes tables with the values
+    auto readBand = [&](int first, int count)
+    {
+        if (!readrows(context, band.data(), first, count))
+            strcpy(message, "Reading rows failed");
+        else if (std::any_of(band.begin(), band.begin() + count * linesize,
+                             [](uint16_t v) { return v > MAXJSAMPLE; }))
+            strcpy(message, "Sample value larger than 12 bits");
+        else
+            return;
+        longjmp(handle.setjmp_buffer, 1);
+    };
+
+    // A pass over the first band, with the output only counted, gives the Huffman tables
+    readBand(0, firstrows);
+    dest.write = nullptr;
+    setEncodingParameters(cinfo, width, firstrows, num_components, quality);
+    cinfo.optimize_coding = TRUE;
+    jpeg_start_compress(&cinfo, TRUE);
+    writeRows(cinfo, band.data(), linesize, firstrows);
+    jpeg_finish_compress(&cinfo);
+
+    // jpeg_set_defaults resets the tables to the standard ones, which can't code all 12 bit values
+    JHUFF_TBL dc_tables[NUM_HUFF_TBLS], ac_tables[NUM_HUFF_TBLS];
+    for (int i = 0; i < NUM_HUFF_TBLS; i++)
+    {
+        if (cinfo.dc_huff_tbl_ptrs[i])
+        {
+            extendHuffmanTable(&cinfo, cinfo.dc_huff_tbl_ptrs[i], false);
+            dc_tables[i] = *cinfo.dc_huff_tbl_ptrs[i];
+        }
+        if (cinfo.ac_huff_tbl_ptrs[i])
+        {
+            extendHuffmanTable(&cinfo, cinfo.ac_huff_tbl_ptrs[i], true);
+            ac_tables[i] = *cinfo.ac_huff_tbl_ptrs[i];
+        }
+    }
+
+    // The single pass keeps one MCU row of coefficients, the output goes out as it is made
+    dest.write = writedata;
+    setEncodingParameters(cinfo, width, height, num_components, quality);
+    for (int i = 0; i < NUM_HUFF_TBLS; i++)
+    {
+        if (cinfo.dc_huff_tbl_ptrs[i])
+            *cinfo.dc_huff_tbl_ptrs[i] = dc_tables[i];
+        if (cinfo.ac_huff_tbl_ptrs[i])
+            *cinfo.ac_huff_tbl_ptrs[i] = ac_tables[i];
+    }
+    cinfo.optimize_coding = FALSE;
+    jpeg_start_compress(&cinfo, TRUE);
+    writeRows(cinfo, band.data(), linesize, firstrows);
+    for (int first = firstrows; first < height; first += bandrows)
+    {
+        const int count = std::min(bandrows, height - first);
+        readBand(first, count);
+        writeRows(cinfo, band.data(), linesize, count);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    json j = {
+        {"width", width},
+        {"height", height},
+        {"numComponents", num_components},
+        {"quality", quality},
+        {"bandRows", bandrows},
+        {"outputSize", dest.total},
+        {"seconds", seconds},
+        {"megapixelsPerSecond", seconds > 0 ? double(width) * height / seconds / 1e6 : 0.0},
+    };
+    return strdup(j.dump().c_str());
+}
+
+//
+// Memory used by the last decode, decodewithmask or getcoefficients call on this thread, to help
+// size the wasm heap
+// Sizes are in bytes, peaks are over the whole call; arenaReserved is what the thread arena holds
+//
+char *getmemorystats()
+{
+    json j = {
+        {"peakBytes", lastStats.peak_bytes},
+        {"permanentPoolBytes", lastStats.pool_peak_bytes[JPOOL_PERMANENT]},
+        {"imagePoolBytes", lastStats.pool_peak_bytes[JPOOL_IMAGE]},
+        {"smallAllocs", lastStats.small_allocs},
+        {"largeAllocs", lastStats.large_allocs},
+        {"virtualSampleArrayBytes", lastStats.virt_sarray_bytes},
+        {"virtualBlockArrayBytes", lastStats.virt_barray_bytes},
+        {"virtualArrayMemoryBytes", lastStats.virt_mem_bytes},
+        {"arenaReserved", arena.ptr ? jpeg_arena_reserved(arena.ptr) : 0},
+    };
+    return strdup(j.dump().c_str());
+}
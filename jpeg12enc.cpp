@@ -0,0 +1,115 @@
+//
+// Native command line encoder for raw 12 bit rasters, streaming through encodestream
+// The input is memory mapped and read a band at a time, the output is written as it is made,
+// so large images need little memory
+//
+// Usage: jpeg12enc input.raw width height components quality output.jpg [band rows]
+// The input holds uint16 samples in native byte order, interleaved by pixel
+//
+// Build with a native compiler, not emcc:
+// gcc -O2 -c jpeg12-6b/j*.c && g++ -O2 -o jpeg12enc jpeg12enc.cpp jpeg12api.cpp Packer_RLE.cpp *.o -pthread
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C"
+{
+    char *encodestream(int, int, int, int, int, int (*)(void *, uint16_t *, int, int),
+                       int (*)(void *, const uint8_t *, size_t), void *);
+}
+
+struct Stream
+{
+    const uint16_t *pixels; // The mapped input
+    size_t linesize;        // In samples
+    FILE *output;
+};
+
+// Copies the rows out of the mapping, then lets the kernel drop the pages already read
+static int readRows(void *context, uint16_t *rows, int first, int count)
+{
+    auto s = static_cast<Stream *>(context);
+    const uint16_t *src = s->pixels + first * s->linesize;
+    const size_t size = count * s->linesize * sizeof(uint16_t);
+    memcpy(rows, src, size);
+
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(s->pixels);
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(src) + size) & ~(page - 1);
+    if (end > begin)
+        madvise(const_cast<uint16_t *>(s->pixels), end - begin, MADV_DONTNEED);
+    return 1;
+}
+
+static int writeData(void *context, const uint8_t *data, size_t size)
+{
+    auto s = static_cast<Stream *>(context);
+    return fwrite(data, 1, size, s->output) == size;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 7 || argc > 8)
+    {
+        fprintf(stderr, "Usage: %s input.raw width height components quality output.jpg [band rows]\n", argv[0]);
+        return 2;
+    }
+
+    const int width = atoi(argv[2]);
+    const int height = atoi(argv[3]);
+    const int num_components = atoi(argv[4]);
+    const int quality = atoi(argv[5]);
+    const int bandrows = argc > 7 ? atoi(argv[7]) : 64;
+    if (width < 1 || height < 1 || num_components < 1)
+    {
+        fprintf(stderr, "Invalid image size\n");
+        return 2;
+    }
+
+    const int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    const size_t expected = size_t(width) * height * num_components * sizeof(uint16_t);
+    if (size_t(st.st_size) < expected)
+    {
+        fprintf(stderr, "%s: %zu bytes, expected %zu\n", argv[1], size_t(st.st_size), expected);
+        return 1;
+    }
+    void *map = mmap(nullptr, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    madvise(map, expected, MADV_SEQUENTIAL);
+
+    Stream s;
+    s.pixels = static_cast<const uint16_t *>(map);
+    s.linesize = size_t(width) * num_components;
+    s.output = fopen(argv[6], "wb");
+    if (!s.output)
+    {
+        perror(argv[6]);
+        return 1;
+    }
+
+    char *result = encodestream(width, height, num_components, quality, bandrows,
+                                readRows, writeData, &s);
+    const bool failed = strstr(result, "\"error\"") != nullptr || fclose(s.output) != 0;
+    munmap(map, expected);
+    printf("%s\n", result);
+    free(result);
+    return failed ? 1 : 0;
+}
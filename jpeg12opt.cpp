@@ -0,0 +1,201 @@
+//
+// Native command line tool that re-optimizes the Huffman tables of every JPEG12 file in a directory
+// tree, through transcodetiles. The coefficients are not touched, so the images stay the same
+// Files are read in batches, each batch is transcoded by a pool of threads and written under the
+// output directory with the same relative path. A file that doesn't get smaller, or that fails,
+// is written unchanged. Files that don't start with an SOI marker are skipped
+//
+// Usage: jpeg12opt [-threads N] [-batch MB] input_dir output_dir
+// Zero threads, the default, uses all the cores. A batch holds about 256 MB of input by default
+// Prints the input and output size of each file, and the totals
+//
+// Build with a native compiler, not emcc:
+// gcc -O2 -c jpeg12-6b/j*.c && g++ -O2 -o jpeg12opt jpeg12opt.cpp jpeg12api.cpp Packer_RLE.cpp *.o -pthread
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "json.hpp"
+
+extern "C"
+{
+    char *transcodetiles(uint8_t *, uint32_t *, int, int, uint8_t *, size_t);
+}
+
+using json = nlohmann::json;
+
+// Appends the regular files under dir, as paths relative to the top directory, sorted by name
+static bool listFiles(const std::string &top, const std::string &dir, std::vector<std::string> &files)
+{
+    DIR *d = opendir((top + dir).c_str());
+    if (!d)
+    {
+        perror((top + dir).c_str());
+        return false;
+    }
+    std::vector<std::string> names;
+    while (struct dirent *e = readdir(d))
+        if (strcmp(e->d_name, ".") && strcmp(e->d_name, ".."))
+            names.push_back(e->d_name);
+    closedir(d);
+    std::sort(names.begin(), names.end());
+
+    bool ok = true;
+    for (const std::string &name : names)
+    {
+        const std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat((top + path).c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            ok = listFiles(top, path, files) && ok;
+        else if (S_ISREG(st.st_mode))
+            files.push_back(path);
+    }
+    return ok;
+}
+
+// Appends the file to data, if it is a JPEG of less than 4 GB
+static bool readFile(const std::string &name, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(name.c_str(), "rb");
+    if (!f)
+        return false;
+    const size_t start = data.size();
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0 && data.size() - start <= UINT32_MAX)
+        data.insert(data.end(), buffer, buffer + n);
+    const bool ok = !ferror(f) && data.size() - start <= UINT32_MAX && data.size() - start >= 2 &&
+                    data[start] == 0xFF && data[start + 1] == 0xD8;
+    fclose(f);
+    if (!ok)
+        data.resize(start);
+    return ok;
+}
+
+// Creates the directories of path below top, as needed
+static bool makeDirectories(const std::string &top, const std::string &path)
+{
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+    {
+        const std::string dir = top + path.substr(0, slash);
+        if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+        {
+            perror(dir.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool writeFile(const std::string &name, const uint8_t *data, size_t size)
+{
+    FILE *f = fopen(name.c_str(), "wb");
+    if (!f)
+        return false;
+    const bool ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = 0;
+    size_t batchBytes = size_t(256) << 20;
+    int arg = 1;
+    for (; arg < argc - 2; arg += 2)
+    {
+        if (!strcmp(argv[arg], "-threads"))
+            threads = atoi(argv[arg + 1]);
+        else if (!strcmp(argv[arg], "-batch"))
+            batchBytes = size_t(atoi(argv[arg + 1])) << 20;
+        else
+            break;
+    }
+    if (argc < 3 || arg != argc - 2 || threads < 0 || batchBytes == 0)
+    {
+        fprintf(stderr, "Usage: %s [-threads N] [-batch MB] input_dir output_dir\n", argv[0]);
+        return 2;
+    }
+    const std::string input = argv[arg];
+    const std::string output = argv[arg + 1];
+    if (mkdir(output.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+        perror(output.c_str());
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    bool ok = listFiles(input, "", files);
+
+    size_t totalInput = 0, totalOutput = 0, count = 0, failed = 0;
+    for (size_t next = 0; next < files.size();)
+    {
+        // Read a batch, at least one file
+        std::vector<uint8_t> data;
+        std::vector<uint32_t> sizes;
+        std::vector<std::string> names;
+        for (; next < files.size() && (names.empty() || data.size() < batchBytes); next++)
+        {
+            const size_t before = data.size();
+            if (!readFile(input + files[next], data))
+            {
+                printf("%s: skipped, not a JPEG\n", files[next].c_str() + 1);
+                continue;
+            }
+            sizes.push_back(static_cast<uint32_t>(data.size() - before));
+            names.push_back(files[next]);
+        }
+        if (names.empty())
+            continue;
+
+        // In place, no tile grows
+        char *result = transcodetiles(data.data(), sizes.data(), static_cast<int>(sizes.size()), threads,
+                                      data.data(), data.size());
+        const json j = json::parse(result, nullptr, false);
+        free(result);
+        if (j.is_discarded() || j.contains("error") || j["tiles"].size() != names.size())
+        {
+            fprintf(stderr, "Transcoding failed: %s\n", j.is_discarded() ? "" : j.dump().c_str());
+            return 1;
+        }
+
+        for (size_t t = 0; t < names.size(); t++)
+        {
+            const json &tile = j["tiles"][t];
+            const size_t offset = tile["offset"];
+            const size_t size = tile["size"];
+            const std::string name = output + names[t];
+            if (!makeDirectories(output, names[t]) || !writeFile(name, data.data() + offset, size))
+            {
+                perror(name.c_str());
+                ok = false;
+                continue;
+            }
+            printf("%s: %u -> %zu bytes, saved %zu", names[t].c_str() + 1, sizes[t], size, sizes[t] - size);
+            if (tile.contains("error"))
+            {
+                printf(", kept: %s", tile["error"].get<std::string>().c_str());
+                failed++;
+            }
+            printf("\n");
+            totalInput += sizes[t];
+            totalOutput += size;
+            count++;
+        }
+    }
+
+    printf("%zu files, %zu failed: %zu -> %zu bytes, saved %zu (%.2f%%)\n", count, failed, totalInput,
+           totalOutput, totalInput - totalOutput,
+           totalInput ? 100.0 * (totalInput - totalOutput) / totalInput : 0.0);
+    return ok && !failed ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+//
+// Native command line tool for lossless transforms of JPEG12 files, through transformimage
+// The DCT coefficients are moved, not decoded, so there is no generation loss, and the Zen mask
+// is transformed to match
+//
+// Usage: jpeg12tran [-crop WxH+X+Y] [-flip horizontal|vertical] [-rotate 90|180|270]
+//                   [-transpose] [-transverse] input.jpg output.jpg
+// The crop is in input pixels and applied first, as in jpegtran
+//
+// Build with a native compiler, not emcc:
+// gcc -O2 -c jpeg12-6b/j*.c && g++ -O2 -o jpeg12tran jpeg12tran.cpp jpeg12api.cpp Packer_RLE.cpp *.o -pthread
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+extern "C"
+{
+    char *transformimage(uint8_t *, size_t, int, int, int, int, int, uint8_t *, size_t);
+}
+
+// The TRANSFORM codes of jpeg12api.cpp
+static int transformCode(const char *option, const char *value)
+{
+    if (!strcmp(option, "-transpose"))
+        return 3;
+    if (!strcmp(option, "-transverse"))
+        return 4;
+    if (!strcmp(option, "-flip") && value)
+        return !strcmp(value, "horizontal") ? 1 : !strcmp(value, "vertical") ? 2 : -1;
+    if (!strcmp(option, "-rotate") && value)
+        return !strcmp(value, "90") ? 5 : !strcmp(value, "180") ? 6 : !strcmp(value, "270") ? 7 : -1;
+    return -1;
+}
+
+static bool readFile(const char *name, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f)
+        return false;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.insert(data.end(), buffer, buffer + n);
+    const bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int transform = 0;
+    int x = 0, y = 0, width = 0, height = 0;
+    int arg = 1;
+    for (; arg < argc - 2; arg++)
+    {
+        if (!strcmp(argv[arg], "-crop") && arg + 1 < argc - 2)
+        {
+            if (sscanf(argv[++arg], "%dx%d+%d+%d", &width, &height, &x, &y) != 4)
+                break;
+            continue;
+        }
+        const bool takesValue = !strcmp(argv[arg], "-flip") || !strcmp(argv[arg], "-rotate");
+        const int code = transformCode(argv[arg], takesValue ? argv[arg + 1] : nullptr);
+        if (code < 0 || transform)
+            break; // Unknown, or a second transform
+        transform = code;
+        arg += takesValue;
+    }
+    if (argc < 3 || arg != argc - 2)
+    {
+        fprintf(stderr, "Usage: %s [-crop WxH+X+Y] [-flip horizontal|vertical] [-rotate 90|180|270]\n"
+                        "       [-transpose] [-transverse] input.jpg output.jpg\n",
+                argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> input;
+    if (!readFile(argv[arg], input))
+    {
+        perror(argv[arg]);
+        return 1;
+    }
+
+    // The output is about the size of the input, the json has the size needed if it isn't
+    std::vector<uint8_t> output(input.size() + 65536);
+    char *result = transformimage(input.data(), input.size(), transform, x, y, width, height,
+                                  output.data(), output.size());
+    const char *needed = strstr(result, "\"outputSize\":");
+    if (needed && strstr(result, "\"error\""))
+    {
+        output.resize(strtoull(needed + 13, nullptr, 10));
+        free(result);
+        result = transformimage(input.data(), input.size(), transform, x, y, width, height,
+                                output.data(), output.size());
+        needed = strstr(result, "\"outputSize\":");
+    }
+    if (strstr(result, "\"error\"") || !needed)
+    {
+        fprintf(stderr, "%s\n", result);
+        free(result);
+        return 1;
+    }
+
+    const size_t size = strtoull(needed + 13, nullptr, 10);
+    FILE *f = fopen(argv[arg + 1], "wb");
+    if (!f || fwrite(output.data(), 1, size, f) != size || fclose(f) != 0)
+    {
+        perror(argv[arg + 1]);
+        free(result);
+        return 1;
+    }
+    printf("%s\n", result);
+    free(result);
+    return 0;
+}